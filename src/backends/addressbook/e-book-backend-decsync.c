@@ -41,7 +41,12 @@
 #include <glib/gi18n-lib.h>
 
 #include <e-source/e-source-decsync.h>
-#include <json-glib/json-glib.h>
+#include <backends/utils/decsync-batch.h>
+#include <backends/utils/decsync-digest.h>
+#include <backends/utils/decsync-fingerprint.h>
+#include <backends/utils/decsync-json.h>
+#include <backends/utils/decsync-scheduler.h>
+#include <backends/utils/decsync-watcher.h>
 #include <libdecsync.h>
 
 #include "e-book-backend-decsync.h"
@@ -61,6 +66,21 @@
 #define SQLITEDB_FOLDER_ID   "folder_id"
 #define SQLITE_REVISION_KEY  "revision"
 
+/* Fingerprint of the DecSync collection when it was last read */
+#define SQLITE_SYNC_STATE_KEY "decsync-sync-state"
+
+/* Below this many vCards they are prepared in the calling thread,
+ * see prepare_contacts() */
+#define PARALLEL_PREPARE_MIN_CONTACTS 8
+
+/* Number of contacts a book view is populated with at a time */
+#define BOOK_VIEW_PAGE_SIZE 250
+
+/* Tokens added to the prefix index are merged into its sorted part once
+ * there are this many, or a sixteenth of the sorted ones, see
+ * prefix_index_update() */
+#define PREFIX_INDEX_MIN_MERGE 1024
+
 /* Forward Declarations */
 static gboolean	book_backend_decsync_refresh_start (EBookBackendDecsync *bf);
 static void	e_book_backend_decsync_initable_init
@@ -78,6 +98,34 @@ struct _EBookBackendDecsyncPrivate {
 
 	EBookSqlite *sqlitedb;
 	Decsync   decsync;
+	DecsyncWatcher *watcher;
+	guint      scheduler_id;
+
+	/* Serializes reading the new entries, which happens both from the
+	 * refresh pool and from the scheduler's workers */
+	GMutex     refresh_lock;
+
+	/* Set while a refresh waits in the pool, see
+	 * book_backend_decsync_refresh_cb() */
+	volatile gint refresh_queued;
+
+	/* Incoming entries which did not change the contact, see
+	 * book_backend_decsync_apply_resources() */
+	volatile gint skipped_entries;
+
+	/* Normalized email addresses of all contacts, for contains_email;
+	 * built on its first use, see email_index_ensure() */
+	GMutex     email_index_lock;
+	GHashTable *email_index; /* gchar *email -> number of contacts */
+	GHashTable *email_index_uids; /* gchar *uid -> gchar **emails */
+
+	/* Normalized names and emails of all contacts, for beginswith
+	 * queries when enabled; built in the background on their first
+	 * use, see prefix_index_search() */
+	GMutex     prefix_index_lock;
+	struct _PrefixIndex *prefix_index;
+	gboolean   prefix_index_building;
+	GPtrArray *prefix_index_log; /* PrefixChange *, see prefix_index_build_cb() */
 };
 
 G_DEFINE_TYPE_WITH_CODE (
@@ -294,7 +342,7 @@ safe_name_for_photo (EBookBackendDecsync *bf,
 {
 	gchar *fullname = NULL, *name, *str;
 	gchar *suffix = NULL;
-	gint i = 0;
+	gint i = 0, fd;
 
 	g_return_val_if_fail (photo->type == E_CONTACT_PHOTO_TYPE_INLINED, NULL);
 
@@ -353,7 +401,16 @@ safe_name_for_photo (EBookBackendDecsync *bf,
 		g_free (str);
 
 		i++;
-	} while (g_file_test (fullname, G_FILE_TEST_EXISTS));
+
+		/* Contacts are prepared in parallel, so the name is claimed
+		 * by creating the file, instead of only testing for it */
+		fd = g_open (fullname, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	} while (fd < 0 && errno == EEXIST);
+
+	if (fd < 0)
+		g_clear_pointer (&fullname, g_free);
+	else
+		close (fd);
 
 	g_free (name);
 	g_free (suffix);
@@ -491,15 +548,24 @@ maybe_transform_vcard_field_for_photo (EBookBackendDecsync *bf,
 		/* Create a unique filename with an extension (hopefully) based on the mime type */
 		new_photo_path = safe_name_for_photo (bf, contact, photo, field);
 
-		if ((uri =
+		if (!new_photo_path) {
+			g_set_error_literal (
+				error, E_CLIENT_ERROR,
+				E_CLIENT_ERROR_OTHER_ERROR,
+				g_strerror (errno));
+
+			status = STATUS_ERROR;
+		} else if ((uri =
 		     g_filename_to_uri (new_photo_path, NULL, error)) == NULL) {
 
+			g_unlink (new_photo_path);
 			status = STATUS_ERROR;
 		} else if (!g_file_set_contents (new_photo_path,
 						 (const gchar *) photo->data.inlined.data,
 						 photo->data.inlined.length,
 						 error)) {
 
+			g_unlink (new_photo_path);
 			status = STATUS_ERROR;
 		} else {
 			new_photo = e_contact_photo_new ();
@@ -606,32 +672,251 @@ maybe_transform_vcard_field_for_photo (EBookBackendDecsync *bf,
 	return status;
 }
 
+/****************************************************************
+ *                 Preparing contacts without the lock          *
+ ****************************************************************/
+
+/* Parsing the vCards and writing their inlined photos to files does not
+ * depend on the stored contacts, so it is done before taking the lock,
+ * in parallel when there are enough of them. Only the photos which are
+ * already uris need the stored contact, see transform_prepared_contact(). */
+typedef struct {
+	GMutex lock;
+	GCond cond;
+	guint pending;
+} PrepareBatch;
+
+typedef struct {
+	EBookBackendDecsync *bf;
+	PrepareBatch *batch;
+	const gchar *vcard; /* NULL for a removed contact, which is skipped */
+	const gchar *uid;
+	EContact *contact;
+	gboolean photo_written; /* the inlined PHOTO was written to a file */
+	gboolean logo_written; /* the inlined LOGO was written to a file */
+	GError *error;
+} PreparedContact;
+
+/* Returns whether @field was inlined, in which case it is written to a file */
+static gboolean
+write_inlined_photo (EBookBackendDecsync *bf,
+                     EContact *contact,
+                     EContactField field,
+                     GError **error)
+{
+	EContactPhoto *photo;
+	gboolean inlined;
+
+	photo = e_contact_get (contact, field);
+	if (!photo)
+		return FALSE;
+
+	inlined = photo->type == E_CONTACT_PHOTO_TYPE_INLINED;
+	e_contact_photo_free (photo);
+
+	if (inlined)
+		maybe_transform_vcard_field_for_photo (bf, NULL, contact, field, error);
+
+	return inlined;
+}
+
+static void
+prepare_contact (PreparedContact *prepared)
+{
+	EBookBackendDecsync *bf = prepared->bf;
+
+	if (prepared->uid)
+		prepared->contact = e_contact_new_from_vcard_with_uid (prepared->vcard, prepared->uid);
+	else
+		prepared->contact = e_contact_new_from_vcard (prepared->vcard);
+
+	/* The files are named after the UID, which is only generated
+	 * under the lock when missing */
+	if (!e_contact_get_const (prepared->contact, E_CONTACT_UID))
+		return;
+
+	prepared->photo_written = write_inlined_photo (bf, prepared->contact, E_CONTACT_PHOTO, &prepared->error);
+	if (!prepared->error)
+		prepared->logo_written = write_inlined_photo (bf, prepared->contact, E_CONTACT_LOGO, &prepared->error);
+}
+
+static void
+prepare_contact_cb (gpointer data,
+                    gpointer user_data)
+{
+	PreparedContact *prepared = data;
+	PrepareBatch *batch = prepared->batch;
+
+	prepare_contact (prepared);
+
+	g_mutex_lock (&batch->lock);
+	if (--batch->pending == 0)
+		g_cond_signal (&batch->cond);
+	g_mutex_unlock (&batch->lock);
+}
+
+/* The pool is shared by all the address books of the process */
+static GThreadPool *
+prepare_pool_get (void)
+{
+	static GThreadPool *pool = NULL;
+
+	if (g_once_init_enter (&pool)) {
+		GThreadPool *new_pool;
+
+		new_pool = g_thread_pool_new (prepare_contact_cb, NULL, g_get_num_processors (), FALSE, NULL);
+		g_once_init_leave (&pool, new_pool);
+	}
+
+	return pool;
+}
+
+static void
+prepare_contacts (EBookBackendDecsync *bf,
+                  PreparedContact *prepared,
+                  guint n_prepared)
+{
+	PrepareBatch batch;
+	GThreadPool *pool = NULL;
+	guint ii, n_vcards = 0;
+
+	for (ii = 0; ii < n_prepared; ii++) {
+		prepared[ii].bf = bf;
+		if (prepared[ii].vcard)
+			n_vcards++;
+	}
+
+	if (n_vcards >= PARALLEL_PREPARE_MIN_CONTACTS && g_get_num_processors () > 1)
+		pool = prepare_pool_get ();
+
+	if (!pool) {
+		for (ii = 0; ii < n_prepared; ii++) {
+			if (prepared[ii].vcard)
+				prepare_contact (&prepared[ii]);
+		}
+
+		return;
+	}
+
+	g_mutex_init (&batch.lock);
+	g_cond_init (&batch.cond);
+	batch.pending = n_vcards;
+
+	for (ii = 0; ii < n_prepared; ii++) {
+		if (!prepared[ii].vcard)
+			continue;
+
+		prepared[ii].batch = &batch;
+		g_thread_pool_push (pool, &prepared[ii], NULL);
+	}
+
+	/* Waits for all of them to be prepared */
+	g_mutex_lock (&batch.lock);
+	while (batch.pending > 0)
+		g_cond_wait (&batch.cond, &batch.lock);
+	g_mutex_unlock (&batch.lock);
+
+	g_mutex_clear (&batch.lock);
+	g_cond_clear (&batch.cond);
+}
+
+static PreparedContact *
+prepared_contacts_new (EBookBackendDecsync *bf,
+                       const gchar * const *vcards,
+                       const gchar * const *uids,
+                       guint length)
+{
+	PreparedContact *prepared;
+	guint ii;
+
+	prepared = g_new0 (PreparedContact, length);
+	for (ii = 0; ii < length; ii++) {
+		prepared[ii].vcard = vcards[ii];
+		prepared[ii].uid = uids ? uids[ii] : NULL;
+	}
+
+	prepare_contacts (bf, prepared, length);
+
+	return prepared;
+}
+
+/* Removes the photo files written for @prepared, when it is not stored */
+static void
+prepared_contact_discard_photos (EBookBackendDecsync *bf,
+                                 PreparedContact *prepared)
+{
+	EContactField fields[2] = { E_CONTACT_PHOTO, E_CONTACT_LOGO };
+	gboolean written[2] = { prepared->photo_written, prepared->logo_written };
+	gint ii;
+
+	for (ii = 0; ii < 2; ii++) {
+		EContactPhoto *photo;
+
+		if (!written[ii])
+			continue;
+
+		photo = e_contact_get (prepared->contact, fields[ii]);
+		if (photo && photo->type == E_CONTACT_PHOTO_TYPE_URI)
+			maybe_delete_uri (bf, photo->data.uri);
+		e_contact_photo_free (photo);
+	}
+
+	prepared->photo_written = FALSE;
+	prepared->logo_written = FALSE;
+}
+
+static void
+prepared_contacts_free (EBookBackendDecsync *bf,
+                        PreparedContact *prepared,
+                        guint n_prepared,
+                        gboolean stored)
+{
+	guint ii;
+
+	for (ii = 0; ii < n_prepared; ii++) {
+		if (!stored && prepared[ii].contact)
+			prepared_contact_discard_photos (bf, &prepared[ii]);
+
+		g_clear_object (&prepared[ii].contact);
+		g_clear_error (&prepared[ii].error);
+	}
+
+	g_free (prepared);
+}
+
 /*
  * When a contact is added or modified we receive a vCard,
  * this function checks if we've received inline data
- * and replaces it with a uri notation.
- *
- * If this function modifies 'contact' then it will
- * return the 'modified' status and 'vcard_ret' (if specified)
- * will be set to a newly allocated vcard string.
+ * and replaces it with a uri notation, for the fields
+ * which were not already written to a file by
+ * prepare_contacts().
  */
 static PhotoModifiedStatus
-maybe_transform_vcard_for_photo (EBookBackendDecsync *bf,
-                                 EContact *old_contact,
-                                 EContact *contact,
-                                 GError **error)
+transform_prepared_contact (EBookBackendDecsync *bf,
+                            EContact *old_contact,
+                            PreparedContact *prepared,
+                            GError **error)
 {
-	PhotoModifiedStatus status;
-	gboolean            modified = FALSE;
+	PhotoModifiedStatus status = STATUS_NORMAL;
+	gboolean modified = FALSE;
 
-	status = maybe_transform_vcard_field_for_photo (
-		bf, old_contact, contact,
-		E_CONTACT_PHOTO, error);
-	modified = (status == STATUS_MODIFIED);
+	if (prepared->error) {
+		g_propagate_error (error, g_error_copy (prepared->error));
+		return STATUS_ERROR;
+	}
 
-	if (status != STATUS_ERROR) {
+	modified = prepared->photo_written || prepared->logo_written;
+
+	if (!prepared->photo_written) {
+		status = maybe_transform_vcard_field_for_photo (
+			bf, old_contact, prepared->contact,
+			E_CONTACT_PHOTO, error);
+		modified = modified || (status == STATUS_MODIFIED);
+	}
+
+	if (status != STATUS_ERROR && !prepared->logo_written) {
 		status = maybe_transform_vcard_field_for_photo (
-			bf, old_contact, contact,
+			bf, old_contact, prepared->contact,
 			E_CONTACT_LOGO, error);
 		modified = modified || (status == STATUS_MODIFIED);
 	}
@@ -797,6 +1082,707 @@ cursors_contact_removed (EBookBackendDecsync *bf,
 	}
 }
 
+/****************************************************************
+ *                        Email Index                           *
+ ****************************************************************/
+static gchar *
+email_index_normalize (const gchar *email)
+{
+	gchar *stripped, *normalized;
+
+	if (!email)
+		return NULL;
+
+	stripped = g_strstrip (g_strdup (email));
+	normalized = *stripped ? e_util_utf8_normalize (stripped) : NULL;
+	g_free (stripped);
+
+	return normalized;
+}
+
+/* Called with email_index_lock held */
+static void
+email_index_remove_uid (EBookBackendDecsync *bf,
+                        const gchar *uid)
+{
+	EBookBackendDecsyncPrivate *priv = bf->priv;
+	gchar **emails;
+	guint ii;
+
+	emails = g_hash_table_lookup (priv->email_index_uids, uid);
+	if (!emails)
+		return;
+
+	for (ii = 0; emails[ii]; ii++) {
+		guint count = GPOINTER_TO_UINT (g_hash_table_lookup (priv->email_index, emails[ii]));
+
+		if (count > 1)
+			g_hash_table_insert (priv->email_index, g_strdup (emails[ii]), GUINT_TO_POINTER (count - 1));
+		else
+			g_hash_table_remove (priv->email_index, emails[ii]);
+	}
+
+	g_hash_table_remove (priv->email_index_uids, uid);
+}
+
+/* Called with email_index_lock held */
+static void
+email_index_add_contact (EBookBackendDecsync *bf,
+                         EContact *contact)
+{
+	EBookBackendDecsyncPrivate *priv = bf->priv;
+	GPtrArray *emails;
+	GList *values, *link;
+	const gchar *uid;
+
+	uid = e_contact_get_const (contact, E_CONTACT_UID);
+	if (!uid)
+		return;
+
+	email_index_remove_uid (bf, uid);
+
+	emails = g_ptr_array_new ();
+
+	values = e_contact_get (contact, E_CONTACT_EMAIL);
+	for (link = values; link; link = g_list_next (link)) {
+		gchar *email = email_index_normalize (link->data);
+		guint count, ii;
+
+		if (!email)
+			continue;
+
+		/* Each contact is counted once per address */
+		for (ii = 0; ii < emails->len; ii++) {
+			if (g_str_equal (emails->pdata[ii], email))
+				break;
+		}
+
+		if (ii < emails->len) {
+			g_free (email);
+			continue;
+		}
+
+		count = GPOINTER_TO_UINT (g_hash_table_lookup (priv->email_index, email));
+		g_hash_table_insert (priv->email_index, g_strdup (email), GUINT_TO_POINTER (count + 1));
+		g_ptr_array_add (emails, email);
+	}
+	g_list_free_full (values, g_free);
+
+	if (emails->len > 0) {
+		g_ptr_array_add (emails, NULL);
+		g_hash_table_insert (priv->email_index_uids, g_strdup (uid), g_ptr_array_free (emails, FALSE));
+	} else {
+		g_ptr_array_free (emails, TRUE);
+	}
+}
+
+/* Keeps a built index in sync with committed changes. Called with the
+ * write lock held. */
+static void
+email_index_update (EBookBackendDecsync *bf,
+                    const GSList *contacts,
+                    const GSList *removed_uids)
+{
+	EBookBackendDecsyncPrivate *priv = bf->priv;
+	const GSList *link;
+
+	g_mutex_lock (&priv->email_index_lock);
+
+	if (priv->email_index) {
+		for (link = contacts; link; link = g_slist_next (link))
+			email_index_add_contact (bf, E_CONTACT (link->data));
+
+		for (link = removed_uids; link; link = g_slist_next (link))
+			email_index_remove_uid (bf, link->data);
+	}
+
+	g_mutex_unlock (&priv->email_index_lock);
+}
+
+/* Builds the index from the stored contacts, if not built yet. Called
+ * with the read lock and email_index_lock held. */
+static gboolean
+email_index_ensure (EBookBackendDecsync *bf,
+                    GCancellable *cancellable,
+                    GError **error)
+{
+	EBookBackendDecsyncPrivate *priv = bf->priv;
+	GSList *results = NULL, *link;
+	gboolean success;
+
+	if (priv->email_index)
+		return TRUE;
+
+	success = e_book_sqlite_lock (priv->sqlitedb, EBSQL_LOCK_READ, cancellable, error);
+	if (!success)
+		return FALSE;
+
+	success = e_book_sqlite_search (priv->sqlitedb, NULL, FALSE, &results, cancellable, error);
+
+	e_book_sqlite_unlock (priv->sqlitedb, EBSQL_UNLOCK_NONE, NULL);
+
+	if (!success)
+		return FALSE;
+
+	priv->email_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	priv->email_index_uids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_strfreev);
+
+	for (link = results; link; link = g_slist_next (link)) {
+		EbSqlSearchData *data = link->data;
+		EContact *contact;
+
+		contact = e_contact_new_from_vcard_with_uid (data->vcard, data->uid);
+		email_index_add_contact (bf, contact);
+		g_object_unref (contact);
+	}
+
+	g_slist_free_full (results, (GDestroyNotify) e_book_sqlite_search_data_free);
+
+	return TRUE;
+}
+
+/****************************************************************
+ *                        Prefix Index                          *
+ ****************************************************************/
+
+/* The names and emails of the contacts, for autocompletion. Tokens are
+ * kept in an array sorted by field and value, found by a binary search.
+ * Changed contacts are marked stale and their new tokens appended to a
+ * small unsorted array, which is merged into the sorted one from time
+ * to time, dropping the stale tokens.
+ *
+ * The index is only kept when enabled in the source. It is built in the
+ * background, and queries go to EBookSqlite until it is ready. */
+
+typedef struct {
+	gchar *uid;
+	gboolean stale; /* changed or removed since its tokens were added */
+} PrefixContact;
+
+typedef struct {
+	EContactField field;
+	gchar *value; /* normalized */
+	PrefixContact *contact;
+} PrefixToken;
+
+typedef struct _PrefixIndex {
+	GArray *sorted; /* PrefixToken, by field and value */
+	GArray *pending; /* PrefixToken, added since the last merge */
+	GHashTable *contacts; /* gchar *uid -> PrefixContact *, the current ones */
+	GPtrArray *stale_contacts; /* PrefixContact *, freed by the next merge */
+} PrefixIndex;
+
+/* A change committed while the index is being built */
+typedef struct {
+	EContact *contact; /* NULL for a removal */
+	gchar *removed_uid;
+} PrefixChange;
+
+static const EContactField prefix_index_fields[] = {
+	E_CONTACT_FULL_NAME,
+	E_CONTACT_GIVEN_NAME,
+	E_CONTACT_FAMILY_NAME,
+	E_CONTACT_NICKNAME,
+	E_CONTACT_FILE_AS,
+	E_CONTACT_EMAIL
+};
+
+static void
+prefix_change_free (gpointer data)
+{
+	PrefixChange *change = data;
+
+	g_clear_object (&change->contact);
+	g_free (change->removed_uid);
+	g_free (change);
+}
+
+static void
+prefix_contact_free (gpointer data)
+{
+	PrefixContact *contact = data;
+
+	g_free (contact->uid);
+	g_free (contact);
+}
+
+static void
+prefix_token_clear (gpointer data)
+{
+	PrefixToken *token = data;
+
+	g_free (token->value);
+}
+
+static gint
+prefix_token_compare (gconstpointer a,
+                      gconstpointer b)
+{
+	const PrefixToken *token1 = a, *token2 = b;
+
+	if (token1->field != token2->field)
+		return token1->field < token2->field ? -1 : 1;
+
+	return strcmp (token1->value, token2->value);
+}
+
+static PrefixIndex *
+prefix_index_new (void)
+{
+	PrefixIndex *index;
+
+	index = g_new0 (PrefixIndex, 1);
+	index->sorted = g_array_new (FALSE, FALSE, sizeof (PrefixToken));
+	g_array_set_clear_func (index->sorted, prefix_token_clear);
+	index->pending = g_array_new (FALSE, FALSE, sizeof (PrefixToken));
+	g_array_set_clear_func (index->pending, prefix_token_clear);
+	index->contacts = g_hash_table_new (g_str_hash, g_str_equal);
+	index->stale_contacts = g_ptr_array_new_with_free_func (prefix_contact_free);
+
+	return index;
+}
+
+static void
+prefix_index_free (PrefixIndex *index)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (!index)
+		return;
+
+	g_array_unref (index->sorted);
+	g_array_unref (index->pending);
+
+	g_hash_table_iter_init (&iter, index->contacts);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		prefix_contact_free (value);
+	g_hash_table_destroy (index->contacts);
+
+	g_ptr_array_unref (index->stale_contacts);
+	g_free (index);
+}
+
+static void
+prefix_index_add_token (PrefixIndex *index,
+                        EContactField field,
+                        const gchar *value,
+                        PrefixContact *contact)
+{
+	PrefixToken token;
+
+	token.value = email_index_normalize (value);
+	if (!token.value)
+		return;
+
+	token.field = field;
+	token.contact = contact;
+
+	g_array_append_val (index->pending, token);
+}
+
+static void
+prefix_index_remove_uid (PrefixIndex *index,
+                         const gchar *uid)
+{
+	PrefixContact *contact;
+
+	contact = g_hash_table_lookup (index->contacts, uid);
+	if (!contact)
+		return;
+
+	g_hash_table_remove (index->contacts, uid);
+	contact->stale = TRUE;
+	g_ptr_array_add (index->stale_contacts, contact);
+}
+
+static void
+prefix_index_add_contact (PrefixIndex *index,
+                          EContact *econtact)
+{
+	PrefixContact *contact;
+	const gchar *uid;
+	guint ii;
+
+	uid = e_contact_get_const (econtact, E_CONTACT_UID);
+	if (!uid)
+		return;
+
+	prefix_index_remove_uid (index, uid);
+
+	contact = g_new0 (PrefixContact, 1);
+	contact->uid = g_strdup (uid);
+	g_hash_table_insert (index->contacts, contact->uid, contact);
+
+	for (ii = 0; ii < G_N_ELEMENTS (prefix_index_fields); ii++) {
+		EContactField field = prefix_index_fields[ii];
+
+		if (e_contact_field_is_string (field)) {
+			prefix_index_add_token (index, field, e_contact_get_const (econtact, field), contact);
+		} else {
+			GList *values, *link;
+
+			values = e_contact_get (econtact, field);
+			for (link = values; link; link = g_list_next (link))
+				prefix_index_add_token (index, field, link->data, contact);
+			g_list_free_full (values, g_free);
+		}
+	}
+}
+
+static void
+prefix_index_merge (PrefixIndex *index)
+{
+	GArray *merged;
+	guint ii;
+
+	merged = g_array_sized_new (FALSE, FALSE, sizeof (PrefixToken), index->sorted->len + index->pending->len);
+	g_array_set_clear_func (merged, prefix_token_clear);
+
+	/* The values are moved, so the old arrays must not clear them */
+	for (ii = 0; ii < index->sorted->len; ii++) {
+		PrefixToken *token = &g_array_index (index->sorted, PrefixToken, ii);
+
+		if (token->contact->stale)
+			g_free (token->value);
+		else
+			g_array_append_val (merged, *token);
+	}
+
+	for (ii = 0; ii < index->pending->len; ii++) {
+		PrefixToken *token = &g_array_index (index->pending, PrefixToken, ii);
+
+		if (token->contact->stale)
+			g_free (token->value);
+		else
+			g_array_append_val (merged, *token);
+	}
+
+	g_array_set_clear_func (index->sorted, NULL);
+	g_array_unref (index->sorted);
+	g_array_set_clear_func (index->pending, NULL);
+	g_array_set_size (index->pending, 0);
+	g_array_set_clear_func (index->pending, prefix_token_clear);
+
+	g_array_sort (merged, prefix_token_compare);
+	index->sorted = merged;
+
+	g_ptr_array_set_size (index->stale_contacts, 0);
+}
+
+static void
+prefix_index_maybe_merge (PrefixIndex *index)
+{
+	if (index->pending->len >= MAX (PREFIX_INDEX_MIN_MERGE, index->sorted->len / 16))
+		prefix_index_merge (index);
+}
+
+/* Keeps a built index in sync with committed changes, or logs them for
+ * the index being built. Called with the write lock held. */
+static void
+prefix_index_update (EBookBackendDecsync *bf,
+                     const GSList *contacts,
+                     const GSList *removed_uids)
+{
+	EBookBackendDecsyncPrivate *priv = bf->priv;
+	PrefixIndex *index;
+	const GSList *link;
+
+	g_mutex_lock (&priv->prefix_index_lock);
+
+	index = priv->prefix_index;
+	if (index) {
+		for (link = contacts; link; link = g_slist_next (link))
+			prefix_index_add_contact (index, E_CONTACT (link->data));
+
+		for (link = removed_uids; link; link = g_slist_next (link))
+			prefix_index_remove_uid (index, link->data);
+
+		prefix_index_maybe_merge (index);
+	} else if (priv->prefix_index_log) {
+		for (link = contacts; link; link = g_slist_next (link)) {
+			PrefixChange *change = g_new0 (PrefixChange, 1);
+
+			change->contact = g_object_ref (link->data);
+			g_ptr_array_add (priv->prefix_index_log, change);
+		}
+
+		for (link = removed_uids; link; link = g_slist_next (link)) {
+			PrefixChange *change = g_new0 (PrefixChange, 1);
+
+			change->removed_uid = g_strdup (link->data);
+			g_ptr_array_add (priv->prefix_index_log, change);
+		}
+	}
+
+	g_mutex_unlock (&priv->prefix_index_lock);
+}
+
+/* Builds the index from the stored contacts. The contacts are read with
+ * the read lock held and the log of the changes committed afterwards is
+ * started before it is released; the log is applied once the contacts
+ * are indexed, without any lock, and the index is published. */
+static void
+prefix_index_build_cb (gpointer data,
+                       gpointer user_data)
+{
+	EBookBackendDecsync *bf = data;
+	EBookBackendDecsyncPrivate *priv = bf->priv;
+	PrefixIndex *index;
+	GSList *results = NULL, *link;
+	GPtrArray *log;
+	gboolean success;
+	guint ii;
+
+	g_rw_lock_reader_lock (&priv->lock);
+
+	success = e_book_sqlite_lock (priv->sqlitedb, EBSQL_LOCK_READ, NULL, NULL);
+	if (success) {
+		success = e_book_sqlite_search (priv->sqlitedb, NULL, FALSE, &results, NULL, NULL);
+		e_book_sqlite_unlock (priv->sqlitedb, EBSQL_UNLOCK_NONE, NULL);
+	}
+
+	g_mutex_lock (&priv->prefix_index_lock);
+	if (success)
+		priv->prefix_index_log = g_ptr_array_new_with_free_func (prefix_change_free);
+	else
+		priv->prefix_index_building = FALSE; /* tried again by the next query */
+	g_mutex_unlock (&priv->prefix_index_lock);
+
+	g_rw_lock_reader_unlock (&priv->lock);
+
+	if (!success) {
+		g_object_unref (bf);
+		return;
+	}
+
+	index = prefix_index_new ();
+
+	for (link = results; link; link = g_slist_next (link)) {
+		EbSqlSearchData *search_data = link->data;
+		EContact *contact;
+
+		contact = e_contact_new_from_vcard_with_uid (search_data->vcard, search_data->uid);
+		prefix_index_add_contact (index, contact);
+		g_object_unref (contact);
+	}
+
+	g_slist_free_full (results, (GDestroyNotify) e_book_sqlite_search_data_free);
+
+	prefix_index_merge (index);
+
+	g_mutex_lock (&priv->prefix_index_lock);
+
+	log = priv->prefix_index_log;
+	priv->prefix_index_log = NULL;
+
+	for (ii = 0; ii < log->len; ii++) {
+		PrefixChange *change = g_ptr_array_index (log, ii);
+
+		if (change->contact)
+			prefix_index_add_contact (index, change->contact);
+		else
+			prefix_index_remove_uid (index, change->removed_uid);
+	}
+	prefix_index_maybe_merge (index);
+
+	priv->prefix_index = index;
+	priv->prefix_index_building = FALSE;
+
+	g_mutex_unlock (&priv->prefix_index_lock);
+
+	g_ptr_array_unref (log);
+	g_object_unref (bf);
+}
+
+/* The pool is shared by all the address books of the process */
+static GThreadPool *
+prefix_index_pool_get (void)
+{
+	static GThreadPool *pool = NULL;
+
+	if (g_once_init_enter (&pool)) {
+		GThreadPool *new_pool;
+
+		new_pool = g_thread_pool_new (prefix_index_build_cb, NULL, g_get_num_processors (), FALSE, NULL);
+		g_once_init_leave (&pool, new_pool);
+	}
+
+	return pool;
+}
+
+static void
+prefix_index_collect (GArray *tokens,
+                      guint from,
+                      gboolean sorted,
+                      EContactField field,
+                      const gchar *prefix,
+                      GHashTable *seen,
+                      GPtrArray *uids)
+{
+	guint ii;
+
+	for (ii = from; ii < tokens->len; ii++) {
+		PrefixToken *token = &g_array_index (tokens, PrefixToken, ii);
+
+		if (token->field != field || !g_str_has_prefix (token->value, prefix)) {
+			/* Past the matching range of the sorted tokens */
+			if (sorted)
+				break;
+			continue;
+		}
+
+		if (!token->contact->stale && g_hash_table_add (seen, token->contact->uid))
+			g_ptr_array_add (uids, token->contact->uid);
+	}
+}
+
+/* (beginswith "field" "prefix"), with the uids owned by the index; without
+ * an index it only checks that the index can answer it */
+static ESExpResult *
+prefix_index_beginswith (ESExp *esexp,
+                         gint argc,
+                         ESExpResult **argv,
+                         gpointer user_data)
+{
+	PrefixIndex *index = user_data;
+	ESExpResult *result;
+	PrefixToken key;
+	GHashTable *seen;
+	GPtrArray *uids;
+	guint ii, low, high;
+
+	if (argc != 2 ||
+	    argv[0]->type != ESEXP_RES_STRING ||
+	    argv[1]->type != ESEXP_RES_STRING)
+		e_sexp_fatal_error (esexp, "Unsupported beginswith");
+
+	key.field = e_contact_field_id (argv[0]->value.string);
+	for (ii = 0; ii < G_N_ELEMENTS (prefix_index_fields); ii++) {
+		if (prefix_index_fields[ii] == key.field)
+			break;
+	}
+
+	key.value = email_index_normalize (argv[1]->value.string);
+
+	/* Anything else is left to the summary */
+	if (ii == G_N_ELEMENTS (prefix_index_fields) || !key.value) {
+		g_free (key.value);
+		e_sexp_fatal_error (esexp, "Unsupported beginswith");
+	}
+
+	uids = g_ptr_array_new ();
+
+	if (!index) {
+		g_free (key.value);
+
+		result = e_sexp_result_new (esexp, ESEXP_RES_ARRAY_PTR);
+		result->value.ptrarray = uids;
+
+		return result;
+	}
+
+	/* The first token not before the prefix */
+	low = 0;
+	high = index->sorted->len;
+	while (low < high) {
+		guint mid = low + (high - low) / 2;
+
+		if (prefix_token_compare (&g_array_index (index->sorted, PrefixToken, mid), &key) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	seen = g_hash_table_new (g_str_hash, g_str_equal);
+
+	prefix_index_collect (index->sorted, low, TRUE, key.field, key.value, seen, uids);
+	prefix_index_collect (index->pending, 0, FALSE, key.field, key.value, seen, uids);
+
+	g_hash_table_destroy (seen);
+	g_free (key.value);
+
+	result = e_sexp_result_new (esexp, ESEXP_RES_ARRAY_PTR);
+	result->value.ptrarray = uids;
+
+	return result;
+}
+
+/* Evaluates @query against @index, or only checks that it is made of
+ * beginswith on the names and emails, combined with "and" and "or", when
+ * @index is NULL. Returns FALSE for any other query. */
+static gboolean
+prefix_index_eval (PrefixIndex *index,
+                   const gchar *query,
+                   GSList **out_uids)
+{
+	ESExp *esexp;
+	ESExpResult *result = NULL;
+	gboolean success = FALSE;
+
+	esexp = e_sexp_new ();
+	e_sexp_add_function (esexp, 0, "beginswith", prefix_index_beginswith, index);
+	e_sexp_input_text (esexp, query, strlen (query));
+
+	if (e_sexp_parse (esexp) != -1)
+		result = e_sexp_eval (esexp);
+
+	if (result && result->type == ESEXP_RES_ARRAY_PTR) {
+		guint ii;
+
+		for (ii = 0; out_uids && ii < result->value.ptrarray->len; ii++)
+			*out_uids = g_slist_prepend (*out_uids, g_strdup (result->value.ptrarray->pdata[ii]));
+
+		success = TRUE;
+	}
+
+	if (result)
+		e_sexp_result_free (esexp, result);
+	g_object_unref (esexp);
+
+	return success;
+}
+
+/* Answers queries made of beginswith on the names and emails, combined
+ * with "and" and "or", as autocompletion does, once the index is enabled
+ * and built. Returns FALSE for any other query, and while the index is
+ * being built. Called with the read lock held. */
+static gboolean
+prefix_index_search (EBookBackendDecsync *bf,
+                     const gchar *query,
+                     GSList **out_uids)
+{
+	EBookBackendDecsyncPrivate *priv = bf->priv;
+	ESourceDecsync *decsync_extension;
+	gboolean success = FALSE;
+
+	*out_uids = NULL;
+
+	if (!query)
+		return FALSE;
+
+	decsync_extension = e_source_get_extension (e_backend_get_source (E_BACKEND (bf)), E_SOURCE_EXTENSION_DECSYNC_BACKEND);
+	if (!e_source_decsync_get_autocomplete_index (decsync_extension))
+		return FALSE;
+
+	/* Other queries never start building the index */
+	if (!prefix_index_eval (NULL, query, NULL))
+		return FALSE;
+
+	g_mutex_lock (&priv->prefix_index_lock);
+
+	if (priv->prefix_index) {
+		success = prefix_index_eval (priv->prefix_index, query, out_uids);
+	} else if (!priv->prefix_index_building) {
+		priv->prefix_index_building = TRUE;
+		g_thread_pool_push (prefix_index_pool_get (), g_object_ref (bf), NULL);
+	}
+
+	g_mutex_unlock (&priv->prefix_index_lock);
+
+	return success;
+}
+
 /****************************************************************
  *                   Main Backend Implementation                *
  ****************************************************************/
@@ -809,31 +1795,23 @@ cursors_contact_removed (EBookBackendDecsync *bf,
  */
 static gboolean
 do_create (EBookBackendDecsync *bf,
-           const gchar * const *vcards,
-           const gchar * const *uids,
+           PreparedContact *prepared,
+           guint length,
            GSList **out_contacts,
            GCancellable *cancellable,
            GError **error,
-           gboolean update_decsync)
+           DecsyncBatch *batch)
 {
 	PhotoModifiedStatus status = STATUS_NORMAL;
-	guint ii, length;
+	guint ii;
 	GError *local_error = NULL;
-	const gchar *path[2];
-	JsonNode *key_node, *value_node;
-	gchar *key_string, *value_string;
-
-	length = g_strv_length ((gchar **) vcards);
 
 	for (ii = 0; ii < length; ii++) {
 		gchar           *id;
 		const gchar     *rev;
 		EContact        *contact;
 
-		if (uids != NULL && uids[ii] != NULL)
-			contact = e_contact_new_from_vcard_with_uid (vcards[ii], uids[ii]);
-		else
-			contact = e_contact_new_from_vcard (vcards[ii]);
+		contact = g_object_ref (prepared[ii].contact);
 
 		/* Preserve original UID, create a unique UID if needed */
 		if (e_contact_get_const (contact, E_CONTACT_UID) == NULL) {
@@ -842,30 +1820,14 @@ do_create (EBookBackendDecsync *bf,
 			g_free (id);
 		}
 
-		if (update_decsync) {
-			id = e_contact_get (contact, E_CONTACT_UID);
-
-			path[0] = "resources";
-			path[1] = id;
-			key_node = json_node_new (JSON_NODE_NULL);
-			key_string = json_to_string (key_node, FALSE);
-			value_node = json_node_new (JSON_NODE_VALUE);
-			json_node_set_string (value_node, vcards[ii]);
-			value_string = json_to_string (value_node, FALSE);
-			decsync_set_entry(bf->priv->decsync, path, 2, key_string, value_string);
-			json_node_free (key_node);
-			g_free (key_string);
-			json_node_free (value_node);
-			g_free (value_string);
-
-			g_free (id);
-		}
+		if (batch)
+			decsync_batch_set_resource (batch, e_contact_get_const (contact, E_CONTACT_UID), prepared[ii].vcard);
 
 		rev = e_contact_get_const (contact, E_CONTACT_REV);
 		if (!(rev && *rev))
 			set_revision (bf, contact);
 
-		status = maybe_transform_vcard_for_photo (bf, NULL, contact, error);
+		status = transform_prepared_contact (bf, NULL, &prepared[ii], error);
 
 		if (status != STATUS_ERROR) {
 
@@ -971,6 +1933,112 @@ notify_update_vcard (EDataBookView *book_view,
 		e_data_book_view_notify_update_vcard (book_view, id, vcard);
 }
 
+/* Notifies @book_view of the contacts matching @query a page at a time,
+ * so neither the whole result nor the lock is held at once for a big
+ * book, and a stopped view stops reading. Sets @out_paged to FALSE when
+ * the query cannot be read with a cursor, leaving it to the caller. */
+static gboolean
+book_view_notify_paged (EBookBackendDecsync *bf,
+                        EDataBookView *book_view,
+                        DecsyncBackendSearchClosure *closure,
+                        const gchar *query,
+                        gboolean *out_paged,
+                        GError **error)
+{
+	EbSqlCursor *cursor;
+	EContactField sort_field = E_CONTACT_FILE_AS;
+	EBookCursorSortType sort_type = E_BOOK_CURSOR_SORT_ASCENDING;
+	gboolean success = TRUE;
+
+	/* Any summarized field will do, the order of the pages does not
+	 * matter; FILE_AS is in the default summary */
+	g_rw_lock_reader_lock (&(bf->priv->lock));
+	cursor = e_book_sqlite_cursor_new (bf->priv->sqlitedb, query, &sort_field, &sort_type, 1, NULL);
+	g_rw_lock_reader_unlock (&(bf->priv->lock));
+
+	*out_paged = cursor != NULL;
+	if (!cursor)
+		return TRUE;
+
+	while (e_flag_is_set (closure->running)) {
+		GSList *results = NULL, *link;
+		gint n_results;
+
+		g_rw_lock_reader_lock (&(bf->priv->lock));
+		n_results = e_book_sqlite_cursor_step (
+			bf->priv->sqlitedb, cursor,
+			EBSQL_CURSOR_STEP_MOVE | EBSQL_CURSOR_STEP_FETCH,
+			EBSQL_CURSOR_ORIGIN_CURRENT,
+			BOOK_VIEW_PAGE_SIZE,
+			&results,
+			NULL, /* GCancellable */
+			error);
+		g_rw_lock_reader_unlock (&(bf->priv->lock));
+
+		if (n_results < 0) {
+			success = FALSE;
+			break;
+		}
+
+		for (link = results; link; link = g_slist_next (link)) {
+			EbSqlSearchData *data = link->data;
+
+			notify_update_vcard (book_view, TRUE, data->uid, data->vcard);
+		}
+
+		g_slist_free_full (results, (GDestroyNotify) e_book_sqlite_search_data_free);
+
+		/* A short page is the last one */
+		if (n_results < BOOK_VIEW_PAGE_SIZE)
+			break;
+	}
+
+	e_book_sqlite_cursor_free (bf->priv->sqlitedb, cursor);
+
+	return success;
+}
+
+/* Notifies the contacts matching a query answered by prefix_index_search(),
+ * with only the summary fields when @meta_contact is set. Returns FALSE
+ * when the query is not supported by the index. */
+static gboolean
+book_view_notify_indexed (EBookBackendDecsync *bf,
+                          EDataBookView *book_view,
+                          DecsyncBackendSearchClosure *closure,
+                          const gchar *query,
+                          gboolean meta_contact)
+{
+	GSList *uids = NULL, *link;
+	gboolean indexed;
+
+	g_rw_lock_reader_lock (&(bf->priv->lock));
+	indexed = prefix_index_search (bf, query, &uids);
+	g_rw_lock_reader_unlock (&(bf->priv->lock));
+
+	if (!indexed)
+		return FALSE;
+
+	for (link = uids; link && e_flag_is_set (closure->running); link = g_slist_next (link)) {
+		gchar *vcard = NULL;
+		gboolean found;
+
+		g_rw_lock_reader_lock (&(bf->priv->lock));
+		found = e_book_sqlite_get_vcard (bf->priv->sqlitedb, link->data, meta_contact, &vcard, NULL);
+		g_rw_lock_reader_unlock (&(bf->priv->lock));
+
+		/* Removed meanwhile, which the view is notified of anyway */
+		if (!found)
+			continue;
+
+		notify_update_vcard (book_view, TRUE, link->data, vcard);
+		g_free (vcard);
+	}
+
+	g_slist_free_full (uids, g_free);
+
+	return TRUE;
+}
+
 static gboolean
 uid_rev_fields (GHashTable *fields_of_interest)
 {
@@ -1004,7 +2072,7 @@ book_view_thread (gpointer user_data)
 	GSList *summary_list = NULL, *l;
 	GHashTable *fields_of_interest;
 	GError *local_error = NULL;
-	gboolean meta_contact, success;
+	gboolean meta_contact, success, paged = FALSE;
 
 	g_return_val_if_fail (E_IS_DATA_BOOK_VIEW (book_view), NULL);
 
@@ -1036,15 +2104,28 @@ book_view_thread (gpointer user_data)
 	d (printf ("signalling parent thread\n"));
 	e_flag_set (closure->running);
 
-	g_rw_lock_reader_lock (&(bf->priv->lock));
-	success = e_book_sqlite_search (
-		bf->priv->sqlitedb,
-		query,
-		meta_contact,
-		&summary_list,
-		NULL, /* GCancellable */
-		&local_error);
-	g_rw_lock_reader_unlock (&(bf->priv->lock));
+	/* Autocompletion is answered from the prefix index, and only the
+	 * uid and revision are small enough to read in one go */
+	if (book_view_notify_indexed (bf, book_view, closure, query, meta_contact)) {
+		success = TRUE;
+		paged = TRUE;
+	} else if (meta_contact) {
+		success = TRUE;
+	} else {
+		success = book_view_notify_paged (bf, book_view, closure, query, &paged, &local_error);
+	}
+
+	if (success && !paged) {
+		g_rw_lock_reader_lock (&(bf->priv->lock));
+		success = e_book_sqlite_search (
+			bf->priv->sqlitedb,
+			query,
+			meta_contact,
+			&summary_list,
+			NULL, /* GCancellable */
+			&local_error);
+		g_rw_lock_reader_unlock (&(bf->priv->lock));
+	}
 
 	if (!success) {
 		g_warning (G_STRLOC ": Failed to query initial contacts: %s", local_error->message);
@@ -1091,6 +2172,12 @@ book_backend_decsync_dispose (GObject *object)
 
 	bf = E_BOOK_BACKEND_DECSYNC (object);
 
+	if (bf->priv->scheduler_id) {
+		decsync_scheduler_remove (bf->priv->scheduler_id);
+		bf->priv->scheduler_id = 0;
+	}
+	g_clear_pointer (&bf->priv->watcher, decsync_watcher_free);
+
 	g_rw_lock_writer_lock (&(bf->priv->lock));
 
 	if (bf->priv->cursors) {
@@ -1117,6 +2204,12 @@ book_backend_decsync_finalize (GObject *object)
 	g_free (priv->locale);
 	g_free (priv->base_directory);
 	g_rw_lock_clear (&(priv->lock));
+	g_mutex_clear (&priv->refresh_lock);
+	g_mutex_clear (&priv->email_index_lock);
+	g_clear_pointer (&priv->email_index, g_hash_table_destroy);
+	g_clear_pointer (&priv->email_index_uids, g_hash_table_destroy);
+	g_mutex_clear (&priv->prefix_index_lock);
+	g_clear_pointer (&priv->prefix_index, prefix_index_free);
 
 	/* Chain up to parent's finalize() method. */
 	G_OBJECT_CLASS (e_book_backend_decsync_parent_class)->finalize (object);
@@ -1152,6 +2245,9 @@ book_backend_decsync_get_backend_property (EBookBackend *backend,
 
 		return g_string_free (fields, FALSE);
 
+	} else if (g_str_equal (prop_name, DECSYNC_BACKEND_PROPERTY_SKIPPED_ENTRIES)) {
+		return g_strdup_printf ("%d", g_atomic_int_get (&bf->priv->skipped_entries));
+
 	} else if (g_str_equal (prop_name, E_BOOK_BACKEND_PROPERTY_REVISION)) {
 		gchar *prop_value;
 
@@ -1214,21 +2310,31 @@ book_backend_decsync_create_contacts_sync_with_decsync (EBookBackendSync *backen
                                                      gboolean update_decsync)
 {
 	EBookBackendDecsync *bf = E_BOOK_BACKEND_DECSYNC (backend);
+	DecsyncBatch *batch = NULL;
+	PreparedContact *prepared;
 	gboolean success = FALSE;
+	guint length;
 
 	g_return_val_if_fail (out_contacts != NULL, FALSE);
 
 	*out_contacts = NULL;
 
+	length = g_strv_length ((gchar **) vcards);
+	prepared = prepared_contacts_new (bf, vcards, uids, length);
+
 	g_rw_lock_writer_lock (&(bf->priv->lock));
 	if (!e_book_sqlite_lock (bf->priv->sqlitedb,
 				 EBSQL_LOCK_WRITE,
 				 cancellable, error)) {
 		g_rw_lock_writer_unlock (&(bf->priv->lock));
+		prepared_contacts_free (bf, prepared, length, FALSE);
 		return FALSE;
 	}
 
-	success = do_create (bf, vcards, uids, out_contacts, cancellable, error, update_decsync);
+	if (update_decsync)
+		batch = decsync_batch_new ();
+
+	success = do_create (bf, prepared, length, out_contacts, cancellable, error, batch);
 
 	if (success) {
 		*out_contacts = g_slist_reverse (*out_contacts);
@@ -1263,8 +2369,22 @@ book_backend_decsync_create_contacts_sync_with_decsync (EBookBackendSync *backen
 		}
 	}
 
+	if (success) {
+		email_index_update (bf, *out_contacts, NULL);
+		prefix_index_update (bf, *out_contacts, NULL);
+	}
+
 	g_rw_lock_writer_unlock (&(bf->priv->lock));
 
+	prepared_contacts_free (bf, prepared, length, success);
+
+	/* Publish the new contacts once they are committed */
+	if (batch) {
+		if (success)
+			decsync_batch_flush (batch, bf->priv->decsync);
+		decsync_batch_free (batch);
+	}
+
 	return success;
 }
 
@@ -1294,29 +2414,30 @@ book_backend_decsync_modify_contacts_sync_with_decsync (EBookBackendSync *backen
 	GError           *local_error = NULL;
 	PhotoModifiedStatus status = STATUS_NORMAL;
 	GSList *old_contacts = NULL;
+	DecsyncBatch *batch = NULL;
+	PreparedContact *prepared;
 	guint ii, length;
-	const gchar *path[2];
-	JsonNode *key_node, *value_node;
-	gchar *key_string, *value_string;
 
 	length = g_strv_length ((gchar **) vcards);
+	prepared = prepared_contacts_new (bf, vcards, uids, length);
 
 	g_rw_lock_writer_lock (&(bf->priv->lock));
 
 	if (!e_book_sqlite_lock (bf->priv->sqlitedb, EBSQL_LOCK_WRITE, cancellable, error)) {
 		g_rw_lock_writer_unlock (&(bf->priv->lock));
+		prepared_contacts_free (bf, prepared, length, FALSE);
 		return FALSE;
 	}
 
+	if (update_decsync)
+		batch = decsync_batch_new ();
+
 	for (ii = 0; ii < length && status != STATUS_ERROR; ii++) {
 		gchar *id;
 		EContact *mod_contact, *old_contact = NULL;
 		const gchar *mod_contact_rev, *old_contact_rev;
 
-		if (uids != NULL && uids[ii] != NULL)
-			mod_contact = e_contact_new_from_vcard_with_uid (vcards[ii], uids[ii]);
-		else
-			mod_contact = e_contact_new_from_vcard (vcards[ii]);
+		mod_contact = g_object_ref (prepared[ii].contact);
 		id = e_contact_get (mod_contact, E_CONTACT_UID);
 
 		if (id == NULL) {
@@ -1330,20 +2451,8 @@ book_backend_decsync_modify_contacts_sync_with_decsync (EBookBackendSync *backen
 			break;
 		}
 
-		if (update_decsync) {
-			path[0] = "resources";
-			path[1] = id;
-			key_node = json_node_new (JSON_NODE_NULL);
-			key_string = json_to_string (key_node, FALSE);
-			value_node = json_node_new (JSON_NODE_VALUE);
-			json_node_set_string (value_node, vcards[ii]);
-			value_string = json_to_string (value_node, FALSE);
-			decsync_set_entry (bf->priv->decsync, path, 2, key_string, value_string);
-			json_node_free (key_node);
-			g_free (key_string);
-			json_node_free (value_node);
-			g_free (value_string);
-		}
+		if (batch)
+			decsync_batch_set_resource (batch, id, vcards[ii]);
 
 		if (!e_book_sqlite_get_contact (bf->priv->sqlitedb,
 						id, FALSE, &old_contact,
@@ -1381,7 +2490,7 @@ book_backend_decsync_modify_contacts_sync_with_decsync (EBookBackendSync *backen
 		}
 
 		/* Transform incomming photo blobs to uris before storing this to the DB */
-		status = maybe_transform_vcard_for_photo (bf, old_contact, mod_contact, &local_error);
+		status = transform_prepared_contact (bf, old_contact, &prepared[ii], &local_error);
 		if (status == STATUS_ERROR) {
 			g_warning (G_STRLOC ": Error transforming contact %s: %s", id, local_error->message);
 			g_propagate_error (error, local_error);
@@ -1488,10 +2597,22 @@ book_backend_decsync_modify_contacts_sync_with_decsync (EBookBackendSync *backen
 		for (link = *out_contacts; link; link = g_slist_next (link)) {
 			cursors_contact_added (bf, E_CONTACT (link->data));
 		}
+
+		email_index_update (bf, *out_contacts, NULL);
+		prefix_index_update (bf, *out_contacts, NULL);
 	}
 
 	g_rw_lock_writer_unlock (&(bf->priv->lock));
 
+	prepared_contacts_free (bf, prepared, length, status != STATUS_ERROR);
+
+	/* Publish the modifications once they are committed */
+	if (batch) {
+		if (status != STATUS_ERROR)
+			decsync_batch_flush (batch, bf->priv->decsync);
+		decsync_batch_free (batch);
+	}
+
 	g_slist_free_full (old_contacts, g_object_unref);
 	g_slist_free_full (ids, g_free);
 
@@ -1523,10 +2644,8 @@ book_backend_decsync_remove_contacts_sync_with_decsync (EBookBackendSync *backen
 	GError           *local_error = NULL;
 	const GSList     *l;
 	gboolean success = TRUE;
+	DecsyncBatch *batch = NULL;
 	guint ii, length;
-	const gchar *path[2];
-	JsonNode *key_node, *value_node;
-	gchar *key_string, *value_string;
 
 	g_return_val_if_fail (out_removed_uids != NULL, FALSE);
 
@@ -1541,22 +2660,14 @@ book_backend_decsync_remove_contacts_sync_with_decsync (EBookBackendSync *backen
 		return FALSE;
 	}
 
+	if (update_decsync)
+		batch = decsync_batch_new ();
+
 	for (ii = 0; ii < length && success; ii++) {
 		EContact *contact = NULL;
 
-		if (update_decsync) {
-			path[0] = "resources";
-			path[1] = uids[ii];
-			key_node = json_node_new (JSON_NODE_NULL);
-			key_string = json_to_string (key_node, FALSE);
-			value_node = json_node_new (JSON_NODE_NULL);
-			value_string = json_to_string (value_node, FALSE);
-			decsync_set_entry (bf->priv->decsync, path, 2, key_string, value_string);
-			json_node_free (key_node);
-			g_free (key_string);
-			json_node_free (value_node);
-			g_free (value_string);
-		}
+		if (batch)
+			decsync_batch_set_resource (batch, uids[ii], NULL);
 
 		/* First load the EContacts which need to be removed, we might delete some
 		 * photos from disk because of this...
@@ -1628,12 +2739,22 @@ book_backend_decsync_remove_contacts_sync_with_decsync (EBookBackendSync *backen
 		for (l = removed_contacts; l; l = l->next) {
 			cursors_contact_removed (bf, E_CONTACT (l->data));
 		}
+
+		email_index_update (bf, NULL, removed_ids);
+		prefix_index_update (bf, NULL, removed_ids);
 	}
 
 	*out_removed_uids = removed_ids;
 
 	g_rw_lock_writer_unlock (&(bf->priv->lock));
 
+	/* Publish the removals once they are committed */
+	if (batch) {
+		if (success)
+			decsync_batch_flush (batch, bf->priv->decsync);
+		decsync_batch_free (batch);
+	}
+
 	g_slist_free_full (removed_contacts, (GDestroyNotify) g_object_unref);
 
 	return success;
@@ -1692,9 +2813,9 @@ book_backend_decsync_get_contact_list_sync (EBookBackendSync *backend,
                                          GError **error)
 {
 	EBookBackendDecsync *bf = E_BOOK_BACKEND_DECSYNC (backend);
-	GSList *summary_list = NULL;
+	GSList *summary_list = NULL, *uids = NULL, *contacts = NULL;
 	GSList *link;
-	gboolean success = TRUE;
+	gboolean success = TRUE, indexed;
 	GError *local_error = NULL;
 
 	g_return_val_if_fail (out_contacts != NULL, FALSE);
@@ -1705,22 +2826,46 @@ book_backend_decsync_get_contact_list_sync (EBookBackendSync *backend,
 
 	g_rw_lock_reader_lock (&(bf->priv->lock));
 
+	indexed = prefix_index_search (bf, query, &uids);
+
 	success = e_book_sqlite_lock (
 		bf->priv->sqlitedb,
 		EBSQL_LOCK_READ,
 		cancellable, error);
 	if (!success) {
 		g_rw_lock_writer_unlock (&(bf->priv->lock));
+		g_slist_free_full (uids, g_free);
 		return FALSE;
 	}
 
-	success = e_book_sqlite_search (
-		bf->priv->sqlitedb,
-		query,
-		FALSE,
-		&summary_list,
-		cancellable,
-		&local_error);
+	if (indexed) {
+		/* Fetched by their uid, without evaluating the query */
+		for (link = uids; link && success; link = g_slist_next (link)) {
+			gchar *vcard = NULL;
+
+			success = e_book_sqlite_get_vcard (
+				bf->priv->sqlitedb, link->data, FALSE,
+				&vcard, &local_error);
+			if (!success)
+				break;
+
+			contacts = g_slist_prepend (contacts, e_contact_new_from_vcard_with_uid (vcard, link->data));
+			g_free (vcard);
+		}
+
+		if (!success)
+			g_slist_free_full (g_steal_pointer (&contacts), g_object_unref);
+
+		g_slist_free_full (uids, g_free);
+	} else {
+		success = e_book_sqlite_search (
+			bf->priv->sqlitedb,
+			query,
+			FALSE,
+			&summary_list,
+			cancellable,
+			&local_error);
+	}
 
 	e_book_sqlite_unlock (
 		bf->priv->sqlitedb,
@@ -1767,7 +2912,7 @@ book_backend_decsync_get_contact_list_sync (EBookBackendSync *backend,
 		e_book_sqlite_search_data_free (data);
 	}
 
-	*out_contacts = summary_list;
+	*out_contacts = g_slist_concat (contacts, summary_list);
 
 	return success;
 }
@@ -1791,6 +2936,11 @@ book_backend_decsync_get_contact_list_uids_sync (EBookBackendSync *backend,
 
 	g_rw_lock_reader_lock (&(bf->priv->lock));
 
+	if (prefix_index_search (bf, query, out_uids)) {
+		g_rw_lock_reader_unlock (&(bf->priv->lock));
+		return TRUE;
+	}
+
 	success = e_book_sqlite_lock (
 		bf->priv->sqlitedb,
 		EBSQL_LOCK_READ,
@@ -1845,18 +2995,27 @@ book_backend_decsync_get_contact_list_uids_sync (EBookBackendSync *backend,
 	return success;
 }
 
+typedef struct {
+	GHashTable *email_index;
+	gboolean found;
+} ContainsEmailData;
+
 static gboolean
 book_backend_decsync_gather_addresses_cb (gpointer ptr_name,
 				       gpointer ptr_email,
 				       gpointer user_data)
 {
-	GPtrArray *array = user_data;
-	const gchar *email = ptr_email;
+	ContainsEmailData *ced = user_data;
+	gchar *email;
 
-	if (email && *email)
-		g_ptr_array_add (array, e_book_query_field_test (E_CONTACT_EMAIL, E_BOOK_QUERY_IS, email));
+	email = email_index_normalize (ptr_email);
+	if (email) {
+		ced->found = g_hash_table_contains (ced->email_index, email);
+		g_free (email);
+	}
 
-	return TRUE;
+	/* Stop at the first known address */
+	return !ced->found;
 }
 
 static gboolean
@@ -1865,40 +3024,26 @@ book_backend_decsync_contains_email_sync (EBookBackendSync *backend,
 				       GCancellable *cancellable,
 				       GError **error)
 {
-	EBookQuery *book_query = NULL;
-	GPtrArray *array;
-	gchar *sexp = NULL;
-	gboolean success = FALSE;
+	EBookBackendDecsync *bf = E_BOOK_BACKEND_DECSYNC (backend);
+	ContainsEmailData ced = { NULL, FALSE };
 
 	g_return_val_if_fail (email_address != NULL, FALSE);
 
 	d (printf ("book_backend_decsync_contains_email_sync (%s)\n", email_address));
 
-	array = g_ptr_array_new_full (1, (GDestroyNotify) e_book_query_unref);
-
-	e_book_util_foreach_address (email_address, book_backend_decsync_gather_addresses_cb, array);
-
-	if (array->len > 0)
-		book_query = e_book_query_or (array->len, (EBookQuery **) array->pdata, FALSE);
-
-	if (book_query)
-		sexp = e_book_query_to_string (book_query);
-
-	if (sexp) {
-		GSList *uids = NULL;
-
-		success = book_backend_decsync_get_contact_list_uids_sync (backend, sexp,
-			&uids, cancellable, error);
-		success = success && uids != NULL;
+	/* Answered from the email index instead of searching the summary */
+	g_rw_lock_reader_lock (&(bf->priv->lock));
+	g_mutex_lock (&bf->priv->email_index_lock);
 
-		g_slist_free_full (uids, g_free);
+	if (email_index_ensure (bf, cancellable, error)) {
+		ced.email_index = bf->priv->email_index;
+		e_book_util_foreach_address (email_address, book_backend_decsync_gather_addresses_cb, &ced);
 	}
 
-	g_clear_pointer (&book_query, e_book_query_unref);
-	g_ptr_array_unref (array);
-	g_free (sexp);
+	g_mutex_unlock (&bf->priv->email_index_lock);
+	g_rw_lock_reader_unlock (&(bf->priv->lock));
 
-	return success;
+	return ced.found;
 }
 
 static void
@@ -2151,6 +3296,7 @@ book_backend_decsync_delete_cursor (EBookBackend *backend,
 
 typedef struct {
 	EBookBackend *backend;
+	GHashTable *resources; /* gchar *uid -> gchar *vcard, NULL when removed */
 } Extra;
 
 static void
@@ -2182,53 +3328,274 @@ updateName (Extra *extra, const gchar *name)
 static void
 updateContacts (const gchar *uid, const gchar *vcard, Extra *extra)
 {
-	EBookBackend *backend;
-	EBookBackendSync *backend_sync;
-	EBookBackendDecsync *bf;
-	gboolean success, exists;
-	const gchar *uids[2], *vcards[2];
-	GSList *out_contacts = NULL, *link;
+	/* Later entries for the same uid replace earlier ones */
+	g_hash_table_insert (extra->resources, g_strdup (uid), g_strdup (vcard));
+}
 
-	backend = E_BOOK_BACKEND (extra->backend);
-	backend_sync = E_BOOK_BACKEND_SYNC (backend);
-	bf = E_BOOK_BACKEND_DECSYNC (backend);
+static void
+removeContacts (const gchar *uid, Extra *extra)
+{
+	g_hash_table_insert (extra->resources, g_strdup (uid), NULL);
+}
 
-	g_rw_lock_reader_lock (&(bf->priv->lock));
-	success = e_book_sqlite_has_contact (bf->priv->sqlitedb, uid, &exists, NULL);
-	g_rw_lock_reader_unlock (&(bf->priv->lock));
-	if (!success) return;
-
-	uids[0] = uid;
-	uids[1] = '\0';
-	vcards[0] = vcard;
-	vcards[1] = '\0';
-	if (exists)
-		book_backend_decsync_modify_contacts_sync_with_decsync (backend_sync, vcards, uids, 0, &out_contacts, NULL, NULL, FALSE);
-	else
-		book_backend_decsync_create_contacts_sync_with_decsync (backend_sync, vcards, uids, 0, &out_contacts, NULL, NULL, FALSE);
-	for (link = out_contacts; link; link = g_slist_next (link)) {
-		e_book_backend_notify_update (backend, E_CONTACT (link->data));
+static void
+free_contacts_list (GSList *contacts)
+{
+	GSList *link;
+
+	for (link = contacts; link; link = g_slist_next (link)) {
+		if (link->data)
+			g_object_unref (link->data);
 	}
 
-	g_slist_free_full (out_contacts, g_object_unref);
+	g_slist_free (contacts);
 }
 
+/* Applies all the resources collected by updateContacts() and removeContacts()
+ * during one run of decsync_execute_all_new_entries(). Everything is stored in
+ * a single transaction with a single revision bump, after which the views are
+ * notified in one go.
+ *
+ * The digest of the vCard a contact was received with is kept in its extra
+ * data, so a later entry with the same vCard is skipped before parsing it.
+ * Storing the contact from anywhere else clears it.
+ *
+ * The vCards are parsed before the lock is taken, see prepare_contacts().
+ * Every uid is in the table once, with its last value, so the order of
+ * the entries of each uid is kept. */
 static void
-removeContacts (const gchar *uid, Extra *extra)
+book_backend_decsync_apply_resources (EBookBackendDecsync *bf,
+                                      GHashTable *resources)
 {
-	EBookBackend *backend;
-	EBookBackendSync *backend_sync;
-	const gchar *uids[2];
-	GSList *out_uids;
+	EBookBackend *backend = E_BOOK_BACKEND (bf);
+	GHashTableIter iter;
+	gpointer key, value;
+	GSList *contacts = NULL, *old_contacts = NULL, *digests = NULL;
+	GSList *removed_ids = NULL, *removed_contacts = NULL;
+	GSList *link, *old_link;
+	GError *local_error = NULL;
+	PreparedContact *prepared;
+	guint64 *prepared_digests;
+	gboolean success = TRUE;
+	guint skipped = 0, n_prepared = 0, ii;
 
-	backend = E_BOOK_BACKEND (extra->backend);
-	backend_sync = E_BOOK_BACKEND_SYNC (backend);
-	uids[0] = uid;
-	uids[1] = '\0';
-	book_backend_decsync_remove_contacts_sync_with_decsync (backend_sync, uids, 0, &out_uids, NULL, NULL, FALSE);
-	e_book_backend_notify_remove (backend, uid);
+	if (g_hash_table_size (resources) == 0)
+		return;
+
+	prepared = g_new0 (PreparedContact, g_hash_table_size (resources));
+	prepared_digests = g_new0 (guint64, g_hash_table_size (resources));
+
+	g_rw_lock_reader_lock (&(bf->priv->lock));
+
+	g_hash_table_iter_init (&iter, resources);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		const gchar *uid = key, *vcard = value;
+		guint64 digest = 0;
+
+		if (vcard != NULL) {
+			gchar *extra = NULL;
+			guint64 old_digest;
+
+			digest = decsync_digest_compute (vcard);
+
+			if (e_book_sqlite_get_contact_extra (bf->priv->sqlitedb, uid, &extra, NULL) &&
+			    decsync_digest_from_string (extra, &old_digest) &&
+			    old_digest == digest) {
+				g_free (extra);
+				skipped++;
+				continue;
+			}
+
+			g_free (extra);
+		}
+
+		prepared[n_prepared].uid = uid;
+		prepared[n_prepared].vcard = vcard;
+		prepared_digests[n_prepared] = digest;
+		n_prepared++;
+	}
+
+	g_rw_lock_reader_unlock (&(bf->priv->lock));
+
+	prepare_contacts (bf, prepared, n_prepared);
+
+	g_rw_lock_writer_lock (&(bf->priv->lock));
+
+	if (!e_book_sqlite_lock (bf->priv->sqlitedb,
+				 EBSQL_LOCK_WRITE,
+				 NULL, &local_error)) {
+		g_rw_lock_writer_unlock (&(bf->priv->lock));
+		g_warning ("Failed to lock database for DecSync entries: %s", local_error->message);
+		g_clear_error (&local_error);
+		prepared_contacts_free (bf, prepared, n_prepared, FALSE);
+		g_free (prepared_digests);
+		return;
+	}
+
+	for (ii = 0; ii < n_prepared; ii++) {
+		const gchar *uid = prepared[ii].uid, *vcard = prepared[ii].vcard;
+		const gchar *rev;
+		EContact *contact, *old_contact = NULL;
+
+		if (!e_book_sqlite_get_contact (bf->priv->sqlitedb,
+						uid, FALSE, &old_contact,
+						&local_error)) {
+			if (!g_error_matches (local_error,
+					      E_BOOK_SQLITE_ERROR,
+					      E_BOOK_SQLITE_ERROR_CONTACT_NOT_FOUND)) {
+				g_warning (G_STRLOC ": Failed to load contact %s: %s", uid, local_error->message);
+				g_clear_error (&local_error);
+				prepared_contact_discard_photos (bf, &prepared[ii]);
+				continue;
+			}
+			g_clear_error (&local_error);
+		}
+
+		if (vcard == NULL) {
+			if (old_contact) {
+				removed_ids = g_slist_prepend (removed_ids, g_strdup (uid));
+				removed_contacts = g_slist_prepend (removed_contacts, old_contact);
+			}
+			continue;
+		}
+
+		contact = g_object_ref (prepared[ii].contact);
+
+		if (old_contact) {
+			if (bf->priv->revision_guards) {
+				const gchar *old_rev;
+
+				rev = e_contact_get_const (contact, E_CONTACT_REV);
+				old_rev = e_contact_get_const (old_contact, E_CONTACT_REV);
+
+				if (!rev || !old_rev || strcmp (rev, old_rev) != 0) {
+					g_warning (G_STRLOC ": Tried to modify contact %s with out of sync revision", uid);
+					prepared_contact_discard_photos (bf, &prepared[ii]);
+					g_object_unref (contact);
+					g_object_unref (old_contact);
+					continue;
+				}
+			}
+
+			/* update the revision (modified time of contact) */
+			set_revision (bf, contact);
+		} else {
+			rev = e_contact_get_const (contact, E_CONTACT_REV);
+			if (!(rev && *rev))
+				set_revision (bf, contact);
+		}
+
+		/* Transform incomming photo blobs to uris before storing this to the DB */
+		if (transform_prepared_contact (bf, old_contact, &prepared[ii], &local_error) == STATUS_ERROR) {
+			g_warning (
+				G_STRLOC ": Error transforming contact %s: %s", uid,
+				local_error ? local_error->message : "Unknown error");
+			g_clear_error (&local_error);
+			prepared_contact_discard_photos (bf, &prepared[ii]);
+			g_object_unref (contact);
+			g_clear_object (&old_contact);
+			continue;
+		}
+
+		contacts = g_slist_prepend (contacts, contact);
+		old_contacts = g_slist_prepend (old_contacts, old_contact);
+		digests = g_slist_prepend (digests, decsync_digest_to_string (prepared_digests[ii]));
+	}
+
+	if (skipped > 0)
+		g_atomic_int_add (&bf->priv->skipped_entries, skipped);
+
+	if (contacts)
+		success = e_book_sqlite_add_contacts (
+			bf->priv->sqlitedb,
+			contacts, digests, TRUE,
+			NULL, &local_error);
+
+	if (success && removed_ids)
+		success = e_book_sqlite_remove_contacts (
+			bf->priv->sqlitedb,
+			removed_ids,
+			NULL, &local_error);
+
+	/* Bump the revision atomically in the same transaction */
+	if (success && (contacts || removed_ids))
+		success = e_book_backend_decsync_bump_revision (bf, &local_error);
+
+	/* Commit or rollback transaction */
+	if (success) {
+		success = e_book_sqlite_unlock (
+			bf->priv->sqlitedb,
+			EBSQL_UNLOCK_COMMIT,
+			&local_error);
+	} else {
+		GError *rollback_error = NULL;
+
+		if (!e_book_sqlite_unlock (bf->priv->sqlitedb, EBSQL_UNLOCK_ROLLBACK, &rollback_error)) {
+			g_warning (
+				"Failed to rollback transaction after failing to apply DecSync entries: %s",
+				rollback_error->message);
+			g_clear_error (&rollback_error);
+		}
+	}
+
+	if (success) {
+		/* Delete old photo file uris now that the changes are committed */
+		for (link = contacts, old_link = old_contacts;
+		     link && old_link;
+		     link = g_slist_next (link), old_link = g_slist_next (old_link)) {
+			if (old_link->data)
+				maybe_delete_unused_uris (bf, E_CONTACT (old_link->data), E_CONTACT (link->data));
+		}
+
+		for (link = removed_contacts; link; link = g_slist_next (link)) {
+			maybe_delete_unused_uris (bf, E_CONTACT (link->data), NULL);
+		}
+
+		/* Notify cursors of the changes */
+		for (link = old_contacts; link; link = g_slist_next (link)) {
+			if (link->data)
+				cursors_contact_removed (bf, E_CONTACT (link->data));
+		}
+
+		for (link = removed_contacts; link; link = g_slist_next (link)) {
+			cursors_contact_removed (bf, E_CONTACT (link->data));
+		}
+
+		for (link = contacts; link; link = g_slist_next (link)) {
+			cursors_contact_added (bf, E_CONTACT (link->data));
+		}
+
+		email_index_update (bf, contacts, removed_ids);
+		prefix_index_update (bf, contacts, removed_ids);
+	} else {
+		g_warning ("Failed to apply DecSync entries: %s",
+			local_error ? local_error->message : "Unknown error");
+		g_clear_error (&local_error);
+	}
 
-	g_slist_free_full (out_uids, g_free);
+	g_rw_lock_writer_unlock (&(bf->priv->lock));
+
+	/* Notify the views outside of the lock */
+	if (success) {
+		for (link = contacts; link; link = g_slist_next (link)) {
+			e_book_backend_notify_update (backend, E_CONTACT (link->data));
+		}
+
+		for (link = removed_ids; link; link = g_slist_next (link)) {
+			e_book_backend_notify_remove (backend, link->data);
+		}
+
+		e_book_backend_notify_complete (backend);
+	}
+
+	prepared_contacts_free (bf, prepared, n_prepared, success);
+	g_free (prepared_digests);
+
+	free_contacts_list (contacts);
+	free_contacts_list (old_contacts);
+	free_contacts_list (removed_contacts);
+	g_slist_free_full (removed_ids, g_free);
+	g_slist_free_full (digests, g_free);
 }
 
 static void
@@ -2236,57 +3603,51 @@ infoListener (const gchar **path, int len, const char *datetime, const char *key
 {
 	Extra *extra;
 	const gchar *info;
-	JsonNode *key_node, *value_node;
-	GError *error = NULL;
+	GString *key, *value;
+	DecsyncJsonType value_type;
 
 	extra = (Extra*)extra_void;
-	key_node = json_from_string (key_string, &error);
-	if (error != NULL) {
+	key = decsync_json_buffer (DECSYNC_JSON_BUFFER_KEY);
+	value = decsync_json_buffer (DECSYNC_JSON_BUFFER_VALUE);
+	if (decsync_json_decode (key_string, key) != DECSYNC_JSON_STRING) {
 		g_warning ("Invalid JSON for info key: %s", key_string);
-		g_error_free (error);
 		return;
 	}
-	value_node = json_from_string (value_string, &error);
-	if (error != NULL) {
+	value_type = decsync_json_decode (value_string, value);
+	if (value_type == DECSYNC_JSON_INVALID) {
 		g_warning ("Invalid JSON for info value: %s", value_string);
-		json_node_free (key_node);
-		g_error_free (error);
 		return;
 	}
-	info = json_node_get_string (key_node);
+	info = key->str;
 	if (g_strcmp0 (info, "deleted") == 0) {
-		if (json_node_get_boolean (value_node) == TRUE) {
+		if (value_type == DECSYNC_JSON_TRUE) {
 			deleteBook (extra);
 		}
 	} else if (g_strcmp0 (info, "name") == 0) {
-		updateName(extra, json_node_get_string (value_node));
+		updateName(extra, value_type == DECSYNC_JSON_STRING ? value->str : NULL);
 	} else {
 		g_warning ("Unknown info key: %s", info);
 	}
-	json_node_free (key_node);
-	json_node_free (value_node);
 }
 
 static void
 resourcesListener (const gchar **path, int len, const char *datetime, const char *key_string, const char *value_string, void *extra_void)
 {
 	Extra *extra;
-	const gchar *uid, *vcard;
-	JsonNode *key_node, *value_node;
-	GError *error = NULL;
+	const gchar *uid;
+	GString *key, *value;
+	DecsyncJsonType value_type;
 
 	extra = (Extra*)extra_void;
-	key_node = json_from_string (key_string, &error);
-	if (error != NULL) {
+	key = decsync_json_buffer (DECSYNC_JSON_BUFFER_KEY);
+	value = decsync_json_buffer (DECSYNC_JSON_BUFFER_VALUE);
+	if (decsync_json_decode (key_string, key) == DECSYNC_JSON_INVALID) {
 		g_warning ("Invalid JSON for resource key: %s", key_string);
-		g_error_free (error);
 		return;
 	}
-	value_node = json_from_string (value_string, &error);
-	if (error != NULL) {
+	value_type = decsync_json_decode (value_string, value);
+	if (value_type != DECSYNC_JSON_NULL && value_type != DECSYNC_JSON_STRING) {
 		g_warning ("Invalid JSON for resource value: %s", value_string);
-		json_node_free (key_node);
-		g_error_free (error);
 		return;
 	}
 	if (len != 1) {
@@ -2294,14 +3655,11 @@ resourcesListener (const gchar **path, int len, const char *datetime, const char
 		return;
 	}
 	uid = path[0];
-	if (json_node_is_null (value_node)) {
+	if (value_type == DECSYNC_JSON_NULL) {
 		removeContacts(uid, extra);
 	} else {
-		vcard = json_node_get_string (value_node);
-		updateContacts(uid, vcard, extra);
+		updateContacts(uid, value->str, extra);
 	}
-	json_node_free (key_node);
-	json_node_free (value_node);
 }
 
 static gboolean
@@ -2328,28 +3686,142 @@ getDecsyncFromSource (EBookBackendDecsyncPrivate *priv, ESource *source)
 	return TRUE;
 }
 
+/* Returns the fingerprint of the entries of the other apps, or NULL */
+static gchar *
+book_backend_decsync_compute_sync_state (EBookBackendDecsync *bf)
+{
+	ESource *source;
+	ESourceDecsync *decsync_extension;
+
+	source = e_backend_get_source (E_BACKEND (bf));
+	decsync_extension = e_source_get_extension (source, E_SOURCE_EXTENSION_DECSYNC_BACKEND);
+
+	return decsync_fingerprint_compute (
+		e_source_decsync_get_decsync_dir (decsync_extension),
+		"contacts",
+		e_source_decsync_get_collection (decsync_extension),
+		e_source_decsync_get_appid (decsync_extension));
+}
+
+/* Reads the new entries, unless @sync_state shows nothing changed since
+ * the last time. The fingerprint is taken before reading, so anything
+ * written meanwhile is read again the next time. */
+static void
+book_backend_decsync_read_new_entries (EBookBackendDecsync *bf,
+                                       const gchar *sync_state)
+{
+	Extra extra;
+	gchar *old_sync_state = NULL;
+	GError *local_error = NULL;
+
+	g_mutex_lock (&bf->priv->refresh_lock);
+
+	if (sync_state &&
+	    e_book_sqlite_get_key_value (bf->priv->sqlitedb, SQLITE_SYNC_STATE_KEY, &old_sync_state, NULL) &&
+	    g_strcmp0 (sync_state, old_sync_state) == 0) {
+		g_free (old_sync_state);
+		g_mutex_unlock (&bf->priv->refresh_lock);
+		return;
+	}
+	g_free (old_sync_state);
+
+	extra = (Extra) {E_BOOK_BACKEND (bf), g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free)};
+	decsync_execute_all_new_entries (bf->priv->decsync, &extra);
+	book_backend_decsync_apply_resources (bf, extra.resources);
+	g_hash_table_destroy (extra.resources);
+
+	if (sync_state &&
+	    !e_book_sqlite_set_key_value (bf->priv->sqlitedb, SQLITE_SYNC_STATE_KEY, sync_state, &local_error)) {
+		g_warning ("Failed to save DecSync sync state: %s", local_error->message);
+		g_clear_error (&local_error);
+	}
+
+	g_mutex_unlock (&bf->priv->refresh_lock);
+}
+
+static void
+book_backend_decsync_refresh_thread_cb (gpointer data,
+                                        gpointer user_data)
+{
+	EBookBackendDecsync *bf = data;
+	gchar *sync_state;
+
+	/* Changes from now on need another refresh */
+	g_atomic_int_set (&bf->priv->refresh_queued, FALSE);
+
+	sync_state = book_backend_decsync_compute_sync_state (bf);
+	book_backend_decsync_read_new_entries (bf, sync_state);
+	g_free (sync_state);
+
+	g_object_unref (bf);
+}
+
+/* The pool is shared by all the address books of the process */
+static GThreadPool *
+refresh_pool_get (void)
+{
+	static GThreadPool *pool = NULL;
+
+	if (g_once_init_enter (&pool)) {
+		GThreadPool *new_pool;
+
+		new_pool = g_thread_pool_new (book_backend_decsync_refresh_thread_cb, NULL, g_get_num_processors (), FALSE, NULL);
+		g_once_init_leave (&pool, new_pool);
+	}
+
+	return pool;
+}
+
+/* Called from the main loop by the watcher and on refresh requests.
+ * Taking the fingerprint walks the collection directory, so the refresh
+ * is done in the refresh pool, like the scheduler does; a refresh which
+ * is still waiting there covers the changes of this call as well. */
 static gboolean
 book_backend_decsync_refresh_cb (gpointer backend)
 {
 	EBookBackendDecsync *bf;
-	Extra extra;
 
 	bf = E_BOOK_BACKEND_DECSYNC (backend);
-	extra = (Extra) {backend};
-	decsync_execute_all_new_entries (bf->priv->decsync, &extra);
+
+	if (g_atomic_int_compare_and_exchange (&bf->priv->refresh_queued, FALSE, TRUE))
+		g_thread_pool_push (refresh_pool_get (), g_object_ref (bf), NULL);
+
 	return TRUE;
 }
 
+/* Called by the scheduler, which already took the fingerprint */
+static void
+book_backend_decsync_scheduled_refresh_cb (const gchar *sync_state,
+                                           gpointer backend)
+{
+	book_backend_decsync_read_new_entries (E_BOOK_BACKEND_DECSYNC (backend), sync_state);
+}
+
 static gboolean
 book_backend_decsync_refresh_start (EBookBackendDecsync *bf)
 {
 	ESource *source;
 	ESourceRefresh *extension;
+	ESourceDecsync *decsync_extension;
 	const gchar *extension_name;
 	guint interval_in_minutes = 0;
 
 	source = e_backend_get_source (E_BACKEND (bf));
 
+	/* Changes made by other apps are picked up as soon as they land in the
+	 * DecSync directory; the periodic refresh below stays as a fallback for
+	 * file systems without change notification. */
+	extension_name = E_SOURCE_EXTENSION_DECSYNC_BACKEND;
+	decsync_extension = e_source_get_extension (source, extension_name);
+	if (e_source_decsync_get_watch_changes (decsync_extension) && !bf->priv->watcher) {
+		bf->priv->watcher = decsync_watcher_new (
+			e_source_decsync_get_decsync_dir (decsync_extension),
+			"contacts",
+			e_source_decsync_get_collection (decsync_extension),
+			e_source_decsync_get_appid (decsync_extension),
+			book_backend_decsync_refresh_cb, bf);
+	}
+
 	extension_name = E_SOURCE_EXTENSION_REFRESH;
 	extension = e_source_get_extension (source, extension_name);
 
@@ -2359,8 +3831,16 @@ book_backend_decsync_refresh_start (EBookBackendDecsync *bf)
 			interval_in_minutes = 30;
 	}
 
-	if (interval_in_minutes > 0) {
-		e_named_timeout_add_seconds (interval_in_minutes * 60, book_backend_decsync_refresh_cb, bf);
+	/* Shared with the other collections of the DecSync directory, so it
+	 * is scanned once per tick for all of them */
+	if (interval_in_minutes > 0 && !bf->priv->scheduler_id) {
+		bf->priv->scheduler_id = decsync_scheduler_add (
+			e_source_decsync_get_decsync_dir (decsync_extension),
+			"contacts",
+			e_source_decsync_get_collection (decsync_extension),
+			e_source_decsync_get_appid (decsync_extension),
+			interval_in_minutes * 60,
+			book_backend_decsync_scheduled_refresh_cb, bf);
 	}
 	return FALSE;
 }
@@ -2523,5 +4003,8 @@ e_book_backend_decsync_init (EBookBackendDecsync *backend)
 	backend->priv = e_book_backend_decsync_get_instance_private (backend);
 
 	g_rw_lock_init (&(backend->priv->lock));
+	g_mutex_init (&backend->priv->refresh_lock);
+	g_mutex_init (&backend->priv->email_index_lock);
+	g_mutex_init (&backend->priv->prefix_index_lock);
 }
 
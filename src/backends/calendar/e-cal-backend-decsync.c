@@ -24,6 +24,7 @@
 
 #include "evolution-decsync-config.h"
 
+#include <errno.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -34,7 +35,12 @@
 
 #include <libedataserver/libedataserver.h>
 #include <e-source/e-source-decsync.h>
-#include <json-glib/json-glib.h>
+#include <backends/utils/decsync-batch.h>
+#include <backends/utils/decsync-digest.h>
+#include <backends/utils/decsync-fingerprint.h>
+#include <backends/utils/decsync-json.h>
+#include <backends/utils/decsync-scheduler.h>
+#include <backends/utils/decsync-watcher.h>
 #include <libdecsync.h>
 
 #include "e-cal-backend-decsync-events.h"
@@ -50,11 +56,91 @@
 
 #define ECAL_REVISION_X_PROP  "X-EVOLUTION-DATA-REVISION"
 
+/* Changes since the last full save of the calendar file are appended to
+ * a journal next to it. The generation stored in the calendar file must
+ * match the one in the journal header, otherwise the journal is stale. */
+#define JOURNAL_X_PROP  "X-EVOLUTION-DECSYNC-JOURNAL"
+#define JOURNAL_SUFFIX  ".journal"
+
+/* Digests of the last DecSync value of each resource, see publish_resource();
+ * the file is written with the calendar file, the journal holds the later
+ * changes */
+#define DIGESTS_SUFFIX  ".digests"
+
+/* Fingerprint of the collection when it was last read, in the cache dir */
+#define SYNC_STATE_FILE_NAME "decsync-sync-state"
+#define JOURNAL_HEADER  "DECSYNC-JOURNAL"
+#define JOURNAL_COMPACT_MIN_SIZE (256 * 1024)
+
+/* Changes are saved by a thread once SAVE_DELAY_MS passed since the last
+ * one, but at most SAVE_MAX_DELAY_MS after the first unsaved one. Both
+ * can be overridden by environment variables of the same name with a
+ * DECSYNC_ prefix. */
+#define SAVE_DELAY_MS      2000
+#define SAVE_MAX_DELAY_MS  10000
+
+/* Number of mutexes the components are spread over, see comp_lock_for() */
+#define COMP_LOCK_STRIPES 32
+
+/* Below this many incoming resources they are parsed in the calling
+ * thread, see parse_resources() */
+#define PARALLEL_PARSE_MIN_RESOURCES 8
+
+/* A view is populated with the matches of at most this many uids at a
+ * time, holding the lock for at most this long, see start_view_cb() */
+#define VIEW_BATCH_SIZE  100
+#define VIEW_SLICE_USECS (20 * 1000)
+
+/* Number of free/busy windows whose busy periods are kept */
+#define FREE_BUSY_CACHE_SIZE 8
+
+/* Total size of the object list results kept, see query_cache_lookup();
+ * a single result larger than a quarter of it is not kept */
+#define QUERY_CACHE_MAX_BYTES (4 * 1024 * 1024)
+
+/* A kept result is computed again after this long, so that anything
+ * the result depends on besides the data is picked up eventually */
+#define QUERY_CACHE_MAX_AGE_USECS (5 * 60 * G_USEC_PER_SEC)
+
+/* Occurrences of recurring events are generated once for this many days
+ * around the current time, up to OCCURRENCES_MAX of them, see
+ * object_occurrences_get() */
+#define OCCURRENCES_HORIZON_DAYS 730
+#define OCCURRENCES_MAX          4096
+
+/* A list of distinct components which keeps the insertion order, with
+ * constant time insertion and removal */
+typedef struct {
+	GQueue queue;
+	GHashTable *links; /* ECalComponent * -> GList * in the queue, created on demand */
+} CompList;
+
+/* One occurrence of a recurring component, in UTC unless a date */
+typedef struct {
+	time_t start;
+	time_t end;
+	ICalTime *istart;
+	ICalTime *iend;
+} ObjectOccurrence;
+
 /* Placeholder for each component and its recurrences */
 typedef struct {
 	ECalComponent *full_object;
 	GHashTable *recurrences;
-	GList *recurrences_list;
+	CompList recurrences_list;
+
+	/* Occurrences of full_object between occurrences_start and
+	 * occurrences_end, generated on demand; cleared by the writers
+	 * whenever the object or one of its recurrences changes */
+	GArray *occurrences; /* ObjectOccurrence, sorted by start */
+	time_t occurrences_start;
+	time_t occurrences_end;
+	gboolean occurrences_truncated;
+
+	/* Serializations made on demand, cleared together with the
+	 * occurrences; protected by strings_lock */
+	GHashTable *comp_strings; /* ECalComponent * -> gchar * */
+	gchar *ical_string; /* the VCALENDAR with all of the components */
 } ECalBackendDecsyncObject;
 
 /* Private part of the ECalBackendDecsync structure */
@@ -65,15 +151,37 @@ struct _ECalBackendDecsyncPrivate {
 	/* Filename in the dir */
 	gchar *file_name;
 	gboolean is_dirty;
-	guint dirty_idle_id;
 
-	/* locked in high-level functions to ensure data is consistent
-	 * in idle and CORBA thread(s?); because high-level functions
-	 * may call other high-level functions the mutex must allow
-	 * recursive locking
+	/* Saves are done by save_thread, see save_request() */
+	GThread *save_thread;
+	GMutex save_lock;
+	GCond save_cond;
+	gboolean save_requested;
+	gboolean save_quit;
+	gint64 save_first_change;
+	gint64 save_last_change;
+	gint64 save_delay;
+	gint64 save_max_delay;
+
+	/* locked in high-level functions which change the data, and while
+	 * it is saved; because high-level functions may call other
+	 * high-level functions the mutex must allow recursive locking.
+	 * Readers do not take it, see data_write_lock()
 	 */
 	GRecMutex idle_save_rmutex;
 
+	/* held for writing by the writers, besides idle_save_rmutex, and
+	 * for reading by the readers, which can so run in parallel */
+	GRWLock data_lock;
+	guint data_write_depth;
+	GThread *data_writer;
+
+	/* libical keeps the state of an iteration in the component itself,
+	 * thus readers sharing data_lock still have to take the lock of the
+	 * component they look at, or vcalendar_lock for the toplevel one */
+	GMutex comp_locks[COMP_LOCK_STRIPES];
+	GMutex vcalendar_lock;
+
 	/* Toplevel VCALENDAR component */
 	ICalComponent *vcalendar;
 
@@ -86,7 +194,7 @@ struct _ECalBackendDecsyncPrivate {
 
 	EIntervalTree *interval_tree;
 
-	GList *comp;
+	CompList comp;
 
 	/* increased when backend saves the file */
 	guint refresh_skip;
@@ -94,15 +202,87 @@ struct _ECalBackendDecsyncPrivate {
 	/* Just an incremental number to ensure uniqueness across revisions */
 	guint revision_counter;
 
+	/* Increased whenever the data lock is released after writing, so it
+	 * changes with every change of the data, even one which does not bump
+	 * the revision; read with the data lock held */
+	guint data_generation;
+
+	/* Busy periods of the last free/busy windows, see free_busy_cache_apply() */
+	GMutex free_busy_lock;
+	GQueue free_busy_cache; /* FreeBusyCacheEntry *, most recent first */
+
+	/* Guards the serializations kept in the objects, see
+	 * object_data_dup_comp_string() */
+	GMutex strings_lock;
+
+	/* Results of the last object list queries, see query_cache_lookup() */
+	GMutex query_cache_lock;
+	GQueue query_cache; /* QueryCacheEntry *, most recently used first */
+	GHashTable *query_cache_index; /* gchar *sexp -> GList * in query_cache */
+	guint query_cache_generation;
+	gsize query_cache_bytes;
+	guint query_cache_hits;
+	guint query_cache_misses;
+
 	Decsync decsync;
+	DecsyncWatcher *watcher;
+
+	/* Set while a batch of incoming DecSync entries is applied; save()
+	 * and the component notifications are deferred until its end */
+	gboolean in_batch;
+	gboolean batch_dirty;
+	gboolean batch_bump_revision;
+	GSList *batch_notifications; /* BatchNotification * */
+
+	/* UIDs changed since the last save, written to the journal by the
+	 * next save unless the whole calendar file has to be rewritten */
+	GHashTable *journal_uids; /* gchar *uid */
+	gboolean journal_needs_snapshot;
+	guint journal_generation;
+	goffset journal_size;
+	goffset snapshot_size;
+
+	/* Set while the calendar file is read in a worker thread, see
+	 * open_cal_streaming(); anything but views and the revision waits
+	 * for it to finish */
+	GMutex load_lock;
+	GCond load_cond;
+	gboolean loading;
+	gboolean load_failed;
+	gboolean refresh_pending;
+	GSList *loading_views; /* EDataCalView * */
+	GHashTable *populating_views; /* EDataCalView *, see start_view_cb() */
 
 	/* Only for ETimezoneCache::get_timezone() call */
 	GHashTable *cached_timezones; /* gchar *tzid -> ICalTimezone * */
+
+	/* The digest of the DecSync value each resource was last set to,
+	 * to skip incoming entries which do not change it; protected by
+	 * idle_save_rmutex. They are saved along with the objects, see
+	 * journal_read(), so no digest outlives a change which got lost. */
+	DecsyncDigests *digests;
+	gint skipped_entries; /* atomic */
+
+	/* Fingerprint of the collection when its new entries were last
+	 * executed, see decsync_fingerprint_compute(); protected by
+	 * idle_save_rmutex and read from the cache dir on first use */
+	gchar *sync_state;
+	gboolean sync_state_loaded;
+
+	/* Serializes reading the new entries, which happens both from the
+	 * refresh pool and from the scheduler's workers */
+	GMutex refresh_lock;
+	guint scheduler_id;
+
+	/* Set while a refresh waits in the pool, see
+	 * ecal_backend_decsync_refresh_cb() */
+	volatile gint refresh_queued;
 };
 
 #define d(x)
 
 static void bump_revision (ECalBackendDecsync *cbfile);
+static ICalProperty *get_revision_property (ECalBackendDecsync *cbfile);
 
 static void	e_cal_backend_decsync_timezone_cache_init
 					(ETimezoneCacheInterface *iface);
@@ -110,6 +290,7 @@ static void	e_cal_backend_decsync_timezone_cache_init
 static ETimezoneCacheInterface *parent_timezone_cache_interface;
 
 static gboolean	ecal_backend_decsync_refresh_start (ECalBackendDecsync *cbfile);
+static gboolean	ecal_backend_decsync_refresh_cb (gpointer backend);
 static void	e_cal_backend_decsync_initable_init
 						(GInitableIface *iface);
 
@@ -125,23 +306,877 @@ G_DEFINE_TYPE_WITH_CODE (
 		G_TYPE_INITABLE,
 		e_cal_backend_decsync_initable_init))
 
-/* g_hash_table_foreach() callback to destroy a ECalBackendDecsyncObject */
+/* Takes the data for writing. Nests, and excludes the readers only at
+ * the outermost level */
+static void
+data_write_lock (ECalBackendDecsync *cbfile)
+{
+	ECalBackendDecsyncPrivate *priv;
+
+	priv = cbfile->priv;
+
+	g_rec_mutex_lock (&priv->idle_save_rmutex);
+
+	if (!priv->data_write_depth++) {
+		g_rw_lock_writer_lock (&priv->data_lock);
+		g_atomic_pointer_set (&priv->data_writer, g_thread_self ());
+	}
+}
+
+static void
+data_write_unlock (ECalBackendDecsync *cbfile)
+{
+	ECalBackendDecsyncPrivate *priv;
+
+	priv = cbfile->priv;
+
+	g_return_if_fail (priv->data_write_depth > 0);
+
+	if (!--priv->data_write_depth) {
+		priv->data_generation++;
+		g_atomic_pointer_set (&priv->data_writer, NULL);
+		g_rw_lock_writer_unlock (&priv->data_lock);
+	}
+
+	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+}
+
+/* How deep each calendar is locked for reading by the current thread,
+ * ECalBackendDecsync * -> depth */
+static GPrivate data_readers = G_PRIVATE_INIT ((GDestroyNotify) g_hash_table_destroy);
+
+static GHashTable *
+data_readers_get (void)
+{
+	GHashTable *readers;
+
+	readers = g_private_get (&data_readers);
+	if (!readers) {
+		readers = g_hash_table_new (g_direct_hash, g_direct_equal);
+		g_private_set (&data_readers, readers);
+	}
+
+	return readers;
+}
+
+/* Takes the data for reading, unless the calling thread is the writer
+ * already. Nests, and takes the lock only at the outermost level, since
+ * a GRWLock taken for reading twice deadlocks when a writer waits in
+ * between. Returns whether data_read_unlock() has anything to release. */
+static gboolean
+data_read_lock (ECalBackendDecsync *cbfile)
+{
+	ECalBackendDecsyncPrivate *priv;
+	GHashTable *readers;
+	guint depth;
+
+	priv = cbfile->priv;
+
+	if (g_atomic_pointer_get (&priv->data_writer) == (gpointer) g_thread_self ())
+		return FALSE;
+
+	readers = data_readers_get ();
+	depth = GPOINTER_TO_UINT (g_hash_table_lookup (readers, cbfile));
+
+	if (!depth)
+		g_rw_lock_reader_lock (&priv->data_lock);
+
+	g_hash_table_insert (readers, cbfile, GUINT_TO_POINTER (depth + 1));
+
+	return TRUE;
+}
+
+static void
+data_read_unlock (ECalBackendDecsync *cbfile,
+                  gboolean locked)
+{
+	GHashTable *readers;
+	guint depth;
+
+	if (!locked)
+		return;
+
+	readers = data_readers_get ();
+	depth = GPOINTER_TO_UINT (g_hash_table_lookup (readers, cbfile));
+
+	g_return_if_fail (depth > 0);
+
+	if (depth > 1) {
+		g_hash_table_insert (readers, cbfile, GUINT_TO_POINTER (depth - 1));
+	} else {
+		g_hash_table_remove (readers, cbfile);
+		g_rw_lock_reader_unlock (&cbfile->priv->data_lock);
+	}
+}
+
+static GMutex *
+comp_lock_for (ECalBackendDecsync *cbfile,
+               gconstpointer comp)
+{
+	return &cbfile->priv->comp_locks[(GPOINTER_TO_SIZE (comp) >> 4) % COMP_LOCK_STRIPES];
+}
+
+static void
+comp_list_insert (CompList *list,
+                  ECalComponent *comp,
+                  gboolean at_end)
+{
+	if (!list->links)
+		list->links = g_hash_table_new (g_direct_hash, g_direct_equal);
+	else if (g_hash_table_contains (list->links, comp))
+		return;
+
+	if (at_end)
+		g_queue_push_tail (&list->queue, comp);
+	else
+		g_queue_push_head (&list->queue, comp);
+
+	g_hash_table_insert (list->links, comp, at_end ? list->queue.tail : list->queue.head);
+}
+
+static void
+comp_list_prepend (CompList *list,
+                   ECalComponent *comp)
+{
+	comp_list_insert (list, comp, FALSE);
+}
+
+static void
+comp_list_append (CompList *list,
+                  ECalComponent *comp)
+{
+	comp_list_insert (list, comp, TRUE);
+}
+
+static gboolean
+comp_list_remove (CompList *list,
+                  ECalComponent *comp)
+{
+	GList *link;
+
+	link = list->links ? g_hash_table_lookup (list->links, comp) : NULL;
+	if (!link)
+		return FALSE;
+
+	g_hash_table_remove (list->links, comp);
+	g_queue_delete_link (&list->queue, link);
+
+	return TRUE;
+}
+
+static gboolean
+comp_list_is_empty (CompList *list)
+{
+	return g_queue_is_empty (&list->queue);
+}
+
+static void
+comp_list_clear (CompList *list)
+{
+	g_queue_clear (&list->queue);
+	g_clear_pointer (&list->links, g_hash_table_destroy);
+}
+
+/* g_hash_table_foreach() callback to destroy a ECalBackendDecsyncObject */
+static void
+free_object_data (gpointer data)
+{
+	ECalBackendDecsyncObject *obj_data = data;
+
+	if (obj_data->full_object)
+		g_object_unref (obj_data->full_object);
+	g_hash_table_destroy (obj_data->recurrences);
+	comp_list_clear (&obj_data->recurrences_list);
+	g_clear_pointer (&obj_data->occurrences, g_array_unref);
+	g_clear_pointer (&obj_data->comp_strings, g_hash_table_destroy);
+	g_free (obj_data->ical_string);
+
+	g_free (obj_data);
+}
+
+typedef struct {
+	time_t start;
+	time_t end;
+	guint data_generation;
+	GPtrArray *periods; /* ICalProperty *, the FREEBUSY properties */
+} FreeBusyCacheEntry;
+
+static void
+free_busy_cache_entry_free (gpointer data)
+{
+	FreeBusyCacheEntry *entry = data;
+
+	g_ptr_array_unref (entry->periods);
+	g_free (entry);
+}
+
+typedef struct {
+	gchar *sexp;
+	GSList *objects; /* gchar *, the serialized components */
+	gsize bytes;
+	gint64 expires; /* monotonic time */
+} QueryCacheEntry;
+
+static void
+query_cache_entry_free (gpointer data)
+{
+	QueryCacheEntry *entry = data;
+
+	g_free (entry->sexp);
+	g_slist_free_full (entry->objects, g_free);
+	g_free (entry);
+}
+
+/* Drops what was derived from the components of the object, before
+ * any of them changes. Called with the data lock held for writing. */
+static void
+object_data_invalidate (ECalBackendDecsyncObject *obj_data)
+{
+	g_clear_pointer (&obj_data->occurrences, g_array_unref);
+	g_clear_pointer (&obj_data->comp_strings, g_hash_table_destroy);
+	g_clear_pointer (&obj_data->ical_string, g_free);
+}
+
+static void
+journal_mark_uid (ECalBackendDecsync *cbfile,
+                  const gchar *uid)
+{
+	ECalBackendDecsyncPrivate *priv;
+
+	if (!uid || !*uid)
+		return;
+
+	priv = cbfile->priv;
+
+	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	g_hash_table_add (priv->journal_uids, g_strdup (uid));
+	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+}
+
+/* For changes which are not tied to a single object */
+static void
+journal_invalidate (ECalBackendDecsync *cbfile)
+{
+	ECalBackendDecsyncPrivate *priv;
+
+	priv = cbfile->priv;
+
+	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	priv->journal_needs_snapshot = TRUE;
+	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+}
+
+/* Reads the digests saved with the calendar file @filename, which are
+ * dropped when the file was written again since; the journal read next
+ * holds the later ones. Called with idle_save_rmutex locked. */
+static void
+digests_load (ECalBackendDecsync *cbfile,
+              const gchar *filename)
+{
+	ECalBackendDecsyncPrivate *priv;
+	GError *local_error = NULL;
+	gchar *digests_path, *tag;
+
+	priv = cbfile->priv;
+
+	digests_path = g_strconcat (filename, DIGESTS_SUFFIX, NULL);
+	tag = g_strdup_printf ("%u", priv->journal_generation);
+	if (!decsync_digests_load (priv->digests, digests_path, tag, &local_error)) {
+		g_warning ("Cannot read DecSync digests: %s", local_error->message);
+		g_clear_error (&local_error);
+	}
+	g_free (digests_path);
+	g_free (tag);
+}
+
+/* Called with idle_save_rmutex locked, after the calendar file was
+ * written; a failure only makes the next load apply some values again */
+static void
+digests_save (ECalBackendDecsync *cbfile)
+{
+	ECalBackendDecsyncPrivate *priv;
+	GError *local_error = NULL;
+	gchar *digests_path, *tag;
+
+	priv = cbfile->priv;
+
+	digests_path = g_strconcat (priv->path, DIGESTS_SUFFIX, NULL);
+	tag = g_strdup_printf ("%u", priv->journal_generation);
+	if (!decsync_digests_save (priv->digests, digests_path, tag, &local_error)) {
+		g_warning ("Cannot save DecSync digests: %s", local_error->message);
+		g_clear_error (&local_error);
+	}
+	g_free (digests_path);
+	g_free (tag);
+}
+
+static void
+journal_collect_tzid_cb (ICalParameter *param,
+                         gpointer user_data)
+{
+	GHashTable *tzids = user_data;
+	const gchar *tzid;
+
+	tzid = i_cal_parameter_get_tzid (param);
+	if (tzid && *tzid)
+		g_hash_table_add (tzids, g_strdup (tzid));
+}
+
+static void
+journal_append_component (ECalBackendDecsync *cbfile,
+                          GString *payload,
+                          GHashTable *tzids,
+                          ECalComponent *comp)
+{
+	ICalComponent *icomp;
+	GMutex *comp_lock;
+	gchar *str;
+
+	comp_lock = comp_lock_for (cbfile, comp);
+	icomp = e_cal_component_get_icalcomponent (comp);
+
+	g_mutex_lock (comp_lock);
+	i_cal_component_foreach_tzid (icomp, journal_collect_tzid_cb, tzids);
+	str = i_cal_component_as_ical_string (icomp);
+	g_mutex_unlock (comp_lock);
+
+	g_string_append (payload, str);
+	g_free (str);
+}
+
+/* Appends the digest of the DecSync value of @uid, if known. It follows
+ * the record of the object, so it is written only along with it. */
+static void
+journal_append_digest (ECalBackendDecsync *cbfile,
+                       GString *records,
+                       const gchar *uid)
+{
+	guint64 digest;
+
+	if (!decsync_digests_lookup (cbfile->priv->digests, uid, &digest))
+		return;
+
+	g_string_append_printf (records, "H %" G_GSIZE_FORMAT "\n%016" G_GINT64_MODIFIER "x %s\n",
+		strlen (uid) + 17, digest, uid);
+}
+
+/* Appends a record with the current state of the object @uid: either all
+ * its components with the timezones they use, or its removal */
+static void
+journal_append_object (ECalBackendDecsync *cbfile,
+                       GString *records,
+                       const gchar *uid)
+{
+	ECalBackendDecsyncPrivate *priv;
+	ECalBackendDecsyncObject *obj_data;
+	GString *payload;
+	GHashTable *tzids;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	priv = cbfile->priv;
+
+	obj_data = g_hash_table_lookup (priv->comp_uid_hash, uid);
+	if (!obj_data || (!obj_data->full_object && !g_hash_table_size (obj_data->recurrences))) {
+		g_string_append_printf (records, "D %" G_GSIZE_FORMAT "\n%s\n", strlen (uid), uid);
+		journal_append_digest (cbfile, records, uid);
+		return;
+	}
+
+	payload = g_string_new (NULL);
+	tzids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	if (obj_data->full_object)
+		journal_append_component (cbfile, payload, tzids, obj_data->full_object);
+
+	g_hash_table_iter_init (&iter, obj_data->recurrences);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		journal_append_component (cbfile, payload, tzids, value);
+
+	g_string_prepend (payload, "BEGIN:VCALENDAR\r\n");
+
+	g_mutex_lock (&priv->vcalendar_lock);
+
+	g_hash_table_iter_init (&iter, tzids);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		ICalTimezone *zone;
+		ICalComponent *tz_comp;
+		gchar *str;
+
+		zone = i_cal_component_get_timezone (priv->vcalendar, key);
+		if (!zone)
+			continue;
+
+		tz_comp = i_cal_timezone_get_component (zone);
+		if (tz_comp) {
+			str = i_cal_component_as_ical_string (tz_comp);
+			g_string_insert (payload, strlen ("BEGIN:VCALENDAR\r\n"), str);
+			g_free (str);
+			g_object_unref (tz_comp);
+		}
+
+		g_object_unref (zone);
+	}
+
+	g_mutex_unlock (&priv->vcalendar_lock);
+
+	g_string_append (payload, "END:VCALENDAR\r\n");
+
+	g_string_append_printf (records, "U %" G_GSIZE_FORMAT "\n", payload->len);
+	g_string_append_len (records, payload->str, payload->len);
+	g_string_append_c (records, '\n');
+
+	journal_append_digest (cbfile, records, uid);
+
+	g_hash_table_destroy (tzids);
+	g_string_free (payload, TRUE);
+}
+
+/* Appends the objects changed since the last save to the journal, setting
+ * @written to the number of bytes appended. Returns FALSE when the whole
+ * calendar file has to be written instead, with @error set when the
+ * journal could not be written. */
+static gboolean
+journal_append (ECalBackendDecsync *cbfile,
+                gsize *written,
+                GError **error)
+{
+	ECalBackendDecsyncPrivate *priv;
+	ICalProperty *prop;
+	GFile *file;
+	GFileOutputStream *stream;
+	GString *records;
+	GHashTableIter iter;
+	gpointer key;
+	gchar *journal_path;
+	gboolean succeeded;
+
+	priv = cbfile->priv;
+
+	if (priv->journal_needs_snapshot || !g_hash_table_size (priv->journal_uids))
+		return FALSE;
+
+	records = g_string_new (NULL);
+	if (priv->journal_size == 0)
+		g_string_append_printf (records, "%s %u\n", JOURNAL_HEADER, priv->journal_generation);
+
+	g_hash_table_iter_init (&iter, priv->journal_uids);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		journal_append_object (cbfile, records, key);
+
+	g_mutex_lock (&priv->vcalendar_lock);
+	prop = get_revision_property (cbfile);
+	if (prop) {
+		const gchar *revision = i_cal_property_get_x (prop);
+
+		if (revision)
+			g_string_append_printf (records, "R %" G_GSIZE_FORMAT "\n%s\n", strlen (revision), revision);
+		g_object_unref (prop);
+	}
+	g_mutex_unlock (&priv->vcalendar_lock);
+
+	journal_path = g_strconcat (priv->path, JOURNAL_SUFFIX, NULL);
+	file = g_file_new_for_path (journal_path);
+	g_free (journal_path);
+
+	/* Start over when the journal is new, so nothing left over from a
+	 * failed removal can precede the header */
+	if (priv->journal_size == 0)
+		stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+	else
+		stream = g_file_append_to (file, G_FILE_CREATE_NONE, NULL, error);
+
+	succeeded = stream != NULL;
+	if (succeeded)
+		succeeded = g_output_stream_write_all (G_OUTPUT_STREAM (stream), records->str, records->len, NULL, NULL, error);
+	if (succeeded)
+		succeeded = g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, error);
+
+	if (succeeded) {
+		priv->journal_size += records->len;
+		*written = records->len;
+		g_hash_table_remove_all (priv->journal_uids);
+	} else {
+		/* The journal may end with a partial record now */
+		priv->journal_needs_snapshot = TRUE;
+	}
+
+	g_clear_object (&stream);
+	g_object_unref (file);
+	g_string_free (records, TRUE);
+
+	return succeeded;
+}
+
+static gboolean
+journal_should_compact (ECalBackendDecsync *cbfile)
+{
+	ECalBackendDecsyncPrivate *priv;
+
+	priv = cbfile->priv;
+
+	return priv->journal_size > MAX (JOURNAL_COMPACT_MIN_SIZE, priv->snapshot_size / 2);
+}
+
+static void
+journal_index_free_list (gpointer data)
+{
+	g_slist_free_full (data, g_object_unref);
+}
+
+/* Maps each UID in @vcalendar to its components */
+static GHashTable *
+journal_index_new (ICalComponent *vcalendar)
+{
+	GHashTable *index;
+	ICalCompIter *iter;
+	ICalComponent *icomp;
+
+	index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, journal_index_free_list);
+
+	iter = i_cal_component_begin_component (vcalendar, I_CAL_ANY_COMPONENT);
+	icomp = iter ? i_cal_comp_iter_deref (iter) : NULL;
+	while (icomp) {
+		ICalComponentKind kind;
+		const gchar *uid;
+
+		kind = i_cal_component_isa (icomp);
+		uid = i_cal_component_get_uid (icomp);
+
+		if ((kind == I_CAL_VEVENT_COMPONENT ||
+		     kind == I_CAL_VTODO_COMPONENT ||
+		     kind == I_CAL_VJOURNAL_COMPONENT) && uid) {
+			GSList *list;
+
+			list = g_hash_table_lookup (index, uid);
+			if (list)
+				g_slist_insert (list, icomp, 1);
+			else
+				g_hash_table_insert (index, g_strdup (uid), g_slist_prepend (NULL, icomp));
+		} else {
+			g_object_unref (icomp);
+		}
+
+		icomp = i_cal_comp_iter_next (iter);
+	}
+
+	g_clear_object (&iter);
+
+	return index;
+}
+
+static void
+journal_object_free (gpointer data)
+{
+	if (data)
+		g_object_unref (data);
+}
+
+/* Returns the UID of the objects in a journal record */
+static gchar *
+journal_object_dup_uid (ICalComponent *icalendar)
+{
+	ICalCompIter *iter;
+	ICalComponent *subcomp;
+	gchar *uid = NULL;
+
+	iter = i_cal_component_begin_component (icalendar, I_CAL_ANY_COMPONENT);
+	subcomp = iter ? i_cal_comp_iter_deref (iter) : NULL;
+	while (subcomp && !uid) {
+		ICalComponentKind kind;
+
+		kind = i_cal_component_isa (subcomp);
+		if (kind == I_CAL_VEVENT_COMPONENT ||
+		    kind == I_CAL_VTODO_COMPONENT ||
+		    kind == I_CAL_VJOURNAL_COMPONENT)
+			uid = g_strdup (i_cal_component_get_uid (subcomp));
+
+		g_object_unref (subcomp);
+		subcomp = uid ? NULL : i_cal_comp_iter_next (iter);
+	}
+
+	g_clear_object (&subcomp);
+	g_clear_object (&iter);
+
+	return uid;
+}
+
+/* Reads the journal next to @filename, when it belongs to the file with
+ * the @generation. Returns the last state of each object it contains:
+ * gchar *uid -> ICalComponent *vcalendar, or NULL when it was removed. */
+static GHashTable *
+journal_read (ECalBackendDecsync *cbfile,
+              const gchar *filename,
+              const gchar *generation,
+              gchar **out_revision)
+{
+	ECalBackendDecsyncPrivate *priv;
+	GHashTable *objects;
+	GStatBuf st;
+	gchar *journal_path, *header, *contents = NULL;
+	const gchar *ptr, *end;
+	gsize length = 0;
+
+	priv = cbfile->priv;
+
+	if (g_stat (filename, &st) == 0)
+		priv->snapshot_size = st.st_size;
+
+	priv->journal_generation = generation ? (guint) g_ascii_strtoull (generation, NULL, 10) : 0;
+	priv->journal_size = 0;
+
+	digests_load (cbfile, filename);
+
+	journal_path = g_strconcat (filename, JOURNAL_SUFFIX, NULL);
+
+	if (!g_file_get_contents (journal_path, &contents, &length, NULL)) {
+		g_free (journal_path);
+		return NULL;
+	}
+
+	header = g_strdup_printf ("%s %u\n", JOURNAL_HEADER, priv->journal_generation);
+	if (!g_str_has_prefix (contents, header)) {
+		/* Left over from before the last full save */
+		g_unlink (journal_path);
+		g_free (header);
+		g_free (contents);
+		g_free (journal_path);
+		return NULL;
+	}
+
+	objects = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, journal_object_free);
+
+	ptr = contents + strlen (header);
+	end = contents + length;
+	while (ptr < end) {
+		ICalComponent *icalendar;
+		const gchar *data;
+		gchar *endptr, *value, *uid;
+		guint64 len;
+
+		if (end - ptr < 2 || ptr[1] != ' ')
+			break;
+
+		len = g_ascii_strtoull (ptr + 2, &endptr, 10);
+		if (endptr == ptr + 2 || endptr >= end || *endptr != '\n')
+			break;
+
+		data = endptr + 1;
+		if ((guint64) (end - data) <= len || data[len] != '\n')
+			break;
+
+		value = g_strndup (data, len);
+
+		/* The digest of an object is reset by each of its records,
+		 * and set again by the H record which follows */
+		switch (*ptr) {
+			case 'U':
+				icalendar = i_cal_parser_parse_string (value);
+				uid = icalendar ? journal_object_dup_uid (icalendar) : NULL;
+				if (uid) {
+					decsync_digests_remove (priv->digests, uid);
+					g_hash_table_replace (objects, uid, icalendar);
+				} else {
+					g_clear_object (&icalendar);
+				}
+				break;
+			case 'D':
+				decsync_digests_remove (priv->digests, value);
+				g_hash_table_replace (objects, g_strdup (value), NULL);
+				break;
+			case 'H':
+				if (len > 17 && value[16] == ' ') {
+					guint64 digest;
+
+					value[16] = '\0';
+					if (decsync_digest_from_string (value, &digest))
+						decsync_digests_set (priv->digests, value + 17, digest);
+				}
+				break;
+			case 'R':
+				if (out_revision) {
+					g_free (*out_revision);
+					*out_revision = g_strdup (value);
+				}
+				break;
+			default:
+				break;
+		}
+
+		g_free (value);
+		ptr = data + len + 1;
+	}
+
+	/* A partial record at the end, from an interrupted write; the next
+	 * save writes the whole file and starts a new journal */
+	if (ptr < end)
+		priv->journal_needs_snapshot = TRUE;
+
+	priv->journal_size = length;
+
+	g_free (header);
+	g_free (contents);
+	g_free (journal_path);
+
+	return objects;
+}
+
+/* Adds the timezones of a journal record which are not known yet and
+ * returns its other components, in order */
+static GSList *
+journal_object_take_components (ICalComponent *vcalendar,
+                                ICalComponent *icalendar)
+{
+	ICalCompIter *iter;
+	ICalComponent *subcomp;
+	GSList *icomps = NULL;
+
+	iter = i_cal_component_begin_component (icalendar, I_CAL_ANY_COMPONENT);
+	subcomp = iter ? i_cal_comp_iter_deref (iter) : NULL;
+	while (subcomp) {
+		ICalComponentKind kind;
+
+		kind = i_cal_component_isa (subcomp);
+
+		if (kind == I_CAL_VTIMEZONE_COMPONENT) {
+			ICalProperty *prop;
+			ICalTimezone *zone = NULL;
+			const gchar *tzid;
+
+			prop = i_cal_component_get_first_property (subcomp, I_CAL_TZID_PROPERTY);
+			tzid = prop ? i_cal_property_get_tzid (prop) : NULL;
+			if (tzid)
+				zone = i_cal_component_get_timezone (vcalendar, tzid);
+			if (tzid && !zone)
+				i_cal_component_take_component (vcalendar, i_cal_component_clone (subcomp));
+
+			g_clear_object (&zone);
+			g_clear_object (&prop);
+		} else if (kind == I_CAL_VEVENT_COMPONENT ||
+			   kind == I_CAL_VTODO_COMPONENT ||
+			   kind == I_CAL_VJOURNAL_COMPONENT) {
+			icomps = g_slist_prepend (icomps, i_cal_component_clone (subcomp));
+		}
+
+		g_object_unref (subcomp);
+		subcomp = i_cal_comp_iter_next (iter);
+	}
+
+	g_clear_object (&iter);
+
+	return g_slist_reverse (icomps);
+}
+
+/* Applies the journal next to @filename on top of its parsed content */
+static void
+journal_replay (ECalBackendDecsync *cbfile,
+                ICalComponent *vcalendar,
+                const gchar *filename)
+{
+	GHashTable *objects, *index;
+	GHashTableIter iter;
+	gpointer key, value;
+	gchar *generation, *revision = NULL;
+
+	generation = e_cal_util_component_dup_x_property (vcalendar, JOURNAL_X_PROP);
+	objects = journal_read (cbfile, filename, generation, &revision);
+	g_free (generation);
+
+	if (!objects)
+		return;
+
+	index = journal_index_new (vcalendar);
+
+	g_hash_table_iter_init (&iter, objects);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		GSList *link, *icomps;
+
+		for (link = g_hash_table_lookup (index, key); link; link = g_slist_next (link))
+			i_cal_component_remove_component (vcalendar, link->data);
+
+		if (!value)
+			continue;
+
+		icomps = journal_object_take_components (vcalendar, value);
+		for (link = icomps; link; link = g_slist_next (link))
+			i_cal_component_add_component (vcalendar, link->data);
+		g_slist_free_full (icomps, g_object_unref);
+	}
+
+	if (revision)
+		e_cal_util_component_set_x_property (vcalendar, ECAL_REVISION_X_PROP, revision);
+
+	g_hash_table_destroy (index);
+	g_hash_table_destroy (objects);
+	g_free (revision);
+}
+
+static void save_request (ECalBackendDecsync *cbfile);
+
+
+/* Returns whether @ical is the value the resource @uid was last set to,
+ * in which case applying it would not change anything */
+static gboolean
+digests_is_unchanged (ECalBackendDecsync *cbfile,
+                      const gchar *uid,
+                      const gchar *ical)
+{
+	ECalBackendDecsyncPrivate *priv;
+	gboolean unchanged;
+
+	priv = cbfile->priv;
+
+	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	unchanged = decsync_digests_matches (priv->digests, uid, decsync_digest_compute (ical));
+	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+
+	return unchanged;
+}
+
+/* Remembers @ical, or NULL when removed, as the value of the resource @uid */
 static void
-free_object_data (gpointer data)
+digests_update (ECalBackendDecsync *cbfile,
+                const gchar *uid,
+                const gchar *ical)
 {
-	ECalBackendDecsyncObject *obj_data = data;
+	ECalBackendDecsyncPrivate *priv;
 
-	if (obj_data->full_object)
-		g_object_unref (obj_data->full_object);
-	g_hash_table_destroy (obj_data->recurrences);
-	g_list_free (obj_data->recurrences_list);
+	priv = cbfile->priv;
 
-	g_free (obj_data);
+	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	if (ical)
+		decsync_digests_set (priv->digests, uid, decsync_digest_compute (ical));
+	else
+		decsync_digests_remove (priv->digests, uid);
+	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+}
+
+/* Adds the resource @uid to @batch, to be written to DecSync */
+static void
+publish_resource (ECalBackendDecsync *cbfile,
+                  DecsyncBatch *batch,
+                  const gchar *uid,
+                  const gchar *ical)
+{
+	decsync_batch_set_resource (batch, uid, ical);
+	digests_update (cbfile, uid, ical);
+}
+
+/* The size is in bytes */
+static void
+save_file_log (ECalBackendDecsync *cbfile,
+               const gchar *kind,
+               gint64 start_time,
+               gsize size)
+{
+	e_debug_log (
+		FALSE, E_DEBUG_LOG_DOMAIN_CAL_QUERIES, "---;%p;SAVE;%s;%s;%" G_GINT64_FORMAT "ms;%" G_GSIZE_FORMAT, cbfile,
+		G_OBJECT_TYPE_NAME (cbfile), kind, (g_get_monotonic_time () - start_time) / 1000, size);
 }
 
 /* Saves the calendar data */
-static gboolean
-save_file_when_idle (gpointer user_data)
+static void
+save_file (ECalBackendDecsync *cbfile)
 {
 	ECalBackendDecsyncPrivate *priv;
 	GError *e = NULL;
@@ -149,24 +1184,54 @@ save_file_when_idle (gpointer user_data)
 	GFileOutputStream *stream;
 	gboolean succeeded;
 	gchar *tmp, *backup_uristr;
-	gchar *buf;
-	ECalBackendDecsync *cbfile = user_data;
+	gchar *buf, *generation, *journal_path;
+	gsize buf_len;
 	gboolean writable;
+	gint64 start_time;
 
 	priv = cbfile->priv;
-	g_return_val_if_fail (priv->path != NULL, FALSE);
-	g_return_val_if_fail (priv->vcalendar != NULL, FALSE);
+	g_return_if_fail (priv->path != NULL);
+	g_return_if_fail (priv->vcalendar != NULL);
 
 	writable = e_cal_backend_get_writable (E_CAL_BACKEND (cbfile));
+	start_time = g_get_monotonic_time ();
 
+	/* Keeps the writers out, the readers go on in parallel */
 	g_rec_mutex_lock (&priv->idle_save_rmutex);
-	if (!priv->is_dirty || !writable) {
-		priv->dirty_idle_id = 0;
+
+	/* Saved once the whole file is read, see load_finish() */
+	if (priv->loading) {
+		g_rec_mutex_unlock (&priv->idle_save_rmutex);
+		return;
+	}
+
+	/* Never overwrite a file which could not be read completely */
+	if (!priv->is_dirty || !writable || priv->load_failed) {
 		priv->is_dirty = FALSE;
 		g_rec_mutex_unlock (&priv->idle_save_rmutex);
-		return FALSE;
+		return;
+	}
+
+	if (journal_append (cbfile, &buf_len, &e)) {
+		priv->is_dirty = FALSE;
+
+		/* Fold the journal back into the calendar file once it grows
+		 * too large, with the next save */
+		if (journal_should_compact (cbfile)) {
+			priv->journal_needs_snapshot = TRUE;
+			priv->is_dirty = TRUE;
+			save_request (cbfile);
+		}
+
+		g_rec_mutex_unlock (&priv->idle_save_rmutex);
+
+		save_file_log (cbfile, "journal", start_time, buf_len);
+		return;
 	}
 
+	/* Fall back to writing the whole file */
+	g_clear_error (&e);
+
 	file = g_file_new_for_path (priv->path);
 	if (!file)
 		goto error_malformed_uri;
@@ -201,8 +1266,21 @@ save_file_when_idle (gpointer user_data)
 		goto error;
 	}
 
+	/* Only taken over once the file is in place, so a journal started
+	 * after a failed save still matches the file on disk */
+	generation = g_strdup_printf ("%u", priv->journal_generation + 1);
+
+	/* The whole calendar is serialized with the readers kept out, but
+	 * they do not wait for the file to be written */
+	data_write_lock (cbfile);
+	e_cal_util_component_set_x_property (priv->vcalendar, JOURNAL_X_PROP, generation);
 	buf = i_cal_component_as_ical_string (priv->vcalendar);
-	succeeded = g_output_stream_write_all (G_OUTPUT_STREAM (stream), buf, strlen (buf) * sizeof (gchar), NULL, NULL, &e);
+	data_write_unlock (cbfile);
+
+	g_free (generation);
+
+	buf_len = strlen (buf);
+	succeeded = g_output_stream_write_all (G_OUTPUT_STREAM (stream), buf, buf_len * sizeof (gchar), NULL, NULL, &e);
 	g_free (buf);
 
 	if (!succeeded || e) {
@@ -229,18 +1307,31 @@ save_file_when_idle (gpointer user_data)
 	if (e)
 		goto error;
 
+	/* The calendar file contains everything from the journal now */
+	journal_path = g_strconcat (priv->path, JOURNAL_SUFFIX, NULL);
+	g_unlink (journal_path);
+	g_free (journal_path);
+
+	g_hash_table_remove_all (priv->journal_uids);
+	priv->journal_needs_snapshot = FALSE;
+	priv->journal_generation++;
+	priv->journal_size = 0;
+	priv->snapshot_size = buf_len;
+
 	priv->is_dirty = FALSE;
-	priv->dirty_idle_id = 0;
+	digests_save (cbfile);
 
 	g_rec_mutex_unlock (&priv->idle_save_rmutex);
 
-	return FALSE;
+	save_file_log (cbfile, "file", start_time, buf_len);
+
+	return;
 
  error_malformed_uri:
 	g_rec_mutex_unlock (&priv->idle_save_rmutex);
 	e_cal_backend_notify_error (E_CAL_BACKEND (cbfile),
 				  _("Cannot save calendar data: Malformed URI."));
-	return FALSE;
+	return;
 
  error:
 	g_rec_mutex_unlock (&priv->idle_save_rmutex);
@@ -253,8 +1344,111 @@ save_file_when_idle (gpointer user_data)
 		g_error_free (e);
 	} else
 		e_cal_backend_notify_error (E_CAL_BACKEND (cbfile), _("Cannot save calendar data"));
+}
 
-	return FALSE;
+static gpointer
+save_thread (gpointer user_data)
+{
+	ECalBackendDecsync *cbfile = user_data;
+	ECalBackendDecsyncPrivate *priv;
+
+	priv = cbfile->priv;
+
+	g_mutex_lock (&priv->save_lock);
+
+	while (!priv->save_quit) {
+		gint64 deadline;
+
+		if (!priv->save_requested) {
+			g_cond_wait (&priv->save_cond, &priv->save_lock);
+			continue;
+		}
+
+		deadline = MIN (priv->save_last_change + priv->save_delay,
+				priv->save_first_change + priv->save_max_delay);
+		if (g_get_monotonic_time () < deadline) {
+			g_cond_wait_until (&priv->save_cond, &priv->save_lock, deadline);
+			continue;
+		}
+
+		priv->save_requested = FALSE;
+		g_mutex_unlock (&priv->save_lock);
+
+		save_file (cbfile);
+
+		g_mutex_lock (&priv->save_lock);
+	}
+
+	g_mutex_unlock (&priv->save_lock);
+
+	return NULL;
+}
+
+/* Lets the save thread save the data once the changes settle, starting
+ * the thread when needed */
+static void
+save_request (ECalBackendDecsync *cbfile)
+{
+	ECalBackendDecsyncPrivate *priv;
+	gint64 now;
+
+	priv = cbfile->priv;
+	now = g_get_monotonic_time ();
+
+	g_mutex_lock (&priv->save_lock);
+
+	if (!priv->save_requested) {
+		priv->save_requested = TRUE;
+		priv->save_first_change = now;
+	}
+	priv->save_last_change = now;
+
+	if (!priv->save_thread && !priv->save_quit)
+		priv->save_thread = g_thread_new ("decsync-save", save_thread, cbfile);
+	else
+		g_cond_signal (&priv->save_cond);
+
+	g_mutex_unlock (&priv->save_lock);
+}
+
+/* Stops the save thread, without saving what it did not save yet */
+static void
+save_thread_stop (ECalBackendDecsync *cbfile)
+{
+	ECalBackendDecsyncPrivate *priv;
+	GThread *thread;
+
+	priv = cbfile->priv;
+
+	g_mutex_lock (&priv->save_lock);
+	priv->save_quit = TRUE;
+	thread = priv->save_thread;
+	priv->save_thread = NULL;
+	g_cond_signal (&priv->save_cond);
+	g_mutex_unlock (&priv->save_lock);
+
+	if (thread)
+		g_thread_join (thread);
+}
+
+static gint64
+save_delay_from_env (const gchar *name,
+                     gint64 default_ms)
+{
+	const gchar *value;
+	gint64 delay_ms = default_ms;
+
+	value = g_getenv (name);
+	if (value && *value) {
+		gchar *end = NULL;
+		gint64 parsed;
+
+		parsed = g_ascii_strtoll (value, &end, 10);
+		if (end && !*end && parsed >= 0)
+			delay_ms = parsed;
+	}
+
+	return delay_ms * G_TIME_SPAN_MILLISECOND;
 }
 
 static void
@@ -263,18 +1457,126 @@ save (ECalBackendDecsync *cbfile,
 {
 	ECalBackendDecsyncPrivate *priv;
 
+	priv = cbfile->priv;
+
+	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	if (priv->in_batch) {
+		priv->batch_dirty = TRUE;
+		priv->batch_bump_revision = priv->batch_bump_revision || do_bump_revision;
+		g_rec_mutex_unlock (&priv->idle_save_rmutex);
+		return;
+	}
+	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+
 	if (do_bump_revision)
 		bump_revision (cbfile);
 
-	priv = cbfile->priv;
-
 	g_rec_mutex_lock (&priv->idle_save_rmutex);
 	priv->is_dirty = TRUE;
+	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+
+	save_request (cbfile);
+}
+
+typedef struct {
+	ECalComponentId *id; /* set for removals only */
+	ECalComponent *old_component;
+	ECalComponent *new_component;
+} BatchNotification;
+
+static void
+batch_notification_free (gpointer data)
+{
+	BatchNotification *bn = data;
+
+	if (bn->id)
+		e_cal_component_id_free (bn->id);
+	g_clear_object (&bn->old_component);
+	g_clear_object (&bn->new_component);
+
+	g_free (bn);
+}
 
-	if (!priv->dirty_idle_id)
-		priv->dirty_idle_id = g_idle_add ((GSourceFunc) save_file_when_idle, cbfile);
+/* Queues the notification when a batch is in progress, returns FALSE
+ * when it should be emitted right away */
+static gboolean
+batch_notification_queue (ECalBackendDecsync *cbfile,
+                          const ECalComponentId *id,
+                          ECalComponent *old_component,
+                          ECalComponent *new_component)
+{
+	ECalBackendDecsyncPrivate *priv;
+	BatchNotification *bn;
+	gboolean queued = FALSE;
+
+	priv = cbfile->priv;
 
+	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	if (priv->in_batch) {
+		bn = g_new0 (BatchNotification, 1);
+		bn->id = id ? e_cal_component_id_copy (id) : NULL;
+		bn->old_component = old_component ? e_cal_component_clone (old_component) : NULL;
+		bn->new_component = new_component ? e_cal_component_clone (new_component) : NULL;
+
+		priv->batch_notifications = g_slist_prepend (priv->batch_notifications, bn);
+		queued = TRUE;
+	}
 	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+
+	return queued;
+}
+
+static void
+notify_component_created (ECalBackendDecsync *cbfile,
+                          ECalComponent *comp)
+{
+	journal_mark_uid (cbfile, e_cal_component_get_uid (comp));
+
+	if (!batch_notification_queue (cbfile, NULL, NULL, comp))
+		e_cal_backend_notify_component_created (E_CAL_BACKEND (cbfile), comp);
+}
+
+static void
+notify_component_modified (ECalBackendDecsync *cbfile,
+                           ECalComponent *old_component,
+                           ECalComponent *new_component)
+{
+	journal_mark_uid (cbfile, e_cal_component_get_uid (new_component ? new_component : old_component));
+
+	if (!batch_notification_queue (cbfile, NULL, old_component, new_component))
+		e_cal_backend_notify_component_modified (E_CAL_BACKEND (cbfile), old_component, new_component);
+}
+
+static void
+notify_component_removed (ECalBackendDecsync *cbfile,
+                          const ECalComponentId *id,
+                          ECalComponent *old_component,
+                          ECalComponent *new_component)
+{
+	journal_mark_uid (cbfile, id ? e_cal_component_id_get_uid (id) : NULL);
+
+	if (!batch_notification_queue (cbfile, id, old_component, new_component))
+		e_cal_backend_notify_component_removed (E_CAL_BACKEND (cbfile), id, old_component, new_component);
+}
+
+/* Emits the notifications queued during a batch, in their original order */
+static void
+batch_notifications_emit (ECalBackendDecsync *cbfile,
+                          GSList *notifications)
+{
+	ECalBackend *backend = E_CAL_BACKEND (cbfile);
+	GSList *link;
+
+	for (link = notifications; link; link = g_slist_next (link)) {
+		BatchNotification *bn = link->data;
+
+		if (bn->id)
+			e_cal_backend_notify_component_removed (backend, bn->id, bn->old_component, bn->new_component);
+		else if (bn->old_component)
+			e_cal_backend_notify_component_modified (backend, bn->old_component, bn->new_component);
+		else
+			e_cal_backend_notify_component_created (backend, bn->new_component);
+	}
 }
 
 static void
@@ -295,7 +1597,7 @@ free_calendar_data (ECalBackendDecsync *cbfile)
 
 	priv = cbfile->priv;
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	data_write_lock (cbfile);
 
 	if (priv->interval_tree)
 		e_intervaltree_destroy (priv->interval_tree);
@@ -305,10 +1607,9 @@ free_calendar_data (ECalBackendDecsync *cbfile)
 	priv->comp_uid_hash = NULL;
 	priv->vcalendar = NULL;
 
-	g_list_free (priv->comp);
-	priv->comp = NULL;
+	comp_list_clear (&priv->comp);
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (cbfile);
 }
 
 /* Dispose handler for the decsync backend */
@@ -322,9 +1623,16 @@ e_cal_backend_decsync_dispose (GObject *object)
 	cbfile = E_CAL_BACKEND_DECSYNC (object);
 	priv = cbfile->priv;
 
+	if (priv->scheduler_id) {
+		decsync_scheduler_remove (priv->scheduler_id);
+		priv->scheduler_id = 0;
+	}
+	g_clear_pointer (&priv->watcher, decsync_watcher_free);
+
 	/* Save if necessary */
+	save_thread_stop (cbfile);
 	if (priv->is_dirty)
-		save_file_when_idle (cbfile);
+		save_file (cbfile);
 
 	free_calendar_data (cbfile);
 
@@ -341,16 +1649,33 @@ static void
 e_cal_backend_decsync_finalize (GObject *object)
 {
 	ECalBackendDecsyncPrivate *priv;
+	guint ii;
 
 	priv = E_CAL_BACKEND_DECSYNC (object)->priv;
 
 	/* Clean up */
 
-	if (priv->dirty_idle_id)
-		g_source_remove (priv->dirty_idle_id);
-
 	g_rec_mutex_clear (&priv->idle_save_rmutex);
+	g_mutex_clear (&priv->save_lock);
+	g_cond_clear (&priv->save_cond);
+	g_rw_lock_clear (&priv->data_lock);
+	for (ii = 0; ii < COMP_LOCK_STRIPES; ii++)
+		g_mutex_clear (&priv->comp_locks[ii]);
+	g_mutex_clear (&priv->vcalendar_lock);
+	g_mutex_clear (&priv->load_lock);
+	g_cond_clear (&priv->load_cond);
+	g_mutex_clear (&priv->refresh_lock);
+	g_mutex_clear (&priv->free_busy_lock);
+	g_queue_clear_full (&priv->free_busy_cache, free_busy_cache_entry_free);
+	g_mutex_clear (&priv->strings_lock);
+	g_mutex_clear (&priv->query_cache_lock);
+	g_queue_clear_full (&priv->query_cache, query_cache_entry_free);
+	g_hash_table_destroy (priv->query_cache_index);
+	g_hash_table_destroy (priv->populating_views);
 	g_hash_table_destroy (priv->cached_timezones);
+	g_hash_table_destroy (priv->journal_uids);
+	decsync_digests_free (priv->digests);
+	g_free (priv->sync_state);
 
 	g_free (priv->path);
 	g_free (priv->file_name);
@@ -467,6 +1792,11 @@ e_cal_backend_decsync_get_backend_property (ECalBackend *backend,
 			E_CAL_STATIC_CAPABILITY_REFRESH_SUPPORTED,
 			NULL);
 
+	} else if (g_str_equal (prop_name, DECSYNC_BACKEND_PROPERTY_SKIPPED_ENTRIES)) {
+		ECalBackendDecsync *cbfile = E_CAL_BACKEND_DECSYNC (backend);
+
+		return g_strdup_printf ("%d", g_atomic_int_get (&cbfile->priv->skipped_entries));
+
 	} else if (g_str_equal (prop_name, E_CAL_BACKEND_PROPERTY_CAL_EMAIL_ADDRESS) ||
 		   g_str_equal (prop_name, E_CAL_BACKEND_PROPERTY_ALARM_EMAIL_ADDRESS)) {
 		ESourceLocal *local_extension;
@@ -503,15 +1833,32 @@ e_cal_backend_decsync_get_backend_property (ECalBackend *backend,
 		return prop_value;
 
 	} else if (g_str_equal (prop_name, E_CAL_BACKEND_PROPERTY_REVISION)) {
+		ECalBackendDecsync *cbfile = E_CAL_BACKEND_DECSYNC (backend);
 		ICalProperty *prop;
 		gchar *revision = NULL;
+		gboolean locked;
+
+		locked = data_read_lock (cbfile);
+		g_mutex_lock (&cbfile->priv->vcalendar_lock);
+		prop = get_revision_property (cbfile);
+		if (prop) {
+			revision = g_strdup (i_cal_property_get_x (prop));
+			g_object_unref (prop);
+		}
+		g_mutex_unlock (&cbfile->priv->vcalendar_lock);
+		data_read_unlock (cbfile, locked);
+
+		if (revision)
+			return revision;
 
 		/* This returns NULL if backend lacks a vcalendar. */
-		prop = ensure_revision (E_CAL_BACKEND_DECSYNC (backend));
+		data_write_lock (cbfile);
+		prop = ensure_revision (cbfile);
 		if (prop) {
 			revision = g_strdup (i_cal_property_get_x (prop));
 			g_object_unref (prop);
 		}
+		data_write_unlock (cbfile);
 
 		return revision;
 	}
@@ -523,6 +1870,7 @@ e_cal_backend_decsync_get_backend_property (ECalBackend *backend,
 
 typedef struct _ResolveTzidData {
 	ICalComponent *vcalendar;
+	GMutex *vcalendar_lock; /* set by readers */
 	GHashTable *zones; /* gchar *tzid -> ICalTimezone * */
 } ResolveTzidData;
 
@@ -532,6 +1880,7 @@ resolve_tzid_data_init (ResolveTzidData *rtd,
 {
 	if (rtd) {
 		rtd->vcalendar = vcalendar;
+		rtd->vcalendar_lock = NULL;
 		rtd->zones = NULL;
 	}
 }
@@ -566,10 +1915,15 @@ resolve_tzid_cb (const gchar *tzid,
 	}
 
 	zone = i_cal_timezone_get_builtin_timezone_from_tzid (tzid);
-	if (zone)
+	if (zone) {
 		g_object_ref (zone);
-	else if (rtd->vcalendar)
+	} else if (rtd->vcalendar) {
+		if (rtd->vcalendar_lock)
+			g_mutex_lock (rtd->vcalendar_lock);
 		zone = i_cal_component_get_timezone (rtd->vcalendar, tzid);
+		if (rtd->vcalendar_lock)
+			g_mutex_unlock (rtd->vcalendar_lock);
+	}
 
 	if (zone) {
 		if (!rtd->zones)
@@ -625,42 +1979,227 @@ check_dup_uid (ECalBackendDecsync *cbfile,
 		uid,
 		rid ? rid : ""));
 
-	new_uid = e_util_generate_uid ();
-	e_cal_component_set_uid (comp, new_uid);
+	new_uid = e_util_generate_uid ();
+	e_cal_component_set_uid (comp, new_uid);
+
+	/* FIXME: I think we need to reset the SEQUENCE property and reset the
+	 * CREATED/DTSTAMP/LAST-MODIFIED.
+	 */
+
+	journal_invalidate (cbfile);
+	save (cbfile, FALSE);
+
+ done:
+	g_free (rid);
+	g_free (new_uid);
+}
+
+static time_t
+get_rid_as_time_t (ECalComponent *comp)
+{
+	ECalComponentRange *range;
+	ECalComponentDateTime *dt;
+	time_t tmt = (time_t) -1;
+
+	range = e_cal_component_get_recurid (comp);
+	if (!range)
+		return tmt;
+
+	dt = e_cal_component_range_get_datetime (range);
+	if (!dt) {
+		e_cal_component_range_free (range);
+		return tmt;
+	}
+
+	tmt = i_cal_time_as_timet (e_cal_component_datetime_get_value (dt));
+
+	e_cal_component_range_free (range);
+
+	return tmt;
+}
+
+static void
+object_occurrence_clear (gpointer data)
+{
+	ObjectOccurrence *occurrence = data;
+
+	g_clear_object (&occurrence->istart);
+	g_clear_object (&occurrence->iend);
+}
+
+static gint
+object_occurrence_compare (gconstpointer a,
+                           gconstpointer b)
+{
+	const ObjectOccurrence *occurrence1 = a, *occurrence2 = b;
+
+	if (occurrence1->start != occurrence2->start)
+		return occurrence1->start < occurrence2->start ? -1 : 1;
+
+	return 0;
+}
+
+/* Whether the occurrence is in the window, the same way as in
+ * e_cal_recur_generate_instances_sync() */
+static gboolean
+object_occurrence_overlaps (const ObjectOccurrence *occurrence,
+                            time_t start,
+                            time_t end)
+{
+	if (occurrence->start == occurrence->end)
+		return occurrence->start >= start && occurrence->start < end;
+
+	return occurrence->start < end && occurrence->end > start;
+}
+
+static gboolean
+collect_occurrence_cb (ICalComponent *icomp,
+                       ICalTime *instance_start,
+                       ICalTime *instance_end,
+                       gpointer user_data,
+                       GCancellable *cancellable,
+                       GError **error)
+{
+	GArray *occurrences = user_data;
+	ObjectOccurrence occurrence;
+
+	if (occurrences->len >= OCCURRENCES_MAX)
+		return FALSE;
+
+	occurrence.istart = i_cal_time_clone (instance_start);
+	occurrence.iend = i_cal_time_clone (instance_end);
+
+	if (!i_cal_time_is_date (occurrence.istart))
+		i_cal_time_convert_to_zone_inplace (occurrence.istart, i_cal_timezone_get_utc_timezone ());
+	if (!i_cal_time_is_date (occurrence.iend))
+		i_cal_time_convert_to_zone_inplace (occurrence.iend, i_cal_timezone_get_utc_timezone ());
+
+	occurrence.start = i_cal_time_as_timet (occurrence.istart);
+	occurrence.end = i_cal_time_as_timet (occurrence.iend);
+
+	g_array_append_val (occurrences, occurrence);
+
+	return TRUE;
+}
+
+/* Called with the lock of the component held */
+static void
+object_occurrences_generate (ECalBackendDecsync *cbfile,
+                             ECalBackendDecsyncObject *obj_data,
+                             time_t start,
+                             time_t end)
+{
+	ICalComponent *icomp, *vcalendar_comp;
+	ICalTimezone *utc_zone;
+	ICalTime *starttt, *endtt;
+	ResolveTzidData rtd;
+
+	g_clear_pointer (&obj_data->occurrences, g_array_unref);
+
+	obj_data->occurrences = g_array_new (FALSE, FALSE, sizeof (ObjectOccurrence));
+	g_array_set_clear_func (obj_data->occurrences, object_occurrence_clear);
+	obj_data->occurrences_start = start;
+	obj_data->occurrences_end = end;
+
+	icomp = e_cal_component_get_icalcomponent (obj_data->full_object);
+	vcalendar_comp = i_cal_component_get_parent (icomp);
+
+	resolve_tzid_data_init (&rtd, vcalendar_comp);
+	rtd.vcalendar_lock = &cbfile->priv->vcalendar_lock;
+
+	utc_zone = i_cal_timezone_get_utc_timezone ();
+	starttt = i_cal_time_new_from_timet_with_zone (start, FALSE, utc_zone);
+	endtt = i_cal_time_new_from_timet_with_zone (end, FALSE, utc_zone);
+
+	e_cal_recur_generate_instances_sync (
+		icomp, starttt, endtt,
+		collect_occurrence_cb,
+		obj_data->occurrences,
+		resolve_tzid_cb,
+		&rtd,
+		utc_zone,
+		NULL, NULL);
 
-	/* FIXME: I think we need to reset the SEQUENCE property and reset the
-	 * CREATED/DTSTAMP/LAST-MODIFIED.
-	 */
+	/* Not usable when some are missing */
+	obj_data->occurrences_truncated = obj_data->occurrences->len >= OCCURRENCES_MAX;
 
-	save (cbfile, FALSE);
+	g_array_sort (obj_data->occurrences, object_occurrence_compare);
 
- done:
-	g_free (rid);
-	g_free (new_uid);
+	g_clear_object (&starttt);
+	g_clear_object (&endtt);
+	resolve_tzid_data_clear (&rtd);
+	g_clear_object (&vcalendar_comp);
 }
 
-static time_t
-get_rid_as_time_t (ECalComponent *comp)
+/* Returns the occurrences of the recurring event of @obj_data, when all
+ * of them in the window are known, or NULL otherwise. They are generated
+ * on the first use for a horizon around the current time, and kept until
+ * the object changes. Called with the data lock held, but not the lock of
+ * the component. Free the result with g_array_unref(). */
+static GArray *
+object_occurrences_get (ECalBackendDecsync *cbfile,
+                        ECalBackendDecsyncObject *obj_data,
+                        time_t start,
+                        time_t end)
 {
-	ECalComponentRange *range;
-	ECalComponentDateTime *dt;
-	time_t tmt = (time_t) -1;
+	ECalComponent *comp = obj_data->full_object;
+	GArray *occurrences = NULL;
+	GMutex *comp_lock;
 
-	range = e_cal_component_get_recurid (comp);
-	if (!range)
-		return tmt;
+	if (!comp || start > end)
+		return NULL;
 
-	dt = e_cal_component_range_get_datetime (range);
-	if (!dt) {
-		e_cal_component_range_free (range);
-		return tmt;
+	comp_lock = comp_lock_for (cbfile, comp);
+	g_mutex_lock (comp_lock);
+
+	if (e_cal_component_get_vtype (comp) == E_CAL_COMPONENT_EVENT &&
+	    e_cal_component_has_recurrences (comp)) {
+		if (!obj_data->occurrences ||
+		    start < obj_data->occurrences_start ||
+		    end > obj_data->occurrences_end) {
+			time_t now = time (NULL);
+			time_t horizon = (time_t) OCCURRENCES_HORIZON_DAYS * 24 * 60 * 60;
+
+			/* The horizon moves with the current time */
+			if (start >= now - horizon && end <= now + horizon)
+				object_occurrences_generate (cbfile, obj_data, now - horizon, now + horizon);
+		}
+
+		if (obj_data->occurrences && !obj_data->occurrences_truncated &&
+		    start >= obj_data->occurrences_start &&
+		    end <= obj_data->occurrences_end)
+			occurrences = g_array_ref (obj_data->occurrences);
 	}
 
-	tmt = i_cal_time_as_timet (e_cal_component_datetime_get_value (dt));
+	g_mutex_unlock (comp_lock);
 
-	e_cal_component_range_free (range);
+	return occurrences;
+}
 
-	return tmt;
+/* Like object_occurrences_get(), for the component in the interval tree,
+ * which is either the main component or a detached recurrence */
+static GArray *
+comp_occurrences_get (ECalBackendDecsync *cbfile,
+                      ECalComponent *comp,
+                      time_t start,
+                      time_t end)
+{
+	ECalBackendDecsyncObject *obj_data = NULL;
+	GMutex *comp_lock;
+	const gchar *uid;
+
+	comp_lock = comp_lock_for (cbfile, comp);
+
+	g_mutex_lock (comp_lock);
+	uid = e_cal_component_get_uid (comp);
+	if (uid && !e_cal_component_is_instance (comp))
+		obj_data = g_hash_table_lookup (cbfile->priv->comp_uid_hash, uid);
+	g_mutex_unlock (comp_lock);
+
+	if (!obj_data || obj_data->full_object != comp)
+		return NULL;
+
+	return object_occurrences_get (cbfile, obj_data, start, end);
 }
 
 /* Adds component to the interval tree
@@ -692,9 +2231,9 @@ add_component_to_intervaltree (ECalBackendDecsync *cbfile,
 		g_print ("Bogus component %s\n", str);
 		g_free (str);
 	} else {
-		g_rec_mutex_lock (&priv->idle_save_rmutex);
+		data_write_lock (cbfile);
 		e_intervaltree_insert (priv->interval_tree, time_start, time_end, comp);
-		g_rec_mutex_unlock (&priv->idle_save_rmutex);
+		data_write_unlock (cbfile);
 	}
 }
 
@@ -715,9 +2254,9 @@ remove_component_from_intervaltree (ECalBackendDecsync *cbfile,
 	uid = e_cal_component_get_uid (comp);
 	rid = e_cal_component_get_recurid_as_string (comp);
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	data_write_lock (cbfile);
 	res = e_intervaltree_remove (priv->interval_tree, uid, rid);
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (cbfile);
 
 	g_free (rid);
 
@@ -768,7 +2307,7 @@ add_component (ECalBackendDecsync *cbfile,
 		}
 
 		g_hash_table_insert (obj_data->recurrences, rid, comp);
-		obj_data->recurrences_list = g_list_append (obj_data->recurrences_list, comp);
+		comp_list_append (&obj_data->recurrences_list, comp);
 	} else {
 		if (obj_data) {
 			if (obj_data->full_object) {
@@ -786,9 +2325,11 @@ add_component (ECalBackendDecsync *cbfile,
 		}
 	}
 
+	object_data_invalidate (obj_data);
+
 	add_component_to_intervaltree (cbfile, comp);
 
-	priv->comp = g_list_prepend (priv->comp, comp);
+	comp_list_prepend (&priv->comp, comp);
 
 	/* Put the object in the toplevel component if required */
 
@@ -799,6 +2340,8 @@ add_component (ECalBackendDecsync *cbfile,
 		g_return_if_fail (icomp != NULL);
 
 		i_cal_component_add_component (priv->vcalendar, icomp);
+
+		journal_mark_uid (cbfile, uid);
 	}
 }
 
@@ -829,7 +2372,7 @@ remove_recurrence_cb (gpointer key,
 	g_object_unref (icomp);
 
 	/* remove it from our mapping */
-	priv->comp = g_list_remove (priv->comp, comp);
+	comp_list_remove (&priv->comp, comp);
 
 	return TRUE;
 }
@@ -845,7 +2388,7 @@ remove_component (ECalBackendDecsync *cbfile,
 {
 	ECalBackendDecsyncPrivate *priv;
 	ICalComponent *icomp;
-	GList *l;
+	gboolean removed;
 
 	priv = cbfile->priv;
 
@@ -857,9 +2400,8 @@ remove_component (ECalBackendDecsync *cbfile,
 		i_cal_component_remove_component (priv->vcalendar, icomp);
 
 		/* Remove it from our mapping */
-		l = g_list_find (priv->comp, obj_data->full_object);
-		g_return_if_fail (l != NULL);
-		priv->comp = g_list_delete_link (priv->comp, l);
+		removed = comp_list_remove (&priv->comp, obj_data->full_object);
+		g_return_if_fail (removed);
 
 		if (!remove_component_from_intervaltree (cbfile, obj_data->full_object)) {
 			g_message (G_STRLOC " Could not remove component from interval tree!");
@@ -869,6 +2411,8 @@ remove_component (ECalBackendDecsync *cbfile,
 	/* remove the recurrences also */
 	g_hash_table_foreach_remove (obj_data->recurrences, (GHRFunc) remove_recurrence_cb, cbfile);
 
+	journal_mark_uid (cbfile, uid);
+
 	g_hash_table_remove (priv->comp_uid_hash, uid);
 
 	save (cbfile, TRUE);
@@ -961,6 +2505,24 @@ cal_backend_decsync_take_icomp (ECalBackendDecsync *cbfile,
 	g_clear_object (&prop);
 }
 
+/* Takes the toplevel component and stores the objects it contains;
+ * called with the data locked for writing */
+static void
+load_vcalendar (ECalBackendDecsync *cbfile,
+                ICalComponent *icomp)
+{
+	ECalBackendDecsyncPrivate *priv;
+
+	priv = cbfile->priv;
+
+	cal_backend_decsync_take_icomp (cbfile, icomp);
+	priv->path = uri_to_path (E_CAL_BACKEND (cbfile));
+
+	priv->comp_uid_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, free_object_data);
+	priv->interval_tree = e_intervaltree_new ();
+	scan_vcalendar (cbfile);
+}
+
 /* Parses an open iCalendar file and loads it into the backend */
 static void
 open_cal (ECalBackendDecsync *cbfile,
@@ -989,16 +2551,12 @@ open_cal (ECalBackendDecsync *cbfile,
 		return;
 	}
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
-
-	cal_backend_decsync_take_icomp (cbfile, icomp);
-	priv->path = uri_to_path (E_CAL_BACKEND (cbfile));
+	data_write_lock (cbfile);
 
-	priv->comp_uid_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, free_object_data);
-	priv->interval_tree = e_intervaltree_new ();
-	scan_vcalendar (cbfile);
+	journal_replay (cbfile, icomp, uristr);
+	load_vcalendar (cbfile, icomp);
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (cbfile);
 }
 
 static void
@@ -1022,7 +2580,7 @@ create_cal (ECalBackendDecsync *cbfile,
 
 	g_free (dirname);
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	data_write_lock (cbfile);
 
 	/* Create the new calendar information */
 	icomp = e_cal_util_new_top_level ();
@@ -1034,9 +2592,475 @@ create_cal (ECalBackendDecsync *cbfile,
 
 	priv->path = uri_to_path (E_CAL_BACKEND (cbfile));
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (cbfile);
+
+	save (cbfile, TRUE);
+}
+
+#define LOAD_CHUNK_SIZE 500
+
+typedef struct {
+	ECalBackendDecsync *cbfile;
+	GDataInputStream *stream;
+	gchar *pending_line;
+	GHashTable *journal; /* see journal_read() */
+	gchar *revision;
+	gint64 start_time;
+} LoadData;
+
+static gboolean
+is_loading (ECalBackendDecsync *cbfile)
+{
+	ECalBackendDecsyncPrivate *priv;
+	gboolean loading;
+
+	priv = cbfile->priv;
+
+	g_mutex_lock (&priv->load_lock);
+	loading = priv->loading;
+	g_mutex_unlock (&priv->load_lock);
+
+	return loading;
+}
+
+/* Only views are served while the calendar file is loaded, they get the
+ * matches of every chunk. The other calls wait here until the whole file
+ * is loaded, since their answers must be complete: the detached instances
+ * of an object may come later in the file, and the objects changed in the
+ * journal are added only at the end. Must not be called with the data
+ * locked. */
+static void
+wait_for_load (ECalBackendDecsync *cbfile)
+{
+	ECalBackendDecsyncPrivate *priv;
+
+	priv = cbfile->priv;
+
+	g_mutex_lock (&priv->load_lock);
+	while (priv->loading)
+		g_cond_wait (&priv->load_cond, &priv->load_lock);
+	g_mutex_unlock (&priv->load_lock);
+}
+
+static gchar *
+load_read_line (GDataInputStream *stream,
+                GError **error)
+{
+	gchar *line;
+	gsize len = 0;
+
+	line = g_data_input_stream_read_line (stream, &len, NULL, error);
+	if (line && len > 0 && line[len - 1] == '\r')
+		line[len - 1] = '\0';
+
+	return line;
+}
+
+static gboolean
+load_line_is (const gchar *line,
+              const gchar *prefix)
+{
+	return g_ascii_strncasecmp (line, prefix, strlen (prefix)) == 0;
+}
+
+/* Adds the components read from the file to the calendar and notifies
+ * the views started meanwhile; objects with a UID in @skip_uids are
+ * replaced by the journal */
+static void
+load_chunk (ECalBackendDecsync *cbfile,
+            GSList *icomps,
+            GHashTable *skip_uids)
+{
+	ECalBackendDecsyncPrivate *priv;
+	ETimezoneCache *timezone_cache;
+	GSList *link, *added = NULL, *views;
+
+	priv = cbfile->priv;
+	timezone_cache = E_TIMEZONE_CACHE (cbfile);
+
+	data_write_lock (cbfile);
+
+	for (link = icomps; link; link = g_slist_next (link)) {
+		ICalComponent *icomp = link->data;
+		ICalComponentKind kind;
+
+		kind = i_cal_component_isa (icomp);
+
+		if (kind == I_CAL_VEVENT_COMPONENT ||
+		    kind == I_CAL_VTODO_COMPONENT ||
+		    kind == I_CAL_VJOURNAL_COMPONENT) {
+			ECalComponent *comp;
+			const gchar *uid;
+
+			uid = i_cal_component_get_uid (icomp);
+			if (skip_uids && uid && g_hash_table_contains (skip_uids, uid))
+				continue;
+
+			i_cal_component_add_component (priv->vcalendar, icomp);
+
+			comp = e_cal_component_new ();
+			if (e_cal_component_set_icalcomponent (comp, icomp)) {
+				/* Thus it's not freed while being used in the 'comp' */
+				g_object_ref (icomp);
+
+				check_dup_uid (cbfile, comp);
+
+				add_component (cbfile, comp, FALSE);
+				added = g_slist_prepend (added, g_object_ref (comp));
+			} else {
+				g_object_unref (comp);
+			}
+		} else if (kind == I_CAL_VTIMEZONE_COMPONENT) {
+			ICalProperty *prop;
+			ICalTimezone *zone = NULL;
+			const gchar *tzid;
+
+			prop = i_cal_component_get_first_property (icomp, I_CAL_TZID_PROPERTY);
+			tzid = prop ? i_cal_property_get_tzid (prop) : NULL;
+			if (tzid)
+				zone = i_cal_component_get_timezone (priv->vcalendar, tzid);
+			if (tzid && !zone)
+				i_cal_component_add_component (priv->vcalendar, icomp);
+
+			g_clear_object (&zone);
+			g_clear_object (&prop);
+		} else {
+			/* Keep what we do not know, so that we don't lose it */
+			i_cal_component_add_component (priv->vcalendar, icomp);
+		}
+	}
+
+	views = g_slist_copy_deep (priv->loading_views, (GCopyFunc) g_object_ref, NULL);
+
+	data_write_unlock (cbfile);
+
+	added = g_slist_reverse (added);
+
+	for (link = views; link && added; link = g_slist_next (link)) {
+		EDataCalView *view = link->data;
+		ECalBackendSExp *sexp;
+		GSList *clink, *matched = NULL;
+
+		sexp = e_data_cal_view_get_sexp (view);
+
+		for (clink = added; clink; clink = g_slist_next (clink)) {
+			if (e_cal_backend_sexp_match_comp (sexp, clink->data, timezone_cache))
+				matched = g_slist_prepend (matched, clink->data);
+		}
+
+		if (matched) {
+			matched = g_slist_reverse (matched);
+			e_data_cal_view_notify_components_added (view, matched);
+			g_slist_free (matched);
+		}
+	}
+
+	g_slist_free_full (views, g_object_unref);
+	g_slist_free_full (added, g_object_unref);
+}
+
+static void
+load_finish (ECalBackendDecsync *cbfile,
+             const GError *error)
+{
+	ECalBackendDecsyncPrivate *priv;
+	GSList *views, *link;
+	gboolean refresh_pending;
+
+	priv = cbfile->priv;
+
+	data_write_lock (cbfile);
+
+	g_mutex_lock (&priv->load_lock);
+	priv->loading = FALSE;
+	priv->load_failed = error != NULL;
+	g_cond_broadcast (&priv->load_cond);
+
+	/* Views which are still being populated are completed by
+	 * start_view_cb() instead */
+	views = NULL;
+	for (link = priv->loading_views; link; link = g_slist_next (link)) {
+		if (g_hash_table_contains (priv->populating_views, link->data))
+			g_object_unref (link->data);
+		else
+			views = g_slist_prepend (views, link->data);
+	}
+	g_slist_free (priv->loading_views);
+	priv->loading_views = NULL;
+
+	g_mutex_unlock (&priv->load_lock);
+
+	/* The objects the digests describe may not all be loaded */
+	if (error)
+		decsync_digests_clear (priv->digests);
+
+	refresh_pending = priv->refresh_pending;
+	priv->refresh_pending = FALSE;
+
+	if (priv->is_dirty)
+		save_request (cbfile);
+
+	data_write_unlock (cbfile);
+
+	if (error) {
+		gchar *msg = g_strdup_printf ("%s: %s", _("Cannot read calendar data"), error->message);
+
+		e_cal_backend_set_writable (E_CAL_BACKEND (cbfile), FALSE);
+		e_cal_backend_notify_error (E_CAL_BACKEND (cbfile), msg);
+		g_free (msg);
+	}
+
+	for (link = views; link; link = g_slist_next (link))
+		e_data_cal_view_notify_complete (link->data, NULL /* Success */);
+
+	g_slist_free_full (views, g_object_unref);
+
+	if (refresh_pending)
+		ecal_backend_decsync_refresh_cb (cbfile);
+}
+
+static gpointer
+load_thread (gpointer user_data)
+{
+	LoadData *ld = user_data;
+	ECalBackendDecsync *cbfile = ld->cbfile;
+	ECalBackendDecsyncPrivate *priv = cbfile->priv;
+	GString *text = NULL, *trailer;
+	GSList *chunk = NULL;
+	guint chunk_len = 0;
+	gint depth = 1;
+	gchar *line;
+	GError *error = NULL;
+
+	trailer = g_string_new (NULL);
+
+	line = ld->pending_line;
+	ld->pending_line = NULL;
+	if (!line)
+		line = load_read_line (ld->stream, &error);
+
+	while (line) {
+		if (depth == 0) {
+			/* Possibly another calendar, merge it into this one */
+			if (load_line_is (line, "BEGIN:VCALENDAR"))
+				depth = 1;
+		} else if (load_line_is (line, "BEGIN:")) {
+			if (depth == 1)
+				text = g_string_new (NULL);
+			depth++;
+			g_string_append (text, line);
+			g_string_append (text, "\r\n");
+		} else if (load_line_is (line, "END:")) {
+			depth--;
+			if (depth > 0) {
+				g_string_append (text, line);
+				g_string_append (text, "\r\n");
+			}
+
+			if (depth == 1) {
+				ICalComponent *icomp;
+
+				icomp = i_cal_component_new_from_string (text->str);
+				g_string_free (text, TRUE);
+				text = NULL;
+
+				if (icomp) {
+					chunk = g_slist_prepend (chunk, icomp);
+					chunk_len++;
+				}
+
+				if (chunk_len >= LOAD_CHUNK_SIZE) {
+					chunk = g_slist_reverse (chunk);
+					load_chunk (cbfile, chunk, ld->journal);
+					g_slist_free_full (chunk, g_object_unref);
+					chunk = NULL;
+					chunk_len = 0;
+				}
+			}
+		} else if (depth == 1) {
+			g_string_append (trailer, line);
+			g_string_append (trailer, "\r\n");
+		} else {
+			g_string_append (text, line);
+			g_string_append (text, "\r\n");
+		}
+
+		g_free (line);
+		line = load_read_line (ld->stream, &error);
+	}
+
+	if (text) {
+		if (!error)
+			error = e_client_error_create (E_CLIENT_ERROR_OTHER_ERROR, _("Unexpected end of file"));
+		g_string_free (text, TRUE);
+	}
+
+	chunk = g_slist_reverse (chunk);
+	load_chunk (cbfile, chunk, ld->journal);
+	g_slist_free_full (chunk, g_object_unref);
+
+	/* The objects changed since the last full save come last */
+	if (ld->journal) {
+		GHashTableIter iter;
+		gpointer value;
+
+		g_hash_table_iter_init (&iter, ld->journal);
+		while (g_hash_table_iter_next (&iter, NULL, &value)) {
+			if (!value)
+				continue;
+
+			data_write_lock (cbfile);
+			chunk = journal_object_take_components (priv->vcalendar, value);
+			data_write_unlock (cbfile);
+
+			load_chunk (cbfile, chunk, NULL);
+			g_slist_free_full (chunk, g_object_unref);
+		}
+	}
+
+	data_write_lock (cbfile);
+
+	if (trailer->len) {
+		ICalComponent *icalendar;
+		gchar *str;
+
+		str = g_strconcat ("BEGIN:VCALENDAR\r\n", trailer->str, "END:VCALENDAR\r\n", NULL);
+		icalendar = i_cal_parser_parse_string (str);
+		if (icalendar) {
+			ICalProperty *prop;
+
+			for (prop = i_cal_component_get_first_property (icalendar, I_CAL_ANY_PROPERTY);
+			     prop;
+			     g_object_unref (prop), prop = i_cal_component_get_next_property (icalendar, I_CAL_ANY_PROPERTY)) {
+				i_cal_component_take_property (priv->vcalendar, i_cal_property_clone (prop));
+			}
+
+			g_object_unref (icalendar);
+		}
+		g_free (str);
+	}
+
+	if (ld->revision)
+		e_cal_util_component_set_x_property (priv->vcalendar, ECAL_REVISION_X_PROP, ld->revision);
+
+	data_write_unlock (cbfile);
+
+	if (ld->revision)
+		e_cal_backend_notify_property_changed (E_CAL_BACKEND (cbfile), E_CAL_BACKEND_PROPERTY_REVISION, ld->revision);
+
+	e_debug_log (
+		FALSE, E_DEBUG_LOG_DOMAIN_CAL_QUERIES, "---;%p;LOAD;%s;%" G_GINT64_FORMAT "ms;%u", cbfile,
+		G_OBJECT_TYPE_NAME (cbfile), (g_get_monotonic_time () - ld->start_time) / 1000,
+		g_hash_table_size (priv->comp_uid_hash));
+
+	load_finish (cbfile, error);
+
+	g_clear_error (&error);
+	g_string_free (trailer, TRUE);
+	g_object_unref (ld->stream);
+	if (ld->journal)
+		g_hash_table_destroy (ld->journal);
+	g_free (ld->revision);
+	g_object_unref (ld->cbfile);
+	g_free (ld);
+
+	return NULL;
+}
+
+/* Reads the properties of the calendar file synchronously and its objects
+ * in a worker thread, so that the backend can be used right away. Views
+ * started meanwhile are fed from what has been read so far and completed
+ * as the remaining objects arrive. Falls back to open_cal() for anything
+ * but a plain VCALENDAR. */
+static void
+open_cal_streaming (ECalBackendDecsync *cbfile,
+                    const gchar *uristr,
+                    GError **perror)
+{
+	ECalBackendDecsyncPrivate *priv;
+	GFile *file;
+	GFileInputStream *file_stream;
+	GDataInputStream *stream;
+	ICalComponent *icomp;
+	LoadData *ld;
+	GString *props;
+	gchar *line, *str, *generation;
+	GError *local_error = NULL;
+
+	priv = cbfile->priv;
+
+	file = g_file_new_for_path (uristr);
+	file_stream = g_file_read (file, NULL, perror);
+	g_object_unref (file);
+
+	if (!file_stream)
+		return;
+
+	stream = g_data_input_stream_new (G_INPUT_STREAM (file_stream));
+	g_data_input_stream_set_newline_type (stream, G_DATA_STREAM_NEWLINE_TYPE_LF);
+	g_object_unref (file_stream);
+
+	line = load_read_line (stream, NULL);
+	while (line && !*line) {
+		g_free (line);
+		line = load_read_line (stream, NULL);
+	}
+
+	if (!line || !load_line_is (line, "BEGIN:VCALENDAR")) {
+		g_free (line);
+		g_object_unref (stream);
+		open_cal (cbfile, uristr, perror);
+		return;
+	}
+
+	g_free (line);
+
+	props = g_string_new (NULL);
+	while ((line = load_read_line (stream, &local_error)) != NULL &&
+	       !load_line_is (line, "BEGIN:") &&
+	       !load_line_is (line, "END:VCALENDAR")) {
+		g_string_append (props, line);
+		g_string_append (props, "\r\n");
+		g_free (line);
+	}
+
+	if (local_error) {
+		g_propagate_error (perror, local_error);
+		g_string_free (props, TRUE);
+		g_object_unref (stream);
+		return;
+	}
+
+	str = g_strconcat ("BEGIN:VCALENDAR\r\n", props->str, "END:VCALENDAR\r\n", NULL);
+	icomp = i_cal_parser_parse_string (str);
+	if (!icomp || i_cal_component_isa (icomp) != I_CAL_VCALENDAR_COMPONENT) {
+		g_clear_object (&icomp);
+		icomp = e_cal_util_new_top_level ();
+	}
+	g_string_free (props, TRUE);
+	g_free (str);
+
+	ld = g_new0 (LoadData, 1);
+	ld->cbfile = g_object_ref (cbfile);
+	ld->stream = stream;
+	ld->pending_line = line;
+	ld->start_time = g_get_monotonic_time ();
+
+	data_write_lock (cbfile);
+
+	generation = e_cal_util_component_dup_x_property (icomp, JOURNAL_X_PROP);
+	ld->journal = journal_read (cbfile, uristr, generation, &ld->revision);
+	g_free (generation);
+
+	load_vcalendar (cbfile, icomp);
+
+	g_mutex_lock (&priv->load_lock);
+	priv->loading = TRUE;
+	g_mutex_unlock (&priv->load_lock);
+
+	data_write_unlock (cbfile);
 
-	save (cbfile, TRUE);
+	g_thread_unref (g_thread_new ("decsync-load", load_thread, ld));
 }
 
 static gchar *
@@ -1066,7 +3090,7 @@ e_cal_backend_decsync_open (ECalBackendSync *backend,
 
 	cbfile = E_CAL_BACKEND_DECSYNC (backend);
 	priv = cbfile->priv;
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	data_write_lock (cbfile);
 
 	/* Decsync source is always connected. */
 	e_source_set_connection_status (e_backend_get_source (E_BACKEND (backend)),
@@ -1086,7 +3110,7 @@ e_cal_backend_decsync_open (ECalBackendSync *backend,
 
 	writable = TRUE;
 	if (g_access (str_uri, R_OK) == 0) {
-		open_cal (cbfile, str_uri, &err);
+		open_cal_streaming (cbfile, str_uri, &err);
 		if (g_access (str_uri, W_OK) != 0)
 			writable = FALSE;
 	} else {
@@ -1098,7 +3122,7 @@ e_cal_backend_decsync_open (ECalBackendSync *backend,
 	g_idle_add ((GSourceFunc) ecal_backend_decsync_refresh_start, cbfile);
 
   done:
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (cbfile);
 	e_cal_backend_set_writable (E_CAL_BACKEND (backend), writable);
 	e_backend_set_online (E_BACKEND (backend), TRUE);
 
@@ -1107,16 +3131,51 @@ e_cal_backend_decsync_open (ECalBackendSync *backend,
 }
 
 static void
-add_detached_recur_to_vcalendar (gpointer key,
-                                 gpointer value,
-                                 gpointer user_data)
+add_component_clone_to_vcalendar (ECalBackendDecsync *cbfile,
+                                  ECalComponent *comp,
+                                  ICalComponent *vcalendar)
 {
-	ECalComponent *recurrence = value;
-	ICalComponent *vcalendar = user_data;
+	GMutex *comp_lock;
 
+	comp_lock = comp_lock_for (cbfile, comp);
+
+	g_mutex_lock (comp_lock);
 	i_cal_component_take_component (
 		vcalendar,
-		i_cal_component_clone (e_cal_component_get_icalcomponent (recurrence)));
+		i_cal_component_clone (e_cal_component_get_icalcomponent (comp)));
+	g_mutex_unlock (comp_lock);
+}
+
+/* Returns a newly allocated iCalendar string of @comp, which belongs to
+ * @obj_data, serializing it only when it changed since the last time.
+ * Called with the data lock and the lock of the component held. */
+static gchar *
+object_data_dup_comp_string (ECalBackendDecsync *cbfile,
+                             ECalBackendDecsyncObject *obj_data,
+                             ECalComponent *comp)
+{
+	ECalBackendDecsyncPrivate *priv = cbfile->priv;
+	gchar *str = NULL;
+
+	g_mutex_lock (&priv->strings_lock);
+	if (obj_data->comp_strings)
+		str = g_strdup (g_hash_table_lookup (obj_data->comp_strings, comp));
+	g_mutex_unlock (&priv->strings_lock);
+
+	if (str)
+		return str;
+
+	str = e_cal_component_get_as_string (comp);
+	if (!str)
+		return NULL;
+
+	g_mutex_lock (&priv->strings_lock);
+	if (!obj_data->comp_strings)
+		obj_data->comp_strings = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	g_hash_table_insert (obj_data->comp_strings, comp, g_strdup (str));
+	g_mutex_unlock (&priv->strings_lock);
+
+	return str;
 }
 
 static void
@@ -1131,6 +3190,8 @@ e_cal_backend_decsync_get_ical (ECalBackendSync *backend,
 	ECalBackendDecsync *cbfile;
 	ECalBackendDecsyncPrivate *priv;
 	ECalBackendDecsyncObject *obj_data;
+	GMutex *comp_lock;
+	gboolean locked;
 
 	cbfile = E_CAL_BACKEND_DECSYNC (backend);
 	priv = cbfile->priv;
@@ -1147,11 +3208,11 @@ e_cal_backend_decsync_get_ical (ECalBackendSync *backend,
 	g_return_if_fail (uid != NULL);
 	g_return_if_fail (priv->comp_uid_hash != NULL);
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	locked = data_read_lock (cbfile);
 
 	obj_data = g_hash_table_lookup (priv->comp_uid_hash, uid);
 	if (!obj_data) {
-		g_rec_mutex_unlock (&priv->idle_save_rmutex);
+		data_read_unlock (cbfile, locked);
 		g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 		return;
 	}
@@ -1161,25 +3222,33 @@ e_cal_backend_decsync_get_ical (ECalBackendSync *backend,
 
 		comp = g_hash_table_lookup (obj_data->recurrences, rid);
 		if (!always_ical && comp) {
-			*object = e_cal_component_get_as_string (comp);
+			comp_lock = comp_lock_for (cbfile, comp);
+
+			g_mutex_lock (comp_lock);
+			*object = object_data_dup_comp_string (cbfile, obj_data, comp);
+			g_mutex_unlock (comp_lock);
 		} else {
 			ICalComponent *icomp;
 			ICalTime *itt;
 
 			if (!obj_data->full_object) {
-				g_rec_mutex_unlock (&priv->idle_save_rmutex);
+				data_read_unlock (cbfile, locked);
 				g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 				return;
 			}
 
+			comp_lock = comp_lock_for (cbfile, obj_data->full_object);
+
 			itt = i_cal_time_new_from_string (rid);
+			g_mutex_lock (comp_lock);
 			icomp = e_cal_util_construct_instance (
 				e_cal_component_get_icalcomponent (obj_data->full_object),
 				itt);
+			g_mutex_unlock (comp_lock);
 			g_object_unref (itt);
 
 			if (!icomp) {
-				g_rec_mutex_unlock (&priv->idle_save_rmutex);
+				data_read_unlock (cbfile, locked);
 				g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 				return;
 			}
@@ -1190,28 +3259,46 @@ e_cal_backend_decsync_get_ical (ECalBackendSync *backend,
 		}
 	} else {
 		if (always_ical || g_hash_table_size (obj_data->recurrences) > 0) {
-			ICalComponent *icomp;
+			g_mutex_lock (&priv->strings_lock);
+			*object = g_strdup (obj_data->ical_string);
+			g_mutex_unlock (&priv->strings_lock);
 
-			/* if we have detached recurrences, return a VCALENDAR */
-			icomp = e_cal_util_new_top_level ();
+			if (!*object) {
+				ICalComponent *icomp;
+				GHashTableIter iter;
+				gpointer value;
 
-			/* detached recurrences don't have full_object */
-			if (obj_data->full_object)
-				i_cal_component_add_component (
-					icomp,
-					i_cal_component_clone (e_cal_component_get_icalcomponent (obj_data->full_object)));
+				/* if we have detached recurrences, return a VCALENDAR */
+				icomp = e_cal_util_new_top_level ();
 
-			/* add all detached recurrences */
-			g_hash_table_foreach (obj_data->recurrences, (GHFunc) add_detached_recur_to_vcalendar, icomp);
+				/* detached recurrences don't have full_object */
+				if (obj_data->full_object)
+					add_component_clone_to_vcalendar (cbfile, obj_data->full_object, icomp);
 
-			*object = i_cal_component_as_ical_string (icomp);
+				/* add all detached recurrences */
+				g_hash_table_iter_init (&iter, obj_data->recurrences);
+				while (g_hash_table_iter_next (&iter, NULL, &value))
+					add_component_clone_to_vcalendar (cbfile, value, icomp);
 
-			g_object_unref (icomp);
-		} else if (obj_data->full_object)
-			*object = e_cal_component_get_as_string (obj_data->full_object);
+				*object = i_cal_component_as_ical_string (icomp);
+
+				g_object_unref (icomp);
+
+				g_mutex_lock (&priv->strings_lock);
+				if (!obj_data->ical_string)
+					obj_data->ical_string = g_strdup (*object);
+				g_mutex_unlock (&priv->strings_lock);
+			}
+		} else if (obj_data->full_object) {
+			comp_lock = comp_lock_for (cbfile, obj_data->full_object);
+
+			g_mutex_lock (comp_lock);
+			*object = object_data_dup_comp_string (cbfile, obj_data, obj_data->full_object);
+			g_mutex_unlock (comp_lock);
+		}
 	}
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_read_unlock (cbfile, locked);
 }
 /* Get_object_component handler for the decsync backend */
 static void
@@ -1223,6 +3310,8 @@ e_cal_backend_decsync_get_object (ECalBackendSync *backend,
                                gchar **object,
                                GError **error)
 {
+	wait_for_load (E_CAL_BACKEND_DECSYNC (backend));
+
 	e_cal_backend_decsync_get_ical (backend, cancellable, uid, rid, FALSE, object, error);
 }
 
@@ -1265,8 +3354,247 @@ typedef struct {
 	ECalBackend *backend;
 	EDataCalView *view;
 	gboolean as_string;
+
+	/* Set when every match must occur in the window, see
+	 * match_data_set_occurrence_window() */
+	gboolean prune_by_occurrences;
+	time_t occur_start;
+	time_t occur_end;
 } MatchObjectData;
 
+#define OCCUR_IN_TIME_RANGE "occur-in-time-range?"
+
+/* The functions of a calendar expression which give nothing away about
+ * the matches on their own, including the builtins which would otherwise
+ * pass the marker of occur-in-time-range? on or fail on it */
+static const gchar *query_classify_neutral_functions[] = {
+	"or",
+	"not",
+	"if",
+	"begin",
+	"<",
+	">",
+	"=",
+	"+",
+	"-",
+	"cast-int",
+	"cast-string",
+	"make-time",
+	"time-add-day",
+	"time-day-begin",
+	"time-day-end",
+	"uid?",
+	"due-in-time-range?",
+	"contains?",
+	"has-start?",
+	"has-alarms?",
+	"has-recurrences?",
+	"has-attachments?",
+	"is-completed?",
+	"completed-before?",
+	"has-categories?",
+	"percent-complete?",
+	"occurrences-count?"
+};
+
+/* The functions whose result depends on the current time */
+static const gchar *query_classify_time_functions[] = {
+	"time-now",
+	"has-alarms-in-range?"
+};
+
+typedef struct _QueryClassifyData {
+	guint n_ranges;
+	gboolean depends_on_time;
+} QueryClassifyData;
+
+static gboolean
+query_classify_eval_terms (ESExp *esexp,
+                           gint argc,
+                           ESExpTerm **argv)
+{
+	ESExpResult *result;
+	gboolean has_marker = FALSE;
+	gint ii;
+
+	for (ii = 0; ii < argc; ii++) {
+		result = e_sexp_term_eval (esexp, argv[ii]);
+		if (result->type == ESEXP_RES_STRING && g_strcmp0 (result->value.string, OCCUR_IN_TIME_RANGE) == 0)
+			has_marker = TRUE;
+		e_sexp_result_free (esexp, result);
+	}
+
+	return has_marker;
+}
+
+static ESExpResult *
+query_classify_result (ESExp *esexp,
+                       gboolean marker)
+{
+	ESExpResult *result;
+
+	if (marker) {
+		result = e_sexp_result_new (esexp, ESEXP_RES_STRING);
+		result->value.string = g_strdup (OCCUR_IN_TIME_RANGE);
+	} else {
+		result = e_sexp_result_new (esexp, ESEXP_RES_BOOL);
+		result->value.boolean = FALSE;
+	}
+
+	return result;
+}
+
+static ESExpResult *
+query_classify_occur_cb (ESExp *esexp,
+                         gint argc,
+                         ESExpTerm **argv,
+                         gpointer user_data)
+{
+	QueryClassifyData *data = user_data;
+
+	data->n_ranges++;
+	query_classify_eval_terms (esexp, argc, argv);
+
+	return query_classify_result (esexp, TRUE);
+}
+
+/* A conjunction requires what any of its terms requires */
+static ESExpResult *
+query_classify_and_cb (ESExp *esexp,
+                       gint argc,
+                       ESExpTerm **argv,
+                       gpointer user_data)
+{
+	return query_classify_result (esexp, query_classify_eval_terms (esexp, argc, argv));
+}
+
+static ESExpResult *
+query_classify_time_cb (ESExp *esexp,
+                        gint argc,
+                        ESExpTerm **argv,
+                        gpointer user_data)
+{
+	QueryClassifyData *data = user_data;
+
+	data->depends_on_time = TRUE;
+	query_classify_eval_terms (esexp, argc, argv);
+
+	return query_classify_result (esexp, FALSE);
+}
+
+static ESExpResult *
+query_classify_neutral_cb (ESExp *esexp,
+                           gint argc,
+                           ESExpTerm **argv,
+                           gpointer user_data)
+{
+	query_classify_eval_terms (esexp, argc, argv);
+
+	return query_classify_result (esexp, FALSE);
+}
+
+/* Classifies @query without evaluating it against any component.
+ *
+ * @requires_occurrence is set when every match of @query has to occur in
+ * its time range. This holds for occur-in-time-range? itself and for
+ * conjunctions with it as one of their terms, when it is used only once.
+ *
+ * @depends_on_time is set when the result of @query depends on the current
+ * time, rather than only on the data.
+ *
+ * Queries which fail to parse, for example because of an unknown function,
+ * are taken to not require an occurrence and to depend on the time. */
+static void
+query_classify (const gchar *query,
+                gboolean *requires_occurrence,
+                gboolean *depends_on_time)
+{
+	ESExp *esexp;
+	ESExpResult *result = NULL;
+	QueryClassifyData data = { 0, FALSE };
+	guint ii;
+
+	esexp = e_sexp_new ();
+	e_sexp_add_ifunction (esexp, 0, "and", query_classify_and_cb, &data);
+	e_sexp_add_ifunction (esexp, 0, OCCUR_IN_TIME_RANGE, query_classify_occur_cb, &data);
+	for (ii = 0; ii < G_N_ELEMENTS (query_classify_neutral_functions); ii++)
+		e_sexp_add_ifunction (esexp, 0, query_classify_neutral_functions[ii], query_classify_neutral_cb, &data);
+	for (ii = 0; ii < G_N_ELEMENTS (query_classify_time_functions); ii++)
+		e_sexp_add_ifunction (esexp, 0, query_classify_time_functions[ii], query_classify_time_cb, &data);
+	e_sexp_input_text (esexp, query, strlen (query));
+
+	if (e_sexp_parse (esexp) != -1)
+		result = e_sexp_eval (esexp);
+
+	if (requires_occurrence)
+		*requires_occurrence = result && data.n_ranges == 1 &&
+			result->type == ESEXP_RES_STRING &&
+			g_strcmp0 (result->value.string, OCCUR_IN_TIME_RANGE) == 0;
+	if (depends_on_time)
+		*depends_on_time = !result || data.depends_on_time;
+
+	if (result)
+		e_sexp_result_free (esexp, result);
+
+	g_object_unref (esexp);
+}
+
+/* Recurring events without an occurrence in the window of the query are
+ * skipped without evaluating it, using the generated occurrences. This is
+ * only done for queries where a match is required to occur in the window,
+ * and with a day of margin on both sides, because the expression resolves
+ * floating times in the default timezone, not in UTC. */
+static void
+match_data_set_occurrence_window (MatchObjectData *match_data,
+                                  time_t occur_start,
+                                  time_t occur_end)
+{
+	gboolean requires_occurrence = FALSE;
+
+	if (match_data->query)
+		query_classify (match_data->query, &requires_occurrence, NULL);
+	if (!requires_occurrence)
+		return;
+
+	match_data->prune_by_occurrences = TRUE;
+	match_data->occur_start = occur_start - 24 * 60 * 60;
+	match_data->occur_end = occur_end + 24 * 60 * 60;
+}
+
+/* Called with the data lock held, but not the lock of the component */
+static gboolean
+match_data_skips_component (MatchObjectData *match_data,
+                            ECalComponent *comp)
+{
+	ECalBackendDecsync *cbfile = E_CAL_BACKEND_DECSYNC (match_data->backend);
+	GArray *occurrences;
+	gboolean skip = TRUE;
+	guint ii;
+
+	if (!match_data->prune_by_occurrences)
+		return FALSE;
+
+	occurrences = comp_occurrences_get (cbfile, comp, match_data->occur_start, match_data->occur_end);
+	if (!occurrences)
+		return FALSE;
+
+	for (ii = 0; ii < occurrences->len && skip; ii++) {
+		const ObjectOccurrence *occurrence = &g_array_index (occurrences, ObjectOccurrence, ii);
+
+		if (occurrence->start >= match_data->occur_end)
+			break;
+
+		if (object_occurrence_overlaps (occurrence, match_data->occur_start, match_data->occur_end))
+			skip = FALSE;
+	}
+
+	g_array_unref (occurrences);
+
+	return skip;
+}
+
+/* Views get a copy of the components, as they are notified once the
+ * data is unlocked */
 static void
 match_object_sexp_to_component (gpointer value,
                                 gpointer data)
@@ -1274,19 +3602,36 @@ match_object_sexp_to_component (gpointer value,
 	ECalComponent *comp = value;
 	MatchObjectData *match_data = data;
 	ETimezoneCache *timezone_cache;
+	GMutex *comp_lock;
 
 	g_return_if_fail (comp != NULL);
 	g_return_if_fail (match_data->backend != NULL);
 
+	if (match_data->search_needed && match_data_skips_component (match_data, comp))
+		return;
+
 	timezone_cache = E_TIMEZONE_CACHE (match_data->backend);
+	comp_lock = comp_lock_for (E_CAL_BACKEND_DECSYNC (match_data->backend), comp);
+
+	g_mutex_lock (comp_lock);
 
 	if ((!match_data->search_needed) ||
 	    (e_cal_backend_sexp_match_comp (match_data->obj_sexp, comp, timezone_cache))) {
-		if (match_data->as_string)
-			match_data->comps_list = g_slist_prepend (match_data->comps_list, e_cal_component_get_as_string (comp));
-		else
-			match_data->comps_list = g_slist_prepend (match_data->comps_list, comp);
+		if (match_data->as_string) {
+			ECalBackendDecsync *cbfile = E_CAL_BACKEND_DECSYNC (match_data->backend);
+			ECalBackendDecsyncObject *obj_data;
+			const gchar *uid;
+
+			uid = e_cal_component_get_uid (comp);
+			obj_data = uid ? g_hash_table_lookup (cbfile->priv->comp_uid_hash, uid) : NULL;
+
+			match_data->comps_list = g_slist_prepend (match_data->comps_list,
+				obj_data ? object_data_dup_comp_string (cbfile, obj_data, comp) : e_cal_component_get_as_string (comp));
+		} else
+			match_data->comps_list = g_slist_prepend (match_data->comps_list, e_cal_component_clone (comp));
 	}
+
+	g_mutex_unlock (comp_lock);
 }
 
 static void
@@ -1294,19 +3639,7 @@ match_recurrence_sexp (gpointer key,
                        gpointer value,
                        gpointer data)
 {
-	ECalComponent *comp = value;
-	MatchObjectData *match_data = data;
-	ETimezoneCache *timezone_cache;
-
-	timezone_cache = E_TIMEZONE_CACHE (match_data->backend);
-
-	if ((!match_data->search_needed) ||
-	    (e_cal_backend_sexp_match_comp (match_data->obj_sexp, comp, timezone_cache))) {
-		if (match_data->as_string)
-			match_data->comps_list = g_slist_prepend (match_data->comps_list, e_cal_component_get_as_string (comp));
-		else
-			match_data->comps_list = g_slist_prepend (match_data->comps_list, comp);
-	}
+	match_object_sexp_to_component (value, data);
 }
 
 static void
@@ -1315,27 +3648,141 @@ match_object_sexp (gpointer key,
                    gpointer data)
 {
 	ECalBackendDecsyncObject *obj_data = value;
-	MatchObjectData *match_data = data;
-	ETimezoneCache *timezone_cache;
-
-	timezone_cache = E_TIMEZONE_CACHE (match_data->backend);
 
-	if (obj_data->full_object) {
-		if ((!match_data->search_needed) ||
-		    (e_cal_backend_sexp_match_comp (match_data->obj_sexp,
-						    obj_data->full_object,
-						    timezone_cache))) {
-			if (match_data->as_string)
-				match_data->comps_list = g_slist_prepend (match_data->comps_list, e_cal_component_get_as_string (obj_data->full_object));
-			else
-				match_data->comps_list = g_slist_prepend (match_data->comps_list, obj_data->full_object);
-		}
-	}
+	if (obj_data->full_object)
+		match_object_sexp_to_component (obj_data->full_object, data);
 
 	/* match also recurrences */
 	g_hash_table_foreach (obj_data->recurrences,
 			      (GHFunc) match_recurrence_sexp,
-			      match_data);
+			      data);
+}
+
+/* Called with query_cache_lock held */
+static void
+query_cache_remove_link (ECalBackendDecsync *cbfile,
+                         GList *link)
+{
+	ECalBackendDecsyncPrivate *priv = cbfile->priv;
+	QueryCacheEntry *entry = link->data;
+
+	g_hash_table_remove (priv->query_cache_index, entry->sexp);
+	g_queue_delete_link (&priv->query_cache, link);
+	priv->query_cache_bytes -= entry->bytes;
+	query_cache_entry_free (entry);
+}
+
+/* Called with query_cache_lock held; drops the results once the data
+ * changed since they were computed */
+static void
+query_cache_check_generation (ECalBackendDecsync *cbfile)
+{
+	ECalBackendDecsyncPrivate *priv = cbfile->priv;
+
+	if (priv->query_cache_generation == priv->data_generation)
+		return;
+
+	while (priv->query_cache.head)
+		query_cache_remove_link (cbfile, priv->query_cache.head);
+
+	priv->query_cache_generation = priv->data_generation;
+}
+
+/* Clients often repeat the same query, so the serialized result of the
+ * last ones is kept until the data changes or the result gets too old. Sets a copy of the result
+ * of @sexp to @out_objects, if known. Called with the data lock held. */
+static gboolean
+query_cache_lookup (ECalBackendDecsync *cbfile,
+                    const gchar *sexp,
+                    GSList **out_objects)
+{
+	ECalBackendDecsyncPrivate *priv = cbfile->priv;
+	GList *link;
+	gboolean found = FALSE;
+
+	g_mutex_lock (&priv->query_cache_lock);
+
+	query_cache_check_generation (cbfile);
+
+	link = g_hash_table_lookup (priv->query_cache_index, sexp);
+	if (link && ((QueryCacheEntry *) link->data)->expires <= g_get_monotonic_time ()) {
+		query_cache_remove_link (cbfile, link);
+		link = NULL;
+	}
+
+	if (link) {
+		QueryCacheEntry *entry = link->data;
+
+		g_queue_unlink (&priv->query_cache, link);
+		g_queue_push_head_link (&priv->query_cache, link);
+
+		*out_objects = g_slist_copy_deep (entry->objects, (GCopyFunc) g_strdup, NULL);
+		priv->query_cache_hits++;
+		found = TRUE;
+	} else {
+		priv->query_cache_misses++;
+	}
+
+	e_debug_log (
+		FALSE, E_DEBUG_LOG_DOMAIN_CAL_QUERIES, "---;%p;QUERY-CACHE;%s;%s;%u;%u;%" G_GSIZE_FORMAT, cbfile,
+		found ? "HIT" : "MISS", sexp, priv->query_cache_hits, priv->query_cache_misses,
+		priv->query_cache_bytes);
+
+	g_mutex_unlock (&priv->query_cache_lock);
+
+	return found;
+}
+
+/* Keeps a copy of the result of @sexp, evicting the least recently used
+ * results beyond QUERY_CACHE_MAX_BYTES. Called with the data lock held,
+ * which was not released since the result was computed. */
+static void
+query_cache_store (ECalBackendDecsync *cbfile,
+                   const gchar *sexp,
+                   const GSList *objects)
+{
+	ECalBackendDecsyncPrivate *priv = cbfile->priv;
+	QueryCacheEntry *entry;
+	const GSList *link;
+	GList *existing;
+	gsize bytes;
+	gboolean depends_on_time;
+
+	/* Such results are not kept; a false positive only costs a cache miss */
+	query_classify (sexp, NULL, &depends_on_time);
+	if (depends_on_time)
+		return;
+
+	bytes = sizeof (QueryCacheEntry) + strlen (sexp) + 1;
+	for (link = objects; link; link = g_slist_next (link))
+		bytes += sizeof (GSList) + strlen (link->data) + 1;
+
+	if (bytes > QUERY_CACHE_MAX_BYTES / 4)
+		return;
+
+	entry = g_new0 (QueryCacheEntry, 1);
+	entry->sexp = g_strdup (sexp);
+	entry->objects = g_slist_copy_deep ((GSList *) objects, (GCopyFunc) g_strdup, NULL);
+	entry->bytes = bytes;
+	entry->expires = g_get_monotonic_time () + QUERY_CACHE_MAX_AGE_USECS;
+
+	g_mutex_lock (&priv->query_cache_lock);
+
+	query_cache_check_generation (cbfile);
+
+	/* Computed by another thread meanwhile */
+	existing = g_hash_table_lookup (priv->query_cache_index, sexp);
+	if (existing)
+		query_cache_remove_link (cbfile, existing);
+
+	g_queue_push_head (&priv->query_cache, entry);
+	g_hash_table_insert (priv->query_cache_index, entry->sexp, priv->query_cache.head);
+	priv->query_cache_bytes += entry->bytes;
+
+	while (priv->query_cache_bytes > QUERY_CACHE_MAX_BYTES)
+		query_cache_remove_link (cbfile, priv->query_cache.tail);
+
+	g_mutex_unlock (&priv->query_cache_lock);
 }
 
 /* Get_objects_in_range handler for the decsync backend */
@@ -1351,13 +3798,26 @@ e_cal_backend_decsync_get_object_list (ECalBackendSync *backend,
 	ECalBackendDecsyncPrivate *priv;
 	MatchObjectData match_data = { 0, };
 	time_t occur_start = -1, occur_end = -1;
-	gboolean prunning_by_time;
+	gboolean prunning_by_time, locked;
 	GList * objs_occuring_in_tw;
 	cbfile = E_CAL_BACKEND_DECSYNC (backend);
 	priv = cbfile->priv;
 
+	wait_for_load (cbfile);
+
 	d (g_message (G_STRLOC ": Getting object list (%s)", sexp));
 
+	if (sexp) {
+		gboolean found;
+
+		locked = data_read_lock (cbfile);
+		found = query_cache_lookup (cbfile, sexp, objects);
+		data_read_unlock (cbfile, locked);
+
+		if (found)
+			return;
+	}
+
 	match_data.search_needed = TRUE;
 	match_data.query = sexp;
 	match_data.comps_list = NULL;
@@ -1373,7 +3833,7 @@ e_cal_backend_decsync_get_object_list (ECalBackendSync *backend,
 		return;
 	}
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	locked = data_read_lock (cbfile);
 
 	prunning_by_time = e_cal_backend_sexp_evaluate_occur_times (
 		match_data.obj_sexp,
@@ -1390,14 +3850,19 @@ e_cal_backend_decsync_get_object_list (ECalBackendSync *backend,
 			priv->interval_tree,
 			occur_start, occur_end);
 
+		match_data_set_occurrence_window (&match_data, occur_start, occur_end);
+
 		g_list_foreach (objs_occuring_in_tw, (GFunc) match_object_sexp_to_component,
 			       &match_data);
 	}
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
-
 	*objects = g_slist_reverse (match_data.comps_list);
 
+	if (sexp)
+		query_cache_store (cbfile, sexp, *objects);
+
+	data_read_unlock (cbfile, locked);
+
 	if (objs_occuring_in_tw) {
 		g_list_foreach (objs_occuring_in_tw, (GFunc) g_object_unref, NULL);
 		g_list_free (objs_occuring_in_tw);
@@ -1440,14 +3905,17 @@ add_attach_uris (GSList **attachment_uris,
 }
 
 static void
-add_detached_recur_attach_uris (gpointer key,
-                                gpointer value,
-                                gpointer user_data)
+add_comp_attach_uris (ECalBackendDecsync *cbfile,
+                      GSList **attachment_uris,
+                      ECalComponent *comp)
 {
-	ECalComponent *recurrence = value;
-	GSList **attachment_uris = user_data;
+	GMutex *comp_lock;
 
-	add_attach_uris (attachment_uris, e_cal_component_get_icalcomponent (recurrence));
+	comp_lock = comp_lock_for (cbfile, comp);
+
+	g_mutex_lock (comp_lock);
+	add_attach_uris (attachment_uris, e_cal_component_get_icalcomponent (comp));
+	g_mutex_unlock (comp_lock);
 }
 
 /* Gets the list of attachments */
@@ -1463,17 +3931,20 @@ e_cal_backend_decsync_get_attachment_uris (ECalBackendSync *backend,
 	ECalBackendDecsync *cbfile;
 	ECalBackendDecsyncPrivate *priv;
 	ECalBackendDecsyncObject *obj_data;
+	gboolean locked;
 
 	cbfile = E_CAL_BACKEND_DECSYNC (backend);
 	priv = cbfile->priv;
 
+	wait_for_load (cbfile);
+
 	g_return_if_fail (priv->comp_uid_hash != NULL);
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	locked = data_read_lock (cbfile);
 
 	obj_data = g_hash_table_lookup (priv->comp_uid_hash, uid);
 	if (!obj_data) {
-		g_rec_mutex_unlock (&priv->idle_save_rmutex);
+		data_read_unlock (cbfile, locked);
 		g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 		return;
 	}
@@ -1483,24 +3954,29 @@ e_cal_backend_decsync_get_attachment_uris (ECalBackendSync *backend,
 
 		comp = g_hash_table_lookup (obj_data->recurrences, rid);
 		if (comp) {
-			add_attach_uris (attachment_uris, e_cal_component_get_icalcomponent (comp));
+			add_comp_attach_uris (cbfile, attachment_uris, comp);
 		} else {
 			ICalComponent *icomp;
 			ICalTime *itt;
+			GMutex *comp_lock;
 
 			if (!obj_data->full_object) {
-				g_rec_mutex_unlock (&priv->idle_save_rmutex);
+				data_read_unlock (cbfile, locked);
 				g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 				return;
 			}
 
+			comp_lock = comp_lock_for (cbfile, obj_data->full_object);
+
 			itt = i_cal_time_new_from_string (rid);
+			g_mutex_lock (comp_lock);
 			icomp = e_cal_util_construct_instance (
 				e_cal_component_get_icalcomponent (obj_data->full_object),
 				itt);
+			g_mutex_unlock (comp_lock);
 			g_object_unref (itt);
 			if (!icomp) {
-				g_rec_mutex_unlock (&priv->idle_save_rmutex);
+				data_read_unlock (cbfile, locked);
 				g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 				return;
 			}
@@ -1511,108 +3987,237 @@ e_cal_backend_decsync_get_attachment_uris (ECalBackendSync *backend,
 		}
 	} else {
 		if (g_hash_table_size (obj_data->recurrences) > 0) {
+			GHashTableIter iter;
+			gpointer value;
+
 			/* detached recurrences don't have full_object */
 			if (obj_data->full_object)
-				add_attach_uris (attachment_uris, e_cal_component_get_icalcomponent (obj_data->full_object));
+				add_comp_attach_uris (cbfile, attachment_uris, obj_data->full_object);
 
 			/* add all detached recurrences */
-			g_hash_table_foreach (obj_data->recurrences, add_detached_recur_attach_uris, attachment_uris);
+			g_hash_table_iter_init (&iter, obj_data->recurrences);
+			while (g_hash_table_iter_next (&iter, NULL, &value))
+				add_comp_attach_uris (cbfile, attachment_uris, value);
 		} else if (obj_data->full_object)
-			add_attach_uris (attachment_uris, e_cal_component_get_icalcomponent (obj_data->full_object));
+			add_comp_attach_uris (cbfile, attachment_uris, obj_data->full_object);
 	}
 
 	*attachment_uris = g_slist_reverse (*attachment_uris);
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_read_unlock (cbfile, locked);
 }
 
-/* get_query handler for the decsync backend */
+typedef struct {
+	ECalBackendDecsync *cbfile;
+	EDataCalView *view;
+} StartViewData;
+
+/* Populates a view in batches: the matching uids are collected first, then
+ * at most VIEW_BATCH_SIZE of them are matched at a time, without holding
+ * the lock for longer than VIEW_SLICE_USECS, and the matches are notified
+ * before the next batch. Changes made meanwhile reach the view through the
+ * usual notifications, and uids removed meanwhile are skipped. */
 static void
-e_cal_backend_decsync_start_view (ECalBackend *backend,
-                               EDataCalView *query)
+start_view_cb (gpointer data,
+               gpointer user_data)
 {
-	ECalBackendDecsync *cbfile;
-	ECalBackendDecsyncPrivate *priv;
+	StartViewData *svd = data;
+	ECalBackendDecsync *cbfile = svd->cbfile;
+	ECalBackendDecsyncPrivate *priv = cbfile->priv;
+	EDataCalView *query = svd->view;
 	ECalBackendSExp *sexp;
 	MatchObjectData match_data = { 0, };
 	time_t occur_start = -1, occur_end = -1;
-	gboolean prunning_by_time;
-	GList * objs_occuring_in_tw;
-	cbfile = E_CAL_BACKEND_DECSYNC (backend);
-	priv = cbfile->priv;
+	gboolean prunning_by_time, still_loading = FALSE, complete, locked;
+	GPtrArray *uids;
+	guint done = 0;
 
 	sexp = e_data_cal_view_get_sexp (query);
 
-	d (g_message (G_STRLOC ": Starting query (%s)", e_cal_backend_sexp_text (sexp)));
-
 	/* try to match all currently existing objects */
 	match_data.search_needed = TRUE;
 	match_data.query = e_cal_backend_sexp_text (sexp);
 	match_data.comps_list = NULL;
 	match_data.as_string = FALSE;
-	match_data.backend = backend;
-	match_data.obj_sexp = e_data_cal_view_get_sexp (query);
+	match_data.backend = E_CAL_BACKEND (cbfile);
+	match_data.obj_sexp = sexp;
 	match_data.view = query;
 
 	if (match_data.query && !strcmp (match_data.query, "#t"))
 		match_data.search_needed = FALSE;
 
-	if (!match_data.obj_sexp) {
-		GError *error = EC_ERROR (E_CLIENT_ERROR_INVALID_QUERY);
-		e_data_cal_view_notify_complete (query, error);
-		g_error_free (error);
-		return;
-	}
 	prunning_by_time = e_cal_backend_sexp_evaluate_occur_times (
 		match_data.obj_sexp,
 		&occur_start,
 		&occur_end);
 
-	objs_occuring_in_tw = NULL;
+	uids = g_ptr_array_new_with_free_func (g_free);
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	locked = data_read_lock (cbfile);
 
 	if (!prunning_by_time) {
+		GHashTableIter iter;
+		gpointer key;
+
 		/* full scan */
-		g_hash_table_foreach (priv->comp_uid_hash, (GHFunc) match_object_sexp,
-				      &match_data);
+		g_hash_table_iter_init (&iter, priv->comp_uid_hash);
+		while (g_hash_table_iter_next (&iter, &key, NULL))
+			g_ptr_array_add (uids, g_strdup (key));
 
 		e_debug_log (
 			FALSE, E_DEBUG_LOG_DOMAIN_CAL_QUERIES,  "---;%p;QUERY-ITEMS;%s;%s;%d", query,
-			e_cal_backend_sexp_text (sexp), G_OBJECT_TYPE_NAME (backend),
+			e_cal_backend_sexp_text (sexp), G_OBJECT_TYPE_NAME (cbfile),
 			g_hash_table_size (priv->comp_uid_hash));
 	} else {
+		GList *objs_occuring_in_tw, *link;
+		GHashTable *seen;
+
 		/* matches objects in new "interval tree" way */
 		/* events occuring in time window */
 		objs_occuring_in_tw = e_intervaltree_search (priv->interval_tree, occur_start, occur_end);
 
-		g_list_foreach (objs_occuring_in_tw, (GFunc) match_object_sexp_to_component,
-			       &match_data);
+		/* Instances of the same uid are matched together */
+		seen = g_hash_table_new (g_str_hash, g_str_equal);
+		for (link = objs_occuring_in_tw; link; link = g_list_next (link)) {
+			ECalComponent *comp = link->data;
+			GMutex *comp_lock;
+			const gchar *uid;
+
+			comp_lock = comp_lock_for (cbfile, comp);
+
+			g_mutex_lock (comp_lock);
+			uid = e_cal_component_get_uid (comp);
+			if (uid && !g_hash_table_contains (seen, uid)) {
+				gchar *copy = g_strdup (uid);
+
+				g_hash_table_add (seen, copy);
+				g_ptr_array_add (uids, copy);
+			}
+			g_mutex_unlock (comp_lock);
+		}
+		g_hash_table_destroy (seen);
+
+		match_data_set_occurrence_window (&match_data, occur_start, occur_end);
+
+		e_debug_log (
+			FALSE, E_DEBUG_LOG_DOMAIN_CAL_QUERIES,  "---;%p;QUERY-ITEMS;%s;%s;%d", query,
+			e_cal_backend_sexp_text (sexp), G_OBJECT_TYPE_NAME (cbfile),
+			g_list_length (objs_occuring_in_tw));
+
+		g_list_free_full (objs_occuring_in_tw, g_object_unref);
+	}
+
+	/* The rest is notified as it is read, see load_chunk(); views
+	 * can be started in parallel, thus guard the list */
+	if (priv->loading) {
+		g_mutex_lock (&priv->load_lock);
+		priv->loading_views = g_slist_prepend (priv->loading_views, g_object_ref (query));
+		g_hash_table_add (priv->populating_views, query);
+		g_mutex_unlock (&priv->load_lock);
+		still_loading = TRUE;
+	}
+
+	data_read_unlock (cbfile, locked);
+
+	while (done < uids->len && !e_data_cal_view_is_stopped (query)) {
+		guint batch_end = MIN (done + VIEW_BATCH_SIZE, uids->len);
+		gint64 slice_end;
+
+		locked = data_read_lock (cbfile);
+
+		slice_end = g_get_monotonic_time () + VIEW_SLICE_USECS;
+		while (done < batch_end) {
+			ECalBackendDecsyncObject *obj_data;
+
+			obj_data = priv->comp_uid_hash ? g_hash_table_lookup (priv->comp_uid_hash, uids->pdata[done]) : NULL;
+			if (obj_data)
+				match_object_sexp (NULL, obj_data, &match_data);
+			done++;
+
+			if (g_get_monotonic_time () >= slice_end)
+				break;
+		}
+
+		data_read_unlock (cbfile, locked);
+
+		/* notify listeners of the objects of this batch */
+		if (match_data.comps_list) {
+			match_data.comps_list = g_slist_reverse (match_data.comps_list);
+
+			e_data_cal_view_notify_components_added (query, match_data.comps_list);
+
+			/* free memory */
+			g_slist_free_full (match_data.comps_list, g_object_unref);
+			match_data.comps_list = NULL;
+		}
+
+		if (done < uids->len)
+			e_data_cal_view_notify_progress (query, done * 100 / uids->len, _("Searching..."));
+	}
+
+	complete = !e_data_cal_view_is_stopped (query);
+
+	/* Otherwise it is completed by load_finish() */
+	if (still_loading) {
+		g_mutex_lock (&priv->load_lock);
+		g_hash_table_remove (priv->populating_views, query);
+		if (g_slist_find (priv->loading_views, query))
+			complete = FALSE;
+		g_mutex_unlock (&priv->load_lock);
+	}
+
+	if (complete)
+		e_data_cal_view_notify_complete (query, NULL /* Success */);
+
+	g_ptr_array_free (uids, TRUE);
+	g_object_unref (svd->view);
+	g_object_unref (svd->cbfile);
+	g_free (svd);
+}
+
+/* Views are populated on a pool shared by all the calendars of the
+ * process, so starting many of them at once does not start as many
+ * threads; the others wait for their turn */
+static GThreadPool *
+view_pool_get (void)
+{
+	static GThreadPool *pool = NULL;
+
+	if (g_once_init_enter (&pool)) {
+		GThreadPool *new_pool;
 
-		e_debug_log (
-			FALSE, E_DEBUG_LOG_DOMAIN_CAL_QUERIES,  "---;%p;QUERY-ITEMS;%s;%s;%d", query,
-			e_cal_backend_sexp_text (sexp), G_OBJECT_TYPE_NAME (backend),
-			g_list_length (objs_occuring_in_tw));
+		new_pool = g_thread_pool_new (start_view_cb, NULL, g_get_num_processors (), FALSE, NULL);
+		g_once_init_leave (&pool, new_pool);
 	}
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	return pool;
+}
 
-	/* notify listeners of all objects */
-	if (match_data.comps_list) {
-		match_data.comps_list = g_slist_reverse (match_data.comps_list);
+/* get_query handler for the decsync backend */
+static void
+e_cal_backend_decsync_start_view (ECalBackend *backend,
+                               EDataCalView *query)
+{
+	StartViewData *svd;
+	ECalBackendSExp *sexp;
 
-		e_data_cal_view_notify_components_added (query, match_data.comps_list);
+	sexp = e_data_cal_view_get_sexp (query);
 
-		/* free memory */
-		g_slist_free (match_data.comps_list);
-	}
+	d (g_message (G_STRLOC ": Starting query (%s)", e_cal_backend_sexp_text (sexp)));
 
-	if (objs_occuring_in_tw) {
-		g_list_foreach (objs_occuring_in_tw, (GFunc) g_object_unref, NULL);
-		g_list_free (objs_occuring_in_tw);
+	if (!sexp) {
+		GError *error = EC_ERROR (E_CLIENT_ERROR_INVALID_QUERY);
+		e_data_cal_view_notify_complete (query, error);
+		g_error_free (error);
+		return;
 	}
 
-	e_data_cal_view_notify_complete (query, NULL /* Success */);
+	svd = g_new0 (StartViewData, 1);
+	svd->cbfile = g_object_ref (E_CAL_BACKEND_DECSYNC (backend));
+	svd->view = g_object_ref (query);
+
+	if (!g_thread_pool_push (view_pool_get (), svd, NULL))
+		start_view_cb (svd, NULL);
 }
 
 static gboolean
@@ -1659,6 +4264,86 @@ free_busy_instance (ICalComponent *icomp,
 	return TRUE;
 }
 
+/* Adds the busy periods cached for the window to @vfb. Returns FALSE
+ * when they are not cached, or cached before the data changed. Called
+ * with the data lock held. */
+static gboolean
+free_busy_cache_apply (ECalBackendDecsync *cbfile,
+                       time_t start,
+                       time_t end,
+                       ICalComponent *vfb)
+{
+	ECalBackendDecsyncPrivate *priv;
+	GList *link, *next;
+	gboolean found = FALSE;
+
+	priv = cbfile->priv;
+
+	g_mutex_lock (&priv->free_busy_lock);
+
+	for (link = priv->free_busy_cache.head; link; link = next) {
+		FreeBusyCacheEntry *entry = link->data;
+		guint ii;
+
+		next = link->next;
+
+		if (entry->data_generation != priv->data_generation) {
+			free_busy_cache_entry_free (entry);
+			g_queue_delete_link (&priv->free_busy_cache, link);
+			continue;
+		}
+
+		if (found || entry->start != start || entry->end != end)
+			continue;
+
+		for (ii = 0; ii < entry->periods->len; ii++)
+			i_cal_component_take_property (vfb, i_cal_property_clone (g_ptr_array_index (entry->periods, ii)));
+
+		g_queue_unlink (&priv->free_busy_cache, link);
+		g_queue_push_head_link (&priv->free_busy_cache, link);
+		found = TRUE;
+	}
+
+	g_mutex_unlock (&priv->free_busy_lock);
+
+	return found;
+}
+
+/* Remembers the busy periods of @vfb for the window; called with the
+ * data lock held */
+static void
+free_busy_cache_store (ECalBackendDecsync *cbfile,
+                       time_t start,
+                       time_t end,
+                       ICalComponent *vfb)
+{
+	ECalBackendDecsyncPrivate *priv;
+	FreeBusyCacheEntry *entry;
+	ICalProperty *prop;
+
+	priv = cbfile->priv;
+
+	entry = g_new0 (FreeBusyCacheEntry, 1);
+	entry->start = start;
+	entry->end = end;
+	entry->data_generation = priv->data_generation;
+	entry->periods = g_ptr_array_new_with_free_func (g_object_unref);
+
+	for (prop = i_cal_component_get_first_property (vfb, I_CAL_FREEBUSY_PROPERTY);
+	     prop;
+	     g_object_unref (prop), prop = i_cal_component_get_next_property (vfb, I_CAL_FREEBUSY_PROPERTY)) {
+		g_ptr_array_add (entry->periods, i_cal_property_clone (prop));
+	}
+
+	g_mutex_lock (&priv->free_busy_lock);
+
+	g_queue_push_head (&priv->free_busy_cache, entry);
+	while (g_queue_get_length (&priv->free_busy_cache) > FREE_BUSY_CACHE_SIZE)
+		free_busy_cache_entry_free (g_queue_pop_tail (&priv->free_busy_cache));
+
+	g_mutex_unlock (&priv->free_busy_lock);
+}
+
 static ICalComponent *
 create_user_free_busy (ECalBackendDecsync *cbfile,
                        const gchar *address,
@@ -1668,7 +4353,7 @@ create_user_free_busy (ECalBackendDecsync *cbfile,
                        GCancellable *cancellable)
 {
 	ECalBackendDecsyncPrivate *priv;
-	GList *l;
+	GList *comps, *l;
 	ICalComponent *vfb;
 	ICalTimezone *utc_zone;
 	ICalTime *starttt, *endtt;
@@ -1699,6 +4384,13 @@ create_user_free_busy (ECalBackendDecsync *cbfile,
 	endtt = i_cal_time_new_from_timet_with_zone (end, FALSE, utc_zone);
 	i_cal_component_set_dtend (vfb, endtt);
 
+	/* The busy periods do not depend on the user */
+	if (free_busy_cache_apply (cbfile, start, end, vfb)) {
+		g_clear_object (&starttt);
+		g_clear_object (&endtt);
+		return vfb;
+	}
+
 	/* add all objects in the given interval */
 	iso_start = isodate_from_time_t (start);
 	iso_end = isodate_from_time_t (end);
@@ -1716,16 +4408,26 @@ create_user_free_busy (ECalBackendDecsync *cbfile,
 		return vfb;
 	}
 
-	for (l = priv->comp; l; l = l->next) {
+	/* Only the components occurring in the window can be busy in it */
+	comps = e_intervaltree_search (priv->interval_tree, start, end);
+
+	for (l = comps; l; l = l->next) {
 		ECalComponent *comp = l->data;
 		ICalComponent *icomp, *vcalendar_comp;
 		ICalProperty *prop;
 		ResolveTzidData rtd;
+		GMutex *comp_lock;
+		GArray *occurrences;
 
 		icomp = e_cal_component_get_icalcomponent (comp);
 		if (!icomp)
 			continue;
 
+		occurrences = comp_occurrences_get (cbfile, comp, start, end);
+
+		comp_lock = comp_lock_for (cbfile, comp);
+		g_mutex_lock (comp_lock);
+
 		/* If the event is TRANSPARENT, skip it. */
 		prop = i_cal_component_get_first_property (icomp, I_CAL_TRANSP_PROPERTY);
 		if (prop) {
@@ -1734,16 +4436,50 @@ create_user_free_busy (ECalBackendDecsync *cbfile,
 			g_object_unref (prop);
 
 			if (transp_val == I_CAL_TRANSP_TRANSPARENT ||
-			    transp_val == I_CAL_TRANSP_TRANSPARENTNOCONFLICT)
+			    transp_val == I_CAL_TRANSP_TRANSPARENTNOCONFLICT) {
+				g_mutex_unlock (comp_lock);
+				g_clear_pointer (&occurrences, g_array_unref);
 				continue;
+			}
+		}
+
+		/* Without expanding the recurrences again */
+		if (occurrences) {
+			guint ii;
+
+			for (ii = 0; ii < occurrences->len; ii++) {
+				const ObjectOccurrence *occurrence = &g_array_index (occurrences, ObjectOccurrence, ii);
+				ICalTime *instance_start, *instance_end;
+
+				if (occurrence->start >= end)
+					break;
+
+				if (!object_occurrence_overlaps (occurrence, start, end))
+					continue;
+
+				instance_start = i_cal_time_clone (occurrence->istart);
+				instance_end = i_cal_time_clone (occurrence->iend);
+
+				free_busy_instance (icomp, instance_start, instance_end, vfb, NULL, NULL);
+
+				g_object_unref (instance_start);
+				g_object_unref (instance_end);
+			}
+
+			g_mutex_unlock (comp_lock);
+			g_array_unref (occurrences);
+			continue;
 		}
 
-		if (!e_cal_backend_sexp_match_comp (obj_sexp, comp, E_TIMEZONE_CACHE (cbfile)))
+		if (!e_cal_backend_sexp_match_comp (obj_sexp, comp, E_TIMEZONE_CACHE (cbfile))) {
+			g_mutex_unlock (comp_lock);
 			continue;
+		}
 
 		vcalendar_comp = i_cal_component_get_parent (icomp);
 
 		resolve_tzid_data_init (&rtd, vcalendar_comp);
+		rtd.vcalendar_lock = &priv->vcalendar_lock;
 
 		e_cal_recur_generate_instances_sync (
 			e_cal_component_get_icalcomponent (comp), starttt, endtt,
@@ -1754,10 +4490,18 @@ create_user_free_busy (ECalBackendDecsync *cbfile,
 			i_cal_timezone_get_utc_timezone (),
 			cancellable, NULL);
 
+		g_mutex_unlock (comp_lock);
+
 		resolve_tzid_data_clear (&rtd);
 		g_clear_object (&vcalendar_comp);
 	}
 
+	g_list_free_full (comps, g_object_unref);
+
+	/* An interrupted expansion could be incomplete */
+	if (!g_cancellable_is_cancelled (cancellable))
+		free_busy_cache_store (cbfile, start, end, vfb);
+
 	g_clear_object (&starttt);
 	g_clear_object (&endtt);
 	g_object_unref (obj_sexp);
@@ -1783,10 +4527,13 @@ e_cal_backend_decsync_get_free_busy (ECalBackendSync *backend,
 	ICalComponent *vfb;
 	gchar *calobj;
 	const GSList *l;
+	gboolean locked;
 
 	cbfile = E_CAL_BACKEND_DECSYNC (backend);
 	priv = cbfile->priv;
 
+	wait_for_load (cbfile);
+
 	if (priv->vcalendar == NULL) {
 		g_set_error_literal (
 			error, E_CAL_CLIENT_ERROR,
@@ -1796,7 +4543,7 @@ e_cal_backend_decsync_get_free_busy (ECalBackendSync *backend,
 		return;
 	}
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	locked = data_read_lock (cbfile);
 
 	*freebusy = NULL;
 
@@ -1824,7 +4571,7 @@ e_cal_backend_decsync_get_free_busy (ECalBackendSync *backend,
 		}
 	}
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_read_unlock (cbfile, locked);
 }
 
 static void
@@ -1885,9 +4632,7 @@ e_cal_backend_decsync_create_objects_with_decsync (ECalBackendSync *backend,
 	ECalBackendDecsyncPrivate *priv;
 	GSList *icomps = NULL;
 	const GSList *l;
-	const gchar *path[2];
-	JsonNode *key_node, *value_node;
-	gchar *key_string, *value_string;
+	DecsyncBatch *batch = NULL;
 
 	cbfile = E_CAL_BACKEND_DECSYNC (backend);
 	priv = cbfile->priv;
@@ -1906,7 +4651,7 @@ e_cal_backend_decsync_create_objects_with_decsync (ECalBackendSync *backend,
 
 	*new_components = NULL;
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	data_write_lock (cbfile);
 
 	/* First step, parse input strings and do uid verification: may fail */
 	for (l = in_calobjs; l; l = l->next) {
@@ -1917,7 +4662,7 @@ e_cal_backend_decsync_create_objects_with_decsync (ECalBackendSync *backend,
 		icomp = i_cal_parser_parse_string ((gchar *) l->data);
 		if (!icomp) {
 			g_slist_free_full (icomps, g_object_unref);
-			g_rec_mutex_unlock (&priv->idle_save_rmutex);
+			data_write_unlock (cbfile);
 			g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_INVALID_OBJECT));
 			return;
 		}
@@ -1928,7 +4673,7 @@ e_cal_backend_decsync_create_objects_with_decsync (ECalBackendSync *backend,
 		/* Check kind with the parent */
 		if (i_cal_component_isa (icomp) != e_cal_backend_get_kind (E_CAL_BACKEND (backend))) {
 			g_slist_free_full (icomps, g_object_unref);
-			g_rec_mutex_unlock (&priv->idle_save_rmutex);
+			data_write_unlock (cbfile);
 			g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_INVALID_OBJECT));
 			return;
 		}
@@ -1941,7 +4686,7 @@ e_cal_backend_decsync_create_objects_with_decsync (ECalBackendSync *backend,
 			new_uid = e_util_generate_uid ();
 			if (!new_uid) {
 				g_slist_free_full (icomps, g_object_unref);
-				g_rec_mutex_unlock (&priv->idle_save_rmutex);
+				data_write_unlock (cbfile);
 				g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_INVALID_OBJECT));
 				return;
 			}
@@ -1955,7 +4700,7 @@ e_cal_backend_decsync_create_objects_with_decsync (ECalBackendSync *backend,
 		/* check that the object is not in our cache */
 		if (uid_in_use (cbfile, comp_uid)) {
 			g_slist_free_full (icomps, g_object_unref);
-			g_rec_mutex_unlock (&priv->idle_save_rmutex);
+			data_write_unlock (cbfile);
 			g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_ID_ALREADY_EXISTS));
 			return;
 		}
@@ -2006,7 +4751,7 @@ e_cal_backend_decsync_create_objects_with_decsync (ECalBackendSync *backend,
 	/* Save the file */
 	save (cbfile, TRUE);
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (cbfile);
 
 	if (uids)
 		*uids = g_slist_reverse (*uids);
@@ -2014,25 +4759,18 @@ e_cal_backend_decsync_create_objects_with_decsync (ECalBackendSync *backend,
 	*new_components = g_slist_reverse (*new_components);
 
 	if (update_decsync) {
+		batch = decsync_batch_new ();
 		for (l = *uids; l; l = l->next) {
 			gchar *object;
 			e_cal_backend_decsync_get_ical (backend, NULL, l->data, NULL, TRUE, &object, NULL);
 
-			path[0] = "resources";
-			path[1] = l->data;
-			key_node = json_node_new (JSON_NODE_NULL);
-			key_string = json_to_string (key_node, FALSE);
-			value_node = json_node_new (JSON_NODE_VALUE);
-			json_node_set_string (value_node, object);
-			value_string = json_to_string (value_node, FALSE);
-			decsync_set_entry (priv->decsync, path, 2, key_string, value_string);
-			json_node_free (key_node);
-			g_free (key_string);
-			json_node_free (value_node);
-			g_free (value_string);
+			publish_resource (cbfile, batch, l->data, object);
 
 			g_free (object);
 		}
+
+		decsync_batch_flush (batch, priv->decsync);
+		decsync_batch_free (batch);
 	}
 }
 
@@ -2047,6 +4785,8 @@ e_cal_backend_decsync_create_objects (ECalBackendSync *backend,
                                    GSList **new_components,
                                    GError **error)
 {
+	wait_for_load (E_CAL_BACKEND_DECSYNC (backend));
+
 	e_cal_backend_decsync_create_objects_with_decsync (backend, cal, cancellable, in_calobjs, opflags, uids, new_components, error, TRUE);
 }
 
@@ -2080,9 +4820,9 @@ remove_object_instance_cb (gpointer key,
 			i_cal_component_remove_component (
 				rrdata->cbfile->priv->vcalendar,
 				e_cal_component_get_icalcomponent (instance));
-			rrdata->cbfile->priv->comp = g_list_remove (rrdata->cbfile->priv->comp, instance);
+			comp_list_remove (&rrdata->cbfile->priv->comp, instance);
 
-			rrdata->obj_data->recurrences_list = g_list_remove (rrdata->obj_data->recurrences_list, instance);
+			comp_list_remove (&rrdata->obj_data->recurrences_list, instance);
 
 			return TRUE;
 		}
@@ -2108,9 +4848,7 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 	GSList *icomps = NULL;
 	const GSList *l;
 	ResolveTzidData rtd;
-	const gchar *path[2];
-	JsonNode *key_node, *value_node;
-	gchar *key_string, *value_string;
+	DecsyncBatch *batch = NULL;
 
 	cbfile = E_CAL_BACKEND_DECSYNC (backend);
 	priv = cbfile->priv;
@@ -2142,7 +4880,7 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 	if (new_components)
 		*new_components = NULL;
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	data_write_lock (cbfile);
 
 	/* First step, parse input strings and do uid verification: may fail */
 	for (l = calobjs; l; l = l->next) {
@@ -2153,7 +4891,7 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 		icomp = i_cal_parser_parse_string (l->data);
 		if (!icomp) {
 			g_slist_free_full (icomps, g_object_unref);
-			g_rec_mutex_unlock (&priv->idle_save_rmutex);
+			data_write_unlock (cbfile);
 			g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_INVALID_OBJECT));
 			return;
 		}
@@ -2163,7 +4901,7 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 		/* Check kind with the parent */
 		if (i_cal_component_isa (icomp) != e_cal_backend_get_kind (E_CAL_BACKEND (backend))) {
 			g_slist_free_full (icomps, g_object_unref);
-			g_rec_mutex_unlock (&priv->idle_save_rmutex);
+			data_write_unlock (cbfile);
 			g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_INVALID_OBJECT));
 			return;
 		}
@@ -2174,7 +4912,7 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 		/* Get the object from our cache */
 		if (!g_hash_table_lookup (priv->comp_uid_hash, comp_uid)) {
 			g_slist_free_full (icomps, g_object_unref);
-			g_rec_mutex_unlock (&priv->idle_save_rmutex);
+			data_write_unlock (cbfile);
 			g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 			return;
 		}
@@ -2201,6 +4939,12 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 
 		comp_uid = i_cal_component_get_uid (icomp);
 		obj_data = g_hash_table_lookup (priv->comp_uid_hash, comp_uid);
+		if (obj_data)
+			object_data_invalidate (obj_data);
+
+		/* Not every branch below goes through add_component() or
+		 * remove_component(), so mark the object here already */
+		journal_mark_uid (cbfile, comp_uid);
 
 		/* Set the last modified time on the component */
 		current = i_cal_time_new_current_with_zone (i_cal_timezone_get_utc_timezone ());
@@ -2222,7 +4966,7 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 					i_cal_component_remove_component (
 						priv->vcalendar,
 						e_cal_component_get_icalcomponent (obj_data->full_object));
-					priv->comp = g_list_remove (priv->comp, obj_data->full_object);
+					comp_list_remove (&priv->comp, obj_data->full_object);
 
 					g_object_unref (obj_data->full_object);
 				}
@@ -2241,7 +4985,7 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 				i_cal_component_add_component (
 					priv->vcalendar,
 					e_cal_component_get_icalcomponent (obj_data->full_object));
-				priv->comp = g_list_prepend (priv->comp, obj_data->full_object);
+				comp_list_prepend (&priv->comp, obj_data->full_object);
 				break;
 			}
 
@@ -2255,8 +4999,8 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 				i_cal_component_remove_component (
 					priv->vcalendar,
 					e_cal_component_get_icalcomponent (recurrence));
-				priv->comp = g_list_remove (priv->comp, recurrence);
-				obj_data->recurrences_list = g_list_remove (obj_data->recurrences_list, recurrence);
+				comp_list_remove (&priv->comp, recurrence);
+				comp_list_remove (&obj_data->recurrences_list, recurrence);
 				g_hash_table_remove (obj_data->recurrences, rid);
 			} else {
 				if (old_components)
@@ -2271,8 +5015,8 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 			i_cal_component_add_component (
 				priv->vcalendar,
 				e_cal_component_get_icalcomponent (comp));
-			priv->comp = g_list_append (priv->comp, comp);
-			obj_data->recurrences_list = g_list_append (obj_data->recurrences_list, comp);
+			comp_list_append (&priv->comp, comp);
+			comp_list_append (&obj_data->recurrences_list, comp);
 			break;
 		case E_CAL_OBJ_MOD_THIS_AND_PRIOR:
 		case E_CAL_OBJ_MOD_THIS_AND_FUTURE:
@@ -2303,7 +5047,7 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 				i_cal_component_remove_component (
 					priv->vcalendar,
 					e_cal_component_get_icalcomponent (obj_data->full_object));
-				priv->comp = g_list_remove (priv->comp, obj_data->full_object);
+				comp_list_remove (&priv->comp, obj_data->full_object);
 			}
 
 			/* now deal with the detached recurrence */
@@ -2317,8 +5061,8 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 				i_cal_component_remove_component (
 					priv->vcalendar,
 					e_cal_component_get_icalcomponent (recurrence));
-				priv->comp = g_list_remove (priv->comp, recurrence);
-				obj_data->recurrences_list = g_list_remove (obj_data->recurrences_list, recurrence);
+				comp_list_remove (&priv->comp, recurrence);
+				comp_list_remove (&obj_data->recurrences_list, recurrence);
 				g_hash_table_remove (obj_data->recurrences, rid);
 			} else {
 				if (old_components) // TODO: upstream bug (was *old_components)
@@ -2359,7 +5103,7 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 					e_cal_util_remove_instances_ex (e_cal_component_get_icalcomponent (obj_data->full_object), rid_struct, mod, resolve_tzid_cb, &rtd);
 					e_cal_recur_ensure_end_dates (obj_data->full_object, TRUE, resolve_tzid_cb, &rtd, cancellable, NULL);
 
-					e_cal_backend_notify_component_modified (E_CAL_BACKEND (backend), prev_comp, obj_data->full_object);
+					notify_component_modified (cbfile, prev_comp, obj_data->full_object);
 
 					g_clear_object (&prev_comp);
 				}
@@ -2367,7 +5111,7 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 				i_cal_component_add_component (
 					priv->vcalendar,
 					e_cal_component_get_icalcomponent (obj_data->full_object));
-				priv->comp = g_list_prepend (priv->comp, obj_data->full_object);
+				comp_list_prepend (&priv->comp, obj_data->full_object);
 
 				g_clear_object (&rid_struct);
 				g_clear_object (&master_dtstart);
@@ -2402,11 +5146,11 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 			if (old_components)
 				*old_components = g_slist_prepend (*old_components, obj_data->full_object ? e_cal_component_clone (obj_data->full_object) : NULL);
 
-			if (obj_data->recurrences_list) {
+			if (!comp_list_is_empty (&obj_data->recurrences_list)) {
 				/* has detached components, preserve them */
 				GList *ll;
 
-				for (ll = obj_data->recurrences_list; ll; ll = ll->next) {
+				for (ll = obj_data->recurrences_list.queue.head; ll; ll = ll->next) {
 					detached = g_list_prepend (detached, g_object_ref (ll->data));
 				}
 			}
@@ -2430,8 +5174,8 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 
 						g_hash_table_insert (obj_data->recurrences, e_cal_component_get_recurid_as_string (c), c);
 						i_cal_component_add_component (priv->vcalendar, e_cal_component_get_icalcomponent (c));
-						priv->comp = g_list_append (priv->comp, c);
-						obj_data->recurrences_list = g_list_append (obj_data->recurrences_list, c);
+						comp_list_append (&priv->comp, c);
+						comp_list_append (&obj_data->recurrences_list, c);
 					}
 				}
 
@@ -2459,7 +5203,7 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 	/* All the components were updated, now we save the file */
 	save (cbfile, TRUE);
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (cbfile);
 
 	if (old_components)
 		*old_components = g_slist_reverse (*old_components);
@@ -2468,24 +5212,14 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 		*new_components = g_slist_reverse (*new_components);
 
 	if (update_decsync) {
+		batch = decsync_batch_new ();
 		for (l = *new_components; l; l = l->next) {
 			const gchar *uid;
 			gchar *object;
 			uid = i_cal_component_get_uid (e_cal_component_get_icalcomponent (l->data));
 			e_cal_backend_decsync_get_ical (backend, NULL, uid, NULL, TRUE, &object, NULL);
 
-			path[0] = "resources";
-			path[1] = uid;
-			key_node = json_node_new (JSON_NODE_NULL);
-			key_string = json_to_string (key_node, FALSE);
-			value_node = json_node_new (JSON_NODE_VALUE);
-			json_node_set_string (value_node, object);
-			value_string = json_to_string (value_node, FALSE);
-			decsync_set_entry (priv->decsync, path, 2, key_string, value_string);
-			json_node_free (key_node);
-			g_free (key_string);
-			json_node_free (value_node);
-			g_free (value_string);
+			publish_resource (cbfile, batch, uid, object);
 
 			g_free (object);
 		}
@@ -2507,21 +5241,13 @@ e_cal_backend_decsync_modify_objects_with_decsync (ECalBackendSync *backend,
 			if (is_processed) continue;
 			e_cal_backend_decsync_get_ical (backend, NULL, uid, NULL, TRUE, &object, NULL);
 
-			path[0] = "resources";
-			path[1] = uid;
-			key_node = json_node_new (JSON_NODE_NULL);
-			key_string = json_to_string (key_node, FALSE);
-			value_node = json_node_new (JSON_NODE_VALUE);
-			json_node_set_string (value_node, object);
-			value_string = json_to_string (value_node, FALSE);
-			decsync_set_entry (priv->decsync, path, 2, key_string, value_string);
-			json_node_free (key_node);
-			g_free (key_string);
-			json_node_free (value_node);
-			g_free (value_string);
+			publish_resource (cbfile, batch, uid, object);
 
 			g_free (object);
 		}
+
+		decsync_batch_flush (batch, priv->decsync);
+		decsync_batch_free (batch);
 	}
 }
 
@@ -2536,6 +5262,8 @@ e_cal_backend_decsync_modify_objects (ECalBackendSync *backend,
                                    GSList **new_components,
                                    GError **error)
 {
+	wait_for_load (E_CAL_BACKEND_DECSYNC (backend));
+
 	e_cal_backend_decsync_modify_objects_with_decsync (backend, cal, cancellable, calobjs, mod, opflags, old_components, new_components, error, TRUE);
 }
 
@@ -2557,6 +5285,8 @@ e_cal_backend_decsync_discard_alarm_sync (ECalBackendSync *backend,
 	cbfile = E_CAL_BACKEND_DECSYNC (backend);
 	priv = cbfile->priv;
 
+	wait_for_load (cbfile);
+
 	if (priv->vcalendar == NULL) {
 		g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 		return;
@@ -2565,11 +5295,11 @@ e_cal_backend_decsync_discard_alarm_sync (ECalBackendSync *backend,
 	g_return_if_fail (uid != NULL);
 	g_return_if_fail (priv->comp_uid_hash != NULL);
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	data_write_lock (cbfile);
 
 	obj_data = g_hash_table_lookup (priv->comp_uid_hash, uid);
 	if (!obj_data) {
-		g_rec_mutex_unlock (&priv->idle_save_rmutex);
+		data_write_unlock (cbfile);
 		g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 		return;
 	}
@@ -2600,6 +5330,10 @@ e_cal_backend_decsync_discard_alarm_sync (ECalBackendSync *backend,
 		if (e_cal_util_set_alarm_acknowledged (comp, auid, 0)) {
 			GSList *calobjs;
 
+			/* The stored component may have been changed in place */
+			object_data_invalidate (obj_data);
+			journal_mark_uid (cbfile, uid);
+
 			calobjs = g_slist_prepend (NULL, e_cal_component_get_as_string (comp));
 
 			e_cal_backend_decsync_modify_objects (backend, cal, cancellable, calobjs,
@@ -2616,7 +5350,7 @@ e_cal_backend_decsync_discard_alarm_sync (ECalBackendSync *backend,
 		g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 	}
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (cbfile);
 }
 
 /**
@@ -2650,6 +5384,9 @@ remove_instance (ECalBackendDecsync *cbfile,
 	if (rid && !*rid)
 		rid = NULL;
 
+	object_data_invalidate (obj_data);
+	journal_mark_uid (cbfile, uid);
+
 	if (rid) {
 		ICalTime *rid_struct;
 		ResolveTzidData rtd;
@@ -2676,7 +5413,7 @@ remove_instance (ECalBackendDecsync *cbfile,
 				ECalComponentId *id;
 
 				id = e_cal_component_id_new (uid, rid);
-				e_cal_backend_notify_component_removed (E_CAL_BACKEND (cbfile), id, NULL, NULL);
+				notify_component_removed (cbfile, id, NULL, NULL);
 				e_cal_component_id_free (id);
 			}
 
@@ -2684,8 +5421,8 @@ remove_instance (ECalBackendDecsync *cbfile,
 			i_cal_component_remove_component (
 				cbfile->priv->vcalendar,
 				e_cal_component_get_icalcomponent (comp));
-			cbfile->priv->comp = g_list_remove (cbfile->priv->comp, comp);
-			obj_data->recurrences_list = g_list_remove (obj_data->recurrences_list, comp);
+			comp_list_remove (&cbfile->priv->comp, comp);
+			comp_list_remove (&obj_data->recurrences_list, comp);
 			g_hash_table_remove (obj_data->recurrences, rid);
 		} else if (mod == E_CAL_OBJ_MOD_ONLY_THIS) {
 			if (error)
@@ -2696,7 +5433,7 @@ remove_instance (ECalBackendDecsync *cbfile,
 		}
 		/* component empty? */
 		if (!obj_data->full_object) {
-			if (!obj_data->recurrences_list) {
+			if (comp_list_is_empty (&obj_data->recurrences_list)) {
 				/* empty now, remove it */
 				remove_component (cbfile, uid, obj_data);
 				return NULL;
@@ -2713,7 +5450,7 @@ remove_instance (ECalBackendDecsync *cbfile,
 		i_cal_component_remove_component (
 			cbfile->priv->vcalendar,
 			e_cal_component_get_icalcomponent (obj_data->full_object));
-		cbfile->priv->comp = g_list_remove (cbfile->priv->comp, obj_data->full_object);
+		comp_list_remove (&cbfile->priv->comp, obj_data->full_object);
 
 		/* add EXDATE or EXRULE to parent, report as update */
 		if (old_comp) {
@@ -2755,7 +5492,7 @@ remove_instance (ECalBackendDecsync *cbfile,
 		i_cal_component_add_component (
 			cbfile->priv->vcalendar,
 			e_cal_component_get_icalcomponent (obj_data->full_object));
-		cbfile->priv->comp = g_list_prepend (cbfile->priv->comp, obj_data->full_object);
+		comp_list_prepend (&cbfile->priv->comp, obj_data->full_object);
 	} else {
 		if (!obj_data->full_object) {
 			/* Nothing to do, parent doesn't exist. Tell
@@ -2775,7 +5512,7 @@ remove_instance (ECalBackendDecsync *cbfile,
 		i_cal_component_remove_component (
 			cbfile->priv->vcalendar,
 			e_cal_component_get_icalcomponent (obj_data->full_object));
-		cbfile->priv->comp = g_list_remove (cbfile->priv->comp, obj_data->full_object);
+		comp_list_remove (&cbfile->priv->comp, obj_data->full_object);
 
 		/* remove parent, report as removal */
 		if (old_comp) {
@@ -2785,7 +5522,7 @@ remove_instance (ECalBackendDecsync *cbfile,
 		obj_data->full_object = NULL;
 
 		/* component may be empty now, check that */
-		if (!obj_data->recurrences_list) {
+		if (comp_list_is_empty (&obj_data->recurrences_list)) {
 			remove_component (cbfile, uid, obj_data);
 			return NULL;
 		}
@@ -2824,16 +5561,16 @@ notify_comp_removed_cb (gpointer pecalcomp,
                         gpointer pbackend)
 {
 	ECalComponent *comp = pecalcomp;
-	ECalBackend *backend = pbackend;
+	ECalBackendDecsync *cbfile = pbackend;
 	ECalComponentId *id;
 
 	g_return_if_fail (comp != NULL);
-	g_return_if_fail (backend != NULL);
+	g_return_if_fail (cbfile != NULL);
 
 	id = e_cal_component_get_id (comp);
 	g_return_if_fail (id != NULL);
 
-	e_cal_backend_notify_component_removed (backend, id, comp, NULL);
+	notify_component_removed (cbfile, id, comp, NULL);
 
 	e_cal_component_id_free (id);
 }
@@ -2854,9 +5591,7 @@ e_cal_backend_decsync_remove_objects_with_decsync (ECalBackendSync *backend,
 	ECalBackendDecsync *cbfile;
 	ECalBackendDecsyncPrivate *priv;
 	const GSList *l;
-	const gchar *path[2];
-	JsonNode *key_node, *value_node;
-	gchar *key_string, *value_string;
+	DecsyncBatch *batch = NULL;
 
 	cbfile = E_CAL_BACKEND_DECSYNC (backend);
 	priv = cbfile->priv;
@@ -2884,14 +5619,14 @@ e_cal_backend_decsync_remove_objects_with_decsync (ECalBackendSync *backend,
 
 	*old_components = *new_components = NULL;
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	data_write_lock (cbfile);
 
 	/* First step, validate the input */
 	for (l = ids; l; l = l->next) {
 		ECalComponentId *id = l->data;
 		/* Make the ID contains a uid */
 		if (!id || !e_cal_component_id_get_uid (id)) {
-			g_rec_mutex_unlock (&priv->idle_save_rmutex);
+			data_write_unlock (cbfile);
 			g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 			return;
 		}
@@ -2899,13 +5634,13 @@ e_cal_backend_decsync_remove_objects_with_decsync (ECalBackendSync *backend,
 					 or E_CAL_OBJ_MOD_THIS_AND_FUTURE */
 		if ((mod == E_CAL_OBJ_MOD_THIS_AND_PRIOR || mod == E_CAL_OBJ_MOD_THIS_AND_FUTURE) &&
 			!e_cal_component_id_get_rid (id)) {
-			g_rec_mutex_unlock (&priv->idle_save_rmutex);
+			data_write_unlock (cbfile);
 			g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 			return;
 		}
 				/* Make sure the uid exists in the local hash table */
 		if (!g_hash_table_lookup (priv->comp_uid_hash, e_cal_component_id_get_uid (id))) {
-			g_rec_mutex_unlock (&priv->idle_save_rmutex);
+			data_write_unlock (cbfile);
 			g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_OBJECT_NOT_FOUND));
 			return;
 		}
@@ -2922,13 +5657,16 @@ e_cal_backend_decsync_remove_objects_with_decsync (ECalBackendSync *backend,
 		obj_data = g_hash_table_lookup (priv->comp_uid_hash, e_cal_component_id_get_uid (id));
 		recur_id = e_cal_component_id_get_rid (id);
 
+		object_data_invalidate (obj_data);
+		journal_mark_uid (cbfile, e_cal_component_id_get_uid (id));
+
 		switch (mod) {
 		case E_CAL_OBJ_MOD_ALL :
 			*old_components = g_slist_prepend (*old_components, clone_ecalcomp_from_fileobject (obj_data, recur_id));
 			*new_components = g_slist_prepend (*new_components, NULL);
 
-			if (obj_data->recurrences_list)
-				g_list_foreach (obj_data->recurrences_list, notify_comp_removed_cb, cbfile);
+			if (!comp_list_is_empty (&obj_data->recurrences_list))
+				g_queue_foreach (&obj_data->recurrences_list.queue, notify_comp_removed_cb, cbfile);
 			remove_component (cbfile, e_cal_component_id_get_uid (id), obj_data);
 			break;
 		case E_CAL_OBJ_MOD_ONLY_THIS:
@@ -2958,7 +5696,7 @@ e_cal_backend_decsync_remove_objects_with_decsync (ECalBackendSync *backend,
 				i_cal_component_remove_component (
 					priv->vcalendar,
 					e_cal_component_get_icalcomponent (comp));
-				priv->comp = g_list_remove (priv->comp, comp);
+				comp_list_remove (&priv->comp, comp);
 
 				rid_struct = i_cal_time_new_from_string (recur_id);
 				if (!i_cal_time_get_timezone (rid_struct)) {
@@ -2994,7 +5732,7 @@ e_cal_backend_decsync_remove_objects_with_decsync (ECalBackendSync *backend,
 			 * so that it's always before any detached instance we
 			 * might have */
 			if (comp)
-				priv->comp = g_list_prepend (priv->comp, comp);
+				comp_list_prepend (&priv->comp, comp);
 
 			if (obj_data->full_object) {
 				*new_components = g_slist_prepend (*new_components, e_cal_component_clone (obj_data->full_object));
@@ -3007,37 +5745,26 @@ e_cal_backend_decsync_remove_objects_with_decsync (ECalBackendSync *backend,
 
 	save (cbfile, TRUE);
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (cbfile);
 
 	*old_components = g_slist_reverse (*old_components);
 	*new_components = g_slist_reverse (*new_components);
 
 	if (update_decsync) {
+		batch = decsync_batch_new ();
 		for (l = *old_components; l; l = l->next) {
 			const gchar *uid;
 			gchar *object = NULL;
 			uid = i_cal_component_get_uid (e_cal_component_get_icalcomponent (l->data));
 			e_cal_backend_decsync_get_ical (backend, NULL, uid, NULL, TRUE, &object, NULL);
 
-			path[0] = "resources";
-			path[1] = uid;
-			key_node = json_node_new (JSON_NODE_NULL);
-			key_string = json_to_string (key_node, FALSE);
-			if (object == NULL) {
-				value_node = json_node_new (JSON_NODE_NULL);
-			} else {
-				value_node = json_node_new (JSON_NODE_VALUE);
-				json_node_set_string (value_node, object);
-			}
-			value_string = json_to_string (value_node, FALSE);
-			decsync_set_entry (priv->decsync, path, 2, key_string, value_string);
-			json_node_free (key_node);
-			g_free (key_string);
-			json_node_free (value_node);
-			g_free (value_string);
+			publish_resource (cbfile, batch, uid, object);
 
 			g_free (object);
 		}
+
+		decsync_batch_flush (batch, priv->decsync);
+		decsync_batch_free (batch);
 	}
 }
 
@@ -3052,6 +5779,8 @@ e_cal_backend_decsync_remove_objects (ECalBackendSync *backend,
                                    GSList **new_components,
                                    GError **error)
 {
+	wait_for_load (E_CAL_BACKEND_DECSYNC (backend));
+
 	e_cal_backend_decsync_remove_objects_with_decsync (backend, cal, cancellable, ids, mod, opflags, old_components, new_components, error, TRUE);
 }
 
@@ -3216,62 +5945,25 @@ masters_first_cmp (gconstpointer ptr1,
 static gint
 masters_uid_cmp (gconstpointer ptr1, gconstpointer ptr2)
 {
-	ICalComponent *icomp1 = (ICalComponent *) ptr1;
-	ICalComponent *icomp2 = (ICalComponent *) ptr2;
+	ECalComponent *comp1 = (ECalComponent *) ptr1;
+	ECalComponent *comp2 = (ECalComponent *) ptr2;
 
-	return g_strcmp0 (icomp1 ? i_cal_component_get_uid (icomp1) : NULL,
-	                  icomp2 ? i_cal_component_get_uid (icomp2) : NULL);
+	return g_strcmp0 (comp1 ? e_cal_component_get_uid (comp1) : NULL,
+	                  comp2 ? e_cal_component_get_uid (comp2) : NULL);
 }
 
-static void
-e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
-                                                 GCancellable *cancellable,
-                                                 const gchar *calobj,
-                                                 ECalOperationFlags opflags,
-                                                 gboolean update_decsync,
-                                                 GError **error)
+/* Parses @calobj into a VCALENDAR with a METHOD. It does not touch the
+ * backend, so it can be called from any thread. */
+static ICalComponent *
+ecal_backend_decsync_parse_calobj (const gchar *calobj)
 {
-	ESourceRegistry *registry;
-	ECalBackendDecsync *cbfile;
-	ECalBackendDecsyncPrivate *priv;
-	ECalClientTzlookupICalCompData *lookup_data = NULL;
-	ICalComponent *toplevel_comp, *icomp = NULL;
-	ICalComponentKind kind;
-	ICalPropertyMethod toplevel_method, method;
-	ICalComponent *subcomp;
-	GSList *comps = NULL, *del_comps = NULL, *link;
-	ECalComponent *comp;
-	ECalBackendDecsyncTzidData tzdata;
-	GError *err = NULL;
-	const gchar *path[2];
-	JsonNode *key_node, *value_node;
-	gchar *key_string, *value_string;
-
-	cbfile = E_CAL_BACKEND_DECSYNC (backend);
-	priv = cbfile->priv;
-
-	if (priv->vcalendar == NULL) {
-		g_set_error_literal (
-			error, E_CAL_CLIENT_ERROR,
-			E_CAL_CLIENT_ERROR_NO_SUCH_CALENDAR,
-			e_cal_client_error_to_string (
-			E_CAL_CLIENT_ERROR_NO_SUCH_CALENDAR));
-		return;
-	}
+	ICalComponent *toplevel_comp, *icomp;
 
-	/* Pull the component from the string and ensure that it is sane */
 	toplevel_comp = i_cal_parser_parse_string (calobj);
-	if (!toplevel_comp) {
-		g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_INVALID_OBJECT));
-		return;
-	}
-
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
-
-	registry = e_cal_backend_get_registry (E_CAL_BACKEND (backend));
+	if (!toplevel_comp)
+		return NULL;
 
-	kind = i_cal_component_isa (toplevel_comp);
-	if (kind != I_CAL_VCALENDAR_COMPONENT) {
+	if (i_cal_component_isa (toplevel_comp) != I_CAL_VCALENDAR_COMPONENT) {
 		/* If it is not a VCALENDAR, make it one to simplify below */
 		icomp = toplevel_comp;
 		toplevel_comp = e_cal_util_new_top_level ();
@@ -3285,6 +5977,28 @@ e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
 			i_cal_component_set_method (toplevel_comp, I_CAL_METHOD_PUBLISH);
 	}
 
+	return toplevel_comp;
+}
+
+/* Checks the objects of @toplevel_comp, as returned by
+ * ecal_backend_decsync_parse_calobj(), drops those of other kinds than
+ * @kind and sets the ECalComponent-s of the rest to @out_comps, masters
+ * first. It does not touch the backend, so it can be called from any
+ * thread. */
+static gboolean
+ecal_backend_decsync_prepare_toplevel (ICalComponent *toplevel_comp,
+                                       ICalComponentKind kind,
+                                       GSList **out_comps,
+                                       GError **error)
+{
+	ICalPropertyMethod toplevel_method;
+	ICalComponent *subcomp;
+	GSList *icomps = NULL, *del_comps = NULL, *link;
+	ECalBackendDecsyncTzidData tzdata;
+	GError *err = NULL;
+
+	*out_comps = NULL;
+
 	toplevel_method = i_cal_component_get_method (toplevel_comp);
 
 	/* Build a list of timezones so we can make sure all the objects have valid info */
@@ -3302,8 +6016,6 @@ e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
 	}
 
 	/* First we make sure all the components are usuable */
-	kind = e_cal_backend_get_kind (E_CAL_BACKEND (backend));
-
 	for (subcomp = i_cal_component_get_first_component (toplevel_comp, I_CAL_ANY_COMPONENT);
 	     subcomp;
 	     g_object_unref (subcomp), subcomp = i_cal_component_get_next_component (toplevel_comp, I_CAL_ANY_COMPONENT)) {
@@ -3340,7 +6052,7 @@ e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
 
 		}
 
-		comps = g_slist_prepend (comps, g_object_ref (subcomp));
+		icomps = g_slist_prepend (icomps, g_object_ref (subcomp));
 	}
 
 	/* Now we remove the components we don't care about */
@@ -3350,8 +6062,92 @@ e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
 		i_cal_component_remove_component (toplevel_comp, subcomp);
 	}
 
+	icomps = g_slist_sort (icomps, masters_first_cmp);
+
+	for (link = icomps; link; link = g_slist_next (link)) {
+		ECalComponent *comp;
+		ICalTime *current;
+
+		subcomp = link->data;
+
+		/* Create the cal component */
+		comp = e_cal_component_new_from_icalcomponent (g_object_ref (subcomp));
+		if (!comp)
+			continue;
+
+		/* Set the created and last modified times on the component, if not there already */
+		current = i_cal_time_new_current_with_zone (i_cal_timezone_get_utc_timezone ());
+
+		if (!e_cal_util_component_has_property (subcomp, I_CAL_CREATED_PROPERTY)) {
+			/* Update both when CREATED is missing, to make sure the LAST-MODIFIED
+			   is not before CREATED */
+			e_cal_component_set_created (comp, current);
+			e_cal_component_set_last_modified (comp, current);
+		} else if (!e_cal_util_component_has_property (subcomp, I_CAL_LASTMODIFIED_PROPERTY)) {
+			e_cal_component_set_last_modified (comp, current);
+		}
+
+		g_clear_object (&current);
+
+		*out_comps = g_slist_prepend (*out_comps, comp);
+	}
+
+	*out_comps = g_slist_reverse (*out_comps);
+
+ error:
 	g_slist_free_full (del_comps, g_object_unref);
-	del_comps = NULL;
+	g_slist_free_full (icomps, g_object_unref);
+	g_hash_table_destroy (tzdata.zones);
+
+	if (err) {
+		g_propagate_error (error, err);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Merges @toplevel_comp and its objects @comps, as prepared by
+ * ecal_backend_decsync_prepare_toplevel(), into the calendar; takes
+ * ownership of both */
+static void
+e_cal_backend_decsync_receive_prepared_with_decsync (ECalBackendSync *backend,
+                                                     ICalComponent *toplevel_comp,
+                                                     GSList *comps,
+                                                     ECalOperationFlags opflags,
+                                                     gboolean update_decsync,
+                                                     GError **error)
+{
+	ESourceRegistry *registry;
+	ECalBackendDecsync *cbfile;
+	ECalBackendDecsyncPrivate *priv;
+	ECalClientTzlookupICalCompData *lookup_data = NULL;
+	ICalPropertyMethod toplevel_method, method;
+	ICalComponent *subcomp;
+	GSList *link;
+	ECalComponent *comp;
+	GError *err = NULL;
+	DecsyncBatch *batch = NULL;
+
+	cbfile = E_CAL_BACKEND_DECSYNC (backend);
+	priv = cbfile->priv;
+
+	if (priv->vcalendar == NULL) {
+		g_object_unref (toplevel_comp);
+		g_slist_free_full (comps, g_object_unref);
+		g_set_error_literal (
+			error, E_CAL_CLIENT_ERROR,
+			E_CAL_CLIENT_ERROR_NO_SUCH_CALENDAR,
+			e_cal_client_error_to_string (
+			E_CAL_CLIENT_ERROR_NO_SUCH_CALENDAR));
+		return;
+	}
+
+	data_write_lock (cbfile);
+
+	registry = e_cal_backend_get_registry (E_CAL_BACKEND (backend));
+
+	toplevel_method = i_cal_component_get_method (toplevel_comp);
 
 	lookup_data = e_cal_client_tzlookup_icalcomp_data_new (priv->vcalendar);
 
@@ -3378,38 +6174,18 @@ e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
 	g_clear_object (&toplevel_comp);
 
 	/* Now we manipulate the components we care about */
-	comps = g_slist_sort (comps, masters_first_cmp);
-
 	for (link = comps; link; link = g_slist_next (link)) {
 		ECalComponent *old_component = NULL;
 		ECalComponent *new_component = NULL;
 		ECalObjModType mod = E_CAL_OBJ_MOD_THIS;
-		ICalTime *current;
 		const gchar *uid;
-		gchar *rid;
-		ECalBackendDecsyncObject *obj_data;
-		gboolean is_declined;
-
-		subcomp = link->data;
-
-		/* Create the cal component */
-		comp = e_cal_component_new_from_icalcomponent (g_object_ref (subcomp));
-		if (!comp)
-			continue;
-
-		/* Set the created and last modified times on the component, if not there already */
-		current = i_cal_time_new_current_with_zone (i_cal_timezone_get_utc_timezone ());
-
-		if (!e_cal_util_component_has_property (subcomp, I_CAL_CREATED_PROPERTY)) {
-			/* Update both when CREATED is missing, to make sure the LAST-MODIFIED
-			   is not before CREATED */
-			e_cal_component_set_created (comp, current);
-			e_cal_component_set_last_modified (comp, current);
-		} else if (!e_cal_util_component_has_property (subcomp, I_CAL_LASTMODIFIED_PROPERTY)) {
-			e_cal_component_set_last_modified (comp, current);
-		}
+		gchar *rid;
+		ECalBackendDecsyncObject *obj_data;
+		gboolean is_declined;
 
-		g_clear_object (&current);
+		/* The list keeps its own reference */
+		comp = g_object_ref (link->data);
+		subcomp = e_cal_component_get_icalcomponent (comp);
 
 		uid = e_cal_component_get_uid (comp);
 		rid = e_cal_component_get_recurid_as_string (comp);
@@ -3462,14 +6238,12 @@ e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
 					add_component (cbfile, comp, FALSE);
 
 				if (!is_declined)
-					e_cal_backend_notify_component_modified (E_CAL_BACKEND (backend),
-										 old_component, comp);
+					notify_component_modified (cbfile, old_component, comp);
 				else {
 					ECalComponentId *id = e_cal_component_get_id (comp);
 
-					e_cal_backend_notify_component_removed (E_CAL_BACKEND (backend),
-										id, old_component,
-										rid ? comp : NULL);
+					notify_component_removed (cbfile, id, old_component,
+								  rid ? comp : NULL);
 
 					e_cal_component_id_free (id);
 					g_object_unref (comp);
@@ -3481,7 +6255,7 @@ e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
 			} else if (!is_declined) {
 				add_component (cbfile, comp, FALSE);
 
-				e_cal_backend_notify_component_created (E_CAL_BACKEND (backend), comp);
+				notify_component_created (cbfile, comp);
 			} else {
 				g_object_unref (comp);
 			}
@@ -3512,8 +6286,7 @@ e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
 
 				id = e_cal_component_get_id (comp);
 
-				e_cal_backend_notify_component_removed (E_CAL_BACKEND (backend),
-									id, old_component, new_component);
+				notify_component_removed (cbfile, id, old_component, new_component);
 
 				/* remove the component from the toplevel VCALENDAR */
 				i_cal_component_remove_component (priv->vcalendar, subcomp);
@@ -3539,32 +6312,18 @@ e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
 
 	if (update_decsync) {
 		const gchar *prev_uid = NULL;
+
+		batch = decsync_batch_new ();
 		comps = g_slist_sort (comps, masters_uid_cmp);
 		for (link = comps; link; link = g_slist_next (link)) {
 			const gchar *uid;
 			gchar *object = NULL;
 
-			subcomp = link->data;
-			uid = i_cal_component_get_uid (subcomp);
+			uid = e_cal_component_get_uid (link->data);
 			if (g_strcmp0(prev_uid, uid)) {
 				e_cal_backend_decsync_get_ical (backend, NULL, uid, NULL, TRUE, &object, NULL);
 
-				path[0] = "resources";
-				path[1] = uid;
-				key_node = json_node_new (JSON_NODE_NULL);
-				key_string = json_to_string (key_node, FALSE);
-				if (object == NULL) {
-					value_node = json_node_new (JSON_NODE_NULL);
-				} else {
-					value_node = json_node_new (JSON_NODE_VALUE);
-					json_node_set_string (value_node, object);
-				}
-				value_string = json_to_string (value_node, FALSE);
-				decsync_set_entry (priv->decsync, path, 2, key_string, value_string);
-				json_node_free (key_node);
-				g_free (key_string);
-				json_node_free (value_node);
-				g_free (value_string);
+				publish_resource (cbfile, batch, uid, object);
 
 				g_free (object);
 			}
@@ -3573,17 +6332,48 @@ e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
 	}
 
  error:
-	g_slist_free_full (del_comps, g_object_unref);
+	g_clear_object (&toplevel_comp);
 	g_slist_free_full (comps, g_object_unref);
 
-	g_hash_table_destroy (tzdata.zones);
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (cbfile);
 	e_cal_client_tzlookup_icalcomp_data_free (lookup_data);
 
+	/* Write to DecSync once the lock is released */
+	if (batch) {
+		decsync_batch_flush (batch, priv->decsync);
+		decsync_batch_free (batch);
+	}
+
 	if (err)
 		g_propagate_error (error, err);
 }
 
+static void
+e_cal_backend_decsync_receive_objects_with_decsync (ECalBackendSync *backend,
+                                                 GCancellable *cancellable,
+                                                 const gchar *calobj,
+                                                 ECalOperationFlags opflags,
+                                                 gboolean update_decsync,
+                                                 GError **error)
+{
+	ICalComponent *toplevel_comp;
+	GSList *comps = NULL;
+
+	/* Pull the component from the string and ensure that it is sane */
+	toplevel_comp = ecal_backend_decsync_parse_calobj (calobj);
+	if (!toplevel_comp) {
+		g_propagate_error (error, ECC_ERROR (E_CAL_CLIENT_ERROR_INVALID_OBJECT));
+		return;
+	}
+
+	if (!ecal_backend_decsync_prepare_toplevel (toplevel_comp, e_cal_backend_get_kind (E_CAL_BACKEND (backend)), &comps, error)) {
+		g_object_unref (toplevel_comp);
+		return;
+	}
+
+	e_cal_backend_decsync_receive_prepared_with_decsync (backend, toplevel_comp, comps, opflags, update_decsync, error);
+}
+
 /* Update_objects handler for the decsync backend. */
 static void
 e_cal_backend_decsync_receive_objects (ECalBackendSync *backend,
@@ -3593,6 +6383,8 @@ e_cal_backend_decsync_receive_objects (ECalBackendSync *backend,
                                     ECalOperationFlags opflags,
                                     GError **error)
 {
+	wait_for_load (E_CAL_BACKEND_DECSYNC (backend));
+
 	e_cal_backend_decsync_receive_objects_with_decsync (backend, cancellable, calobj, opflags, TRUE, error);
 }
 
@@ -3684,7 +6476,7 @@ cal_backend_decsync_add_cached_timezone (ETimezoneCache *cache,
 
 	priv = E_CAL_BACKEND_DECSYNC (cache)->priv;
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	data_write_lock (E_CAL_BACKEND_DECSYNC (cache));
 
 	tzid = i_cal_timezone_get_tzid (zone);
 	if (!i_cal_component_get_timezone (priv->vcalendar, tzid)) {
@@ -3697,10 +6489,11 @@ cal_backend_decsync_add_cached_timezone (ETimezoneCache *cache,
 		g_clear_object (&tz_comp);
 
 		timezone_added = TRUE;
+		journal_invalidate (E_CAL_BACKEND_DECSYNC (cache));
 		save (E_CAL_BACKEND_DECSYNC (cache), TRUE);
 	}
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (E_CAL_BACKEND_DECSYNC (cache));
 
 	/* Emit the signal outside of the mutex. */
 	if (timezone_added)
@@ -3713,17 +6506,23 @@ cal_backend_decsync_get_cached_timezone (ETimezoneCache *cache,
 {
 	ECalBackendDecsyncPrivate *priv;
 	ICalTimezone *zone;
+	gboolean locked;
 
 	priv = E_CAL_BACKEND_DECSYNC (cache)->priv;
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	/* Looked up also by readers with the data locked for reading, which
+	 * data_read_lock() nests for, thus vcalendar_lock guards the lookup
+	 * and cached_timezones as well */
+	locked = data_read_lock (E_CAL_BACKEND_DECSYNC (cache));
+	g_mutex_lock (&priv->vcalendar_lock);
 	zone = g_hash_table_lookup (priv->cached_timezones, tzid);
 	if (!zone) {
 		zone = i_cal_component_get_timezone (priv->vcalendar, tzid);
 		if (zone)
 			g_hash_table_insert (priv->cached_timezones, g_strdup (tzid), zone);
 	}
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	g_mutex_unlock (&priv->vcalendar_lock);
+	data_read_unlock (E_CAL_BACKEND_DECSYNC (cache), locked);
 
 	if (zone != NULL)
 		return zone;
@@ -3750,6 +6549,7 @@ cal_backend_decsync_list_cached_timezones (ETimezoneCache *cache)
 
 typedef struct {
 	ECalBackend *backend;
+	GHashTable *resources; /* gchar *uid -> gchar *ical, NULL when removed */
 } Extra;
 
 static void
@@ -3812,90 +6612,297 @@ updateColor (Extra *extra, const gchar *color)
 static void
 updateEvent (const gchar *uid, const gchar *ical, Extra *extra)
 {
-	ECalBackendSync *backend;
-
-	backend = E_CAL_BACKEND_SYNC (extra->backend);
-	e_cal_backend_decsync_receive_objects_with_decsync (backend, NULL, ical, 0, FALSE, NULL);
+	/* Later entries for the same uid replace earlier ones */
+	g_hash_table_insert (extra->resources, g_strdup (uid), g_strdup (ical));
 }
 
 static void
 removeEvent (const gchar *uid, Extra *extra)
+{
+	g_hash_table_insert (extra->resources, g_strdup (uid), NULL);
+}
+
+static void
+ecal_backend_decsync_remove_resource (ECalBackendDecsync *cbfile,
+                                      const gchar *uid)
 {
 	ECalComponentId *id;
 	GSList *ids;
-	GSList *old_components, *new_components;
+	GSList *old_components = NULL, *new_components = NULL;
 
 	id = e_cal_component_id_new (uid, NULL);
 	ids = g_slist_prepend (NULL, id);
-	e_cal_backend_decsync_remove_objects_with_decsync (E_CAL_BACKEND_SYNC (extra->backend), NULL, NULL,
+	e_cal_backend_decsync_remove_objects_with_decsync (E_CAL_BACKEND_SYNC (cbfile), NULL, NULL,
 			ids, E_CAL_OBJ_MOD_ALL, 0, &old_components, &new_components, NULL, FALSE);
-	if (old_components && new_components) {
-		e_cal_backend_notify_component_removed (extra->backend, id, old_components->data, new_components->data);
-		g_slist_free (old_components);
-		g_slist_free (new_components);
-	}
+	if (old_components && new_components)
+		notify_component_removed (cbfile, id, old_components->data, new_components->data);
+	e_util_free_nullable_object_slist (old_components);
+	e_util_free_nullable_object_slist (new_components);
 	e_cal_component_id_free (id);
 	g_slist_free (ids);
 }
 
+typedef struct {
+	GMutex lock;
+	GCond cond;
+	guint pending;
+} ParseBatch;
+
+typedef struct {
+	const gchar *uid;
+	const gchar *ical; /* NULL when removed */
+	ICalComponentKind kind;
+	ICalComponent *toplevel_comp; /* NULL when not usable */
+	GSList *comps; /* ECalComponent *, see ecal_backend_decsync_prepare_toplevel() */
+	ParseBatch *batch;
+} ParsedResource;
+
+/* Parses the resource and prepares its components; none of it touches
+ * the backend, so only merging them is left for the locked part */
+static void
+parse_resource (ParsedResource *resource)
+{
+	resource->toplevel_comp = ecal_backend_decsync_parse_calobj (resource->ical);
+
+	if (resource->toplevel_comp &&
+	    !ecal_backend_decsync_prepare_toplevel (resource->toplevel_comp, resource->kind, &resource->comps, NULL))
+		g_clear_object (&resource->toplevel_comp);
+}
+
+static void
+parse_resource_cb (gpointer data,
+                   gpointer user_data)
+{
+	ParsedResource *resource = data;
+	ParseBatch *batch = resource->batch;
+
+	parse_resource (resource);
+
+	g_mutex_lock (&batch->lock);
+	if (--batch->pending == 0)
+		g_cond_signal (&batch->cond);
+	g_mutex_unlock (&batch->lock);
+}
+
+/* The pool is shared by all the calendars of the process */
+static GThreadPool *
+parse_pool_get (void)
+{
+	static GThreadPool *pool = NULL;
+
+	if (g_once_init_enter (&pool)) {
+		GThreadPool *new_pool;
+
+		new_pool = g_thread_pool_new (parse_resource_cb, NULL, g_get_num_processors (), FALSE, NULL);
+		g_once_init_leave (&pool, new_pool);
+	}
+
+	return pool;
+}
+
+/* Parses the values of @parsed, in parallel when there are enough of them.
+ * Each resource is parsed on its own, so the order does not matter. */
+static void
+parse_resources (ParsedResource *parsed,
+                 guint n_parsed)
+{
+	ParseBatch batch;
+	GThreadPool *pool = NULL;
+	guint ii, n_values = 0;
+
+	for (ii = 0; ii < n_parsed; ii++) {
+		if (parsed[ii].ical)
+			n_values++;
+	}
+
+	if (n_values >= PARALLEL_PARSE_MIN_RESOURCES && g_get_num_processors () > 1)
+		pool = parse_pool_get ();
+
+	if (!pool) {
+		for (ii = 0; ii < n_parsed; ii++) {
+			if (parsed[ii].ical)
+				parse_resource (&parsed[ii]);
+		}
+
+		return;
+	}
+
+	g_mutex_init (&batch.lock);
+	g_cond_init (&batch.cond);
+	batch.pending = n_values;
+
+	for (ii = 0; ii < n_parsed; ii++) {
+		if (!parsed[ii].ical)
+			continue;
+
+		parsed[ii].batch = &batch;
+		g_thread_pool_push (pool, &parsed[ii], NULL);
+	}
+
+	/* Waits for all of them to be parsed */
+	g_mutex_lock (&batch.lock);
+	while (batch.pending > 0)
+		g_cond_wait (&batch.cond, &batch.lock);
+	g_mutex_unlock (&batch.lock);
+
+	g_mutex_clear (&batch.lock);
+	g_cond_clear (&batch.cond);
+}
+
+/* Applies all the resources collected by updateEvent() and removeEvent()
+ * during one run of decsync_execute_all_new_entries(). They are parsed
+ * and turned into components before the lock is taken, so only merging
+ * them blocks the calendar. The
+ * calendar is saved once with a single revision bump, after which the
+ * views are notified in one go. */
+static void
+ecal_backend_decsync_apply_resources (ECalBackendDecsync *cbfile,
+                                      GHashTable *resources)
+{
+	ECalBackendDecsyncPrivate *priv;
+	GHashTableIter iter;
+	gpointer key, value;
+	GSList *notifications;
+	ParsedResource *parsed;
+	gboolean dirty, do_bump_revision;
+	guint skipped = 0, n_parsed = 0, ii;
+
+	priv = cbfile->priv;
+
+	if (g_hash_table_size (resources) == 0)
+		return;
+
+	wait_for_load (cbfile);
+
+	/* Every uid is in the table once, with its last value, so merging
+	 * them in any order keeps the order of the entries of each uid */
+	parsed = g_new0 (ParsedResource, g_hash_table_size (resources));
+
+	g_hash_table_iter_init (&iter, resources);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		const gchar *uid = key, *ical = value;
+
+		/* Echoes of a value which is already applied are not even parsed */
+		if (ical && digests_is_unchanged (cbfile, uid, ical)) {
+			skipped++;
+			continue;
+		}
+
+		parsed[n_parsed].uid = uid;
+		parsed[n_parsed].ical = ical;
+		parsed[n_parsed].kind = e_cal_backend_get_kind (E_CAL_BACKEND (cbfile));
+		n_parsed++;
+	}
+
+	parse_resources (parsed, n_parsed);
+
+	data_write_lock (cbfile);
+
+	priv->in_batch = TRUE;
+
+	for (ii = 0; ii < n_parsed; ii++) {
+		const gchar *uid = parsed[ii].uid, *ical = parsed[ii].ical;
+		GError *local_error = NULL;
+
+		if (ical == NULL) {
+			ecal_backend_decsync_remove_resource (cbfile, uid);
+		} else if (parsed[ii].toplevel_comp) {
+			e_cal_backend_decsync_receive_prepared_with_decsync (E_CAL_BACKEND_SYNC (cbfile),
+				parsed[ii].toplevel_comp, parsed[ii].comps, 0, FALSE, &local_error);
+		} else {
+			g_warning ("Invalid calendar object for %s", uid);
+			continue;
+		}
+
+		/* Only what was merged is skipped when it comes again */
+		if (local_error) {
+			g_warning ("Failed to apply %s: %s", uid, local_error->message);
+			g_clear_error (&local_error);
+		} else {
+			digests_update (cbfile, uid, ical);
+		}
+	}
+
+	g_free (parsed);
+
+	if (skipped > 0) {
+		g_atomic_int_add (&priv->skipped_entries, skipped);
+		e_debug_log (
+			FALSE, E_DEBUG_LOG_DOMAIN_CAL_QUERIES, "---;%p;DECSYNC-SKIPPED;%s;%u;%u", cbfile,
+			G_OBJECT_TYPE_NAME (cbfile), skipped, g_hash_table_size (resources));
+	}
+
+	notifications = g_slist_reverse (priv->batch_notifications);
+	dirty = priv->batch_dirty;
+	do_bump_revision = priv->batch_bump_revision;
+
+	priv->in_batch = FALSE;
+	priv->batch_notifications = NULL;
+	priv->batch_dirty = FALSE;
+	priv->batch_bump_revision = FALSE;
+
+	if (dirty)
+		save (cbfile, do_bump_revision);
+
+	data_write_unlock (cbfile);
+
+	/* Notify the views outside of the lock */
+	batch_notifications_emit (cbfile, notifications);
+	g_slist_free_full (notifications, batch_notification_free);
+}
+
 static void
 infoListener (const gchar **path, int len, const char *datetime, const char *key_string, const char *value_string, void *extra_void)
 {
 	Extra *extra;
 	const gchar *info;
-	JsonNode *key_node, *value_node;
-	GError *error = NULL;
+	GString *key, *value;
+	DecsyncJsonType value_type;
 
 	extra = (Extra*)extra_void;
-	key_node = json_from_string (key_string, &error);
-	if (error != NULL) {
+	key = decsync_json_buffer (DECSYNC_JSON_BUFFER_KEY);
+	value = decsync_json_buffer (DECSYNC_JSON_BUFFER_VALUE);
+	if (decsync_json_decode (key_string, key) != DECSYNC_JSON_STRING) {
 		g_warning ("Invalid JSON for info key: %s", key_string);
-		g_error_free (error);
 		return;
 	}
-	value_node = json_from_string (value_string, &error);
-	if (error != NULL) {
+	value_type = decsync_json_decode (value_string, value);
+	if (value_type == DECSYNC_JSON_INVALID) {
 		g_warning ("Invalid JSON for info value: %s", value_string);
-		json_node_free (key_node);
-		g_error_free (error);
 		return;
 	}
-	info = json_node_get_string (key_node);
+	info = key->str;
 	if (g_strcmp0 (info, "deleted") == 0) {
-		if (json_node_get_boolean (value_node) == TRUE) {
+		if (value_type == DECSYNC_JSON_TRUE) {
 			deleteCal (extra);
 		}
 	} else if (g_strcmp0 (info, "name") == 0) {
-		updateName(extra, json_node_get_string (value_node));
+		updateName(extra, value_type == DECSYNC_JSON_STRING ? value->str : NULL);
 	} else if (g_strcmp0 (info, "color") == 0) {
-		updateColor(extra, json_node_get_string (value_node));
+		updateColor(extra, value_type == DECSYNC_JSON_STRING ? value->str : NULL);
 	} else {
 		g_warning ("Unknown info key: %s", info);
 	}
-	json_node_free (key_node);
-	json_node_free (value_node);
 }
 
 static void
 resourcesListener (const gchar **path, int len, const char *datetime, const char *key_string, const char *value_string, void *extra_void)
 {
 	Extra *extra;
-	const gchar *uid, *ical;
-	JsonNode *key_node, *value_node;
-	GError *error = NULL;
+	const gchar *uid;
+	GString *key, *value;
+	DecsyncJsonType value_type;
 
 	extra = (Extra*)extra_void;
-	key_node = json_from_string (key_string, &error);
-	if (error != NULL) {
+	key = decsync_json_buffer (DECSYNC_JSON_BUFFER_KEY);
+	value = decsync_json_buffer (DECSYNC_JSON_BUFFER_VALUE);
+	if (decsync_json_decode (key_string, key) == DECSYNC_JSON_INVALID) {
 		g_warning ("Invalid JSON for info key: %s", key_string);
-		g_error_free (error);
 		return;
 	}
-	value_node = json_from_string (value_string, &error);
-	if (error != NULL) {
+	value_type = decsync_json_decode (value_string, value);
+	if (value_type != DECSYNC_JSON_NULL && value_type != DECSYNC_JSON_STRING) {
 		g_warning ("Invalid JSON for info value: %s", value_string);
-		json_node_free (key_node);
-		g_error_free (error);
 		return;
 	}
 	if (len != 1) {
@@ -3903,14 +6910,26 @@ resourcesListener (const gchar **path, int len, const char *datetime, const char
 		return;
 	}
 	uid = path[0];
-	if (json_node_is_null (value_node)) {
+	if (value_type == DECSYNC_JSON_NULL) {
 		removeEvent(uid, extra);
 	} else {
-		ical = json_node_get_string (value_node);
-		updateEvent(uid, ical, extra);
+		updateEvent(uid, value->str, extra);
+	}
+}
+
+static const gchar *
+ecal_backend_decsync_get_sync_type (ECalBackend *backend)
+{
+	switch (e_cal_backend_get_kind (backend)) {
+		default:
+			g_warn_if_reached ();
+		case I_CAL_VEVENT_COMPONENT:
+			return "calendars";
+		case I_CAL_VTODO_COMPONENT:
+			return "tasks";
+		case I_CAL_VJOURNAL_COMPONENT:
+			return "memos";
 	}
-	json_node_free (key_node);
-	json_node_free (value_node);
 }
 
 static gboolean
@@ -3918,28 +6937,14 @@ getDecsyncFromSource (ECalBackendDecsyncPrivate *priv, ECalBackend *backend)
 {
 	ESource *source;
 	ESourceDecsync *decsync_extension;
-	ICalComponentKind kind;
 	const gchar *extension_name, *decsync_dir, *sync_type, *collection, *appid, *path[1];
 	int error;
 
-	kind = e_cal_backend_get_kind (backend);
 	source = e_backend_get_source (E_BACKEND (backend));
 	extension_name = E_SOURCE_EXTENSION_DECSYNC_BACKEND;
 	decsync_extension = e_source_get_extension (source, extension_name);
 	decsync_dir = e_source_decsync_get_decsync_dir (decsync_extension);
-	switch (kind) {
-		default:
-			g_warn_if_reached ();
-		case I_CAL_VEVENT_COMPONENT:
-			sync_type = "calendars";
-			break;
-		case I_CAL_VTODO_COMPONENT:
-			sync_type = "tasks";
-			break;
-		case I_CAL_VJOURNAL_COMPONENT:
-			sync_type = "memos";
-			break;
-	}
+	sync_type = ecal_backend_decsync_get_sync_type (backend);
 	collection = e_source_decsync_get_collection (decsync_extension);
 	appid = e_source_decsync_get_appid (decsync_extension);
 	error = decsync_new (&priv->decsync, decsync_dir, sync_type, collection, appid);
@@ -3954,28 +6959,210 @@ getDecsyncFromSource (ECalBackendDecsyncPrivate *priv, ECalBackend *backend)
 	return TRUE;
 }
 
+/* Returns the fingerprint of the entries of the other apps, or NULL */
+static gchar *
+ecal_backend_decsync_compute_sync_state (ECalBackendDecsync *cbfile)
+{
+	ESource *source;
+	ESourceDecsync *decsync_extension;
+
+	source = e_backend_get_source (E_BACKEND (cbfile));
+	decsync_extension = e_source_get_extension (source, E_SOURCE_EXTENSION_DECSYNC_BACKEND);
+
+	return decsync_fingerprint_compute (
+		e_source_decsync_get_decsync_dir (decsync_extension),
+		ecal_backend_decsync_get_sync_type (E_CAL_BACKEND (cbfile)),
+		e_source_decsync_get_collection (decsync_extension),
+		e_source_decsync_get_appid (decsync_extension));
+}
+
+/* Returns whether the collection did not change since it was last read */
+static gboolean
+ecal_backend_decsync_sync_state_unchanged (ECalBackendDecsync *cbfile,
+                                           const gchar *sync_state)
+{
+	ECalBackendDecsyncPrivate *priv;
+	gboolean unchanged;
+
+	priv = cbfile->priv;
+
+	if (!sync_state)
+		return FALSE;
+
+	g_rec_mutex_lock (&priv->idle_save_rmutex);
+
+	if (!priv->sync_state_loaded) {
+		gchar *filename;
+
+		filename = g_build_filename (e_cal_backend_get_cache_dir (E_CAL_BACKEND (cbfile)), SYNC_STATE_FILE_NAME, NULL);
+		if (!g_file_get_contents (filename, &priv->sync_state, NULL, NULL))
+			priv->sync_state = NULL;
+		g_free (filename);
+
+		priv->sync_state_loaded = TRUE;
+	}
+
+	unchanged = g_strcmp0 (priv->sync_state, sync_state) == 0;
+
+	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+
+	return unchanged;
+}
+
+static void
+ecal_backend_decsync_store_sync_state (ECalBackendDecsync *cbfile,
+                                       const gchar *sync_state)
+{
+	ECalBackendDecsyncPrivate *priv;
+	const gchar *cache_dir;
+	gchar *filename;
+	GError *local_error = NULL;
+
+	priv = cbfile->priv;
+
+	g_rec_mutex_lock (&priv->idle_save_rmutex);
+
+	g_free (priv->sync_state);
+	priv->sync_state = g_strdup (sync_state);
+	priv->sync_state_loaded = TRUE;
+
+	cache_dir = e_cal_backend_get_cache_dir (E_CAL_BACKEND (cbfile));
+	filename = g_build_filename (cache_dir, SYNC_STATE_FILE_NAME, NULL);
+	if (!sync_state) {
+		g_unlink (filename);
+	} else if (g_mkdir_with_parents (cache_dir, 0700) != 0 ||
+		   !g_file_set_contents (filename, sync_state, -1, &local_error)) {
+		g_warning ("Cannot save DecSync sync state: %s", local_error ? local_error->message : g_strerror (errno));
+		g_clear_error (&local_error);
+	}
+	g_free (filename);
+
+	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+}
+
+/* Reads the new entries, unless @sync_state shows nothing changed since
+ * the last time. The fingerprint is taken before reading, so anything
+ * written meanwhile is read again the next time. */
+static void
+ecal_backend_decsync_read_new_entries (ECalBackendDecsync *cbfile,
+                                       const gchar *sync_state)
+{
+	Extra extra;
+
+	/* Picked up once the calendar file is read, see load_finish() */
+	g_rec_mutex_lock (&cbfile->priv->idle_save_rmutex);
+	if (is_loading (cbfile)) {
+		cbfile->priv->refresh_pending = TRUE;
+		g_rec_mutex_unlock (&cbfile->priv->idle_save_rmutex);
+		return;
+	}
+	g_rec_mutex_unlock (&cbfile->priv->idle_save_rmutex);
+
+	g_mutex_lock (&cbfile->priv->refresh_lock);
+
+	if (!ecal_backend_decsync_sync_state_unchanged (cbfile, sync_state)) {
+		extra = (Extra) {E_CAL_BACKEND (cbfile), g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free)};
+		decsync_execute_all_new_entries (cbfile->priv->decsync, &extra);
+		ecal_backend_decsync_apply_resources (cbfile, extra.resources);
+		g_hash_table_destroy (extra.resources);
+
+		ecal_backend_decsync_store_sync_state (cbfile, sync_state);
+	}
+
+	g_mutex_unlock (&cbfile->priv->refresh_lock);
+}
+
+static void
+ecal_backend_decsync_refresh (ECalBackendDecsync *cbfile)
+{
+	gchar *sync_state;
+
+	sync_state = ecal_backend_decsync_compute_sync_state (cbfile);
+	ecal_backend_decsync_read_new_entries (cbfile, sync_state);
+	g_free (sync_state);
+}
+
+static void
+ecal_backend_decsync_refresh_thread_cb (gpointer data,
+                                        gpointer user_data)
+{
+	ECalBackendDecsync *cbfile = data;
+
+	/* Changes from now on need another refresh */
+	g_atomic_int_set (&cbfile->priv->refresh_queued, FALSE);
+
+	ecal_backend_decsync_refresh (cbfile);
+
+	g_object_unref (cbfile);
+}
+
+/* The pool is shared by all the calendars of the process */
+static GThreadPool *
+refresh_pool_get (void)
+{
+	static GThreadPool *pool = NULL;
+
+	if (g_once_init_enter (&pool)) {
+		GThreadPool *new_pool;
+
+		new_pool = g_thread_pool_new (ecal_backend_decsync_refresh_thread_cb, NULL, g_get_num_processors (), FALSE, NULL);
+		g_once_init_leave (&pool, new_pool);
+	}
+
+	return pool;
+}
+
+/* Called by the watcher from the main loop, and once the calendar is
+ * loaded when a refresh was requested meanwhile. Taking the fingerprint
+ * walks the collection directory, so the refresh is done in the refresh
+ * pool, like the scheduler does; a refresh which is still waiting there
+ * covers the changes of this call as well. */
 static gboolean
 ecal_backend_decsync_refresh_cb (gpointer backend)
 {
 	ECalBackendDecsync *cbfile;
-	Extra extra;
 
 	cbfile = E_CAL_BACKEND_DECSYNC (backend);
-	extra = (Extra) {backend};
-	decsync_execute_all_new_entries (cbfile->priv->decsync, &extra);
+
+	if (g_atomic_int_compare_and_exchange (&cbfile->priv->refresh_queued, FALSE, TRUE))
+		g_thread_pool_push (refresh_pool_get (), g_object_ref (cbfile), NULL);
+
 	return TRUE;
 }
 
+/* Called by the scheduler, which already took the fingerprint */
+static void
+ecal_backend_decsync_scheduled_refresh_cb (const gchar *sync_state,
+                                           gpointer backend)
+{
+	ecal_backend_decsync_read_new_entries (E_CAL_BACKEND_DECSYNC (backend), sync_state);
+}
+
 static gboolean
 ecal_backend_decsync_refresh_start (ECalBackendDecsync *cbfile)
 {
 	ESource *source;
 	ESourceRefresh *extension;
+	ESourceDecsync *decsync_extension;
 	const gchar *extension_name;
 	guint interval_in_minutes = 0;
 
 	source = e_backend_get_source (E_BACKEND (cbfile));
 
+	/* Changes made by other apps are picked up as soon as they land in the
+	 * DecSync directory; the periodic refresh below stays as a fallback for
+	 * file systems without change notification. */
+	extension_name = E_SOURCE_EXTENSION_DECSYNC_BACKEND;
+	decsync_extension = e_source_get_extension (source, extension_name);
+	if (e_source_decsync_get_watch_changes (decsync_extension) && !cbfile->priv->watcher) {
+		cbfile->priv->watcher = decsync_watcher_new (
+			e_source_decsync_get_decsync_dir (decsync_extension),
+			ecal_backend_decsync_get_sync_type (E_CAL_BACKEND (cbfile)),
+			e_source_decsync_get_collection (decsync_extension),
+			e_source_decsync_get_appid (decsync_extension),
+			ecal_backend_decsync_refresh_cb, cbfile);
+	}
+
 	extension_name = E_SOURCE_EXTENSION_REFRESH;
 	extension = e_source_get_extension (source, extension_name);
 
@@ -3985,8 +7172,16 @@ ecal_backend_decsync_refresh_start (ECalBackendDecsync *cbfile)
 			interval_in_minutes = 30;
 	}
 
-	if (interval_in_minutes > 0) {
-		e_named_timeout_add_seconds (interval_in_minutes * 60, ecal_backend_decsync_refresh_cb, cbfile);
+	/* Shared with the other collections of the DecSync directory, so it
+	 * is scanned once per tick for all of them */
+	if (interval_in_minutes > 0 && !cbfile->priv->scheduler_id) {
+		cbfile->priv->scheduler_id = decsync_scheduler_add (
+			e_source_decsync_get_decsync_dir (decsync_extension),
+			ecal_backend_decsync_get_sync_type (E_CAL_BACKEND (cbfile)),
+			e_source_decsync_get_collection (decsync_extension),
+			e_source_decsync_get_appid (decsync_extension),
+			interval_in_minutes * 60,
+			ecal_backend_decsync_scheduled_refresh_cb, cbfile);
 	}
 	return FALSE;
 }
@@ -3997,7 +7192,10 @@ ecal_backend_decsync_refresh_sync (ECalBackendSync *backend,
                                  GCancellable *cancellable,
                                  GError **error)
 {
-	ecal_backend_decsync_refresh_cb (backend);
+	wait_for_load (E_CAL_BACKEND_DECSYNC (backend));
+
+	/* Already in a thread of its own */
+	ecal_backend_decsync_refresh (E_CAL_BACKEND_DECSYNC (backend));
 }
 
 static gboolean
@@ -4067,13 +7265,34 @@ e_cal_backend_decsync_initable_init (GInitableIface *iface)
 static void
 e_cal_backend_decsync_init (ECalBackendDecsync *cbfile)
 {
+	guint ii;
+
 	cbfile->priv = e_cal_backend_decsync_get_instance_private (cbfile);
 
 	cbfile->priv->file_name = g_strdup ("calendar.ics");
 
 	g_rec_mutex_init (&cbfile->priv->idle_save_rmutex);
+	g_mutex_init (&cbfile->priv->save_lock);
+	g_cond_init (&cbfile->priv->save_cond);
+	g_rw_lock_init (&cbfile->priv->data_lock);
+	for (ii = 0; ii < COMP_LOCK_STRIPES; ii++)
+		g_mutex_init (&cbfile->priv->comp_locks[ii]);
+	g_mutex_init (&cbfile->priv->vcalendar_lock);
+	g_mutex_init (&cbfile->priv->load_lock);
+	g_cond_init (&cbfile->priv->load_cond);
+	g_mutex_init (&cbfile->priv->refresh_lock);
+	g_mutex_init (&cbfile->priv->free_busy_lock);
+	g_mutex_init (&cbfile->priv->strings_lock);
+	g_mutex_init (&cbfile->priv->query_cache_lock);
+	cbfile->priv->query_cache_index = g_hash_table_new (g_str_hash, g_str_equal);
 
 	cbfile->priv->cached_timezones = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+	cbfile->priv->populating_views = g_hash_table_new (g_direct_hash, g_direct_equal);
+	cbfile->priv->journal_uids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	cbfile->priv->digests = decsync_digests_new ();
+
+	cbfile->priv->save_delay = save_delay_from_env ("DECSYNC_SAVE_DELAY_MS", SAVE_DELAY_MS);
+	cbfile->priv->save_max_delay = save_delay_from_env ("DECSYNC_SAVE_MAX_DELAY_MS", SAVE_MAX_DELAY_MS);
 }
 
 void
@@ -4087,14 +7306,14 @@ e_cal_backend_decsync_set_file_name (ECalBackendDecsync *cbfile,
 	g_return_if_fail (file_name != NULL);
 
 	priv = cbfile->priv;
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	data_write_lock (cbfile);
 
 	if (priv->file_name)
 		g_free (priv->file_name);
 
 	priv->file_name = g_strdup (file_name);
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_write_unlock (cbfile);
 }
 
 const gchar *
@@ -4119,6 +7338,7 @@ test_query_by_scanning_all_objects (ECalBackendDecsync *cbfile,
 {
 	MatchObjectData match_data;
 	ECalBackendDecsyncPrivate *priv;
+	gboolean locked;
 
 	priv = cbfile->priv;
 
@@ -4135,7 +7355,7 @@ test_query_by_scanning_all_objects (ECalBackendDecsync *cbfile,
 	if (!match_data.obj_sexp)
 		return;
 
-	g_rec_mutex_lock (&priv->idle_save_rmutex);
+	locked = data_read_lock (cbfile);
 
 	if (!match_data.obj_sexp)
 	{
@@ -4146,7 +7366,7 @@ test_query_by_scanning_all_objects (ECalBackendDecsync *cbfile,
 	g_hash_table_foreach (priv->comp_uid_hash, (GHFunc) match_object_sexp,
 			&match_data);
 
-	g_rec_mutex_unlock (&priv->idle_save_rmutex);
+	data_read_unlock (cbfile, locked);
 
 	*objects = g_slist_reverse (match_data.comps_list);
 
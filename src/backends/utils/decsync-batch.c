@@ -0,0 +1,185 @@
+/**
+ * Evolution-DecSync - decsync-batch.c
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "evolution-decsync-config.h"
+
+#include "decsync-batch.h"
+#include "decsync-json.h"
+
+/* Collects the entries written by one operation, so they can be written
+ * once the backend's locks are released. Entries are grouped by path,
+ * and only the last value set for a key of a path is written.
+ *
+ * libdecsync 2.0.1 has no call taking several entries, and its files may
+ * only be written through it, so each remaining entry is still a write
+ * of its own; what is saved are the overwritten entries and the time the
+ * locks are held. */
+
+typedef struct {
+	gchar **path;
+	gint len;
+	GHashTable *values; /* gchar *key -> gchar *value, both JSON */
+	GPtrArray *keys; /* gchar *, in the order they were first set */
+} DecsyncBatchGroup;
+
+struct _DecsyncBatch {
+	GHashTable *groups; /* gchar *joined path -> DecsyncBatchGroup * */
+	GPtrArray *order; /* DecsyncBatchGroup *, in the order they were added */
+	guint size;
+};
+
+static void
+batch_group_free (gpointer data)
+{
+	DecsyncBatchGroup *group = data;
+
+	g_strfreev (group->path);
+	g_hash_table_destroy (group->values);
+	g_ptr_array_free (group->keys, TRUE);
+	g_free (group);
+}
+
+DecsyncBatch *
+decsync_batch_new (void)
+{
+	DecsyncBatch *batch;
+
+	batch = g_new0 (DecsyncBatch, 1);
+	batch->groups = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	batch->order = g_ptr_array_new_with_free_func (batch_group_free);
+
+	return batch;
+}
+
+void
+decsync_batch_free (DecsyncBatch *batch)
+{
+	if (!batch)
+		return;
+
+	g_hash_table_destroy (batch->groups);
+	g_ptr_array_free (batch->order, TRUE);
+	g_free (batch);
+}
+
+/* Sets the entry @key of @path to @value, both encoded as JSON like for
+ * decsync_set_entry() */
+void
+decsync_batch_set_entry (DecsyncBatch *batch,
+                         const gchar **path,
+                         gint len,
+                         const gchar *key,
+                         const gchar *value)
+{
+	DecsyncBatchGroup *group;
+	GString *str;
+	gchar *joined;
+	gint ii;
+
+	g_return_if_fail (batch != NULL);
+	g_return_if_fail (path != NULL);
+	g_return_if_fail (key != NULL);
+	g_return_if_fail (value != NULL);
+
+	/* Path segments are file names, so they cannot contain a slash */
+	str = g_string_new (NULL);
+	for (ii = 0; ii < len; ii++) {
+		if (ii)
+			g_string_append_c (str, '/');
+		g_string_append (str, path[ii]);
+	}
+	joined = g_string_free (str, FALSE);
+
+	group = g_hash_table_lookup (batch->groups, joined);
+	if (!group) {
+		group = g_new0 (DecsyncBatchGroup, 1);
+		group->path = g_new0 (gchar *, len + 1);
+		for (ii = 0; ii < len; ii++)
+			group->path[ii] = g_strdup (path[ii]);
+		group->len = len;
+		group->values = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+		group->keys = g_ptr_array_new ();
+
+		g_hash_table_insert (batch->groups, joined, group);
+		g_ptr_array_add (batch->order, group);
+	} else {
+		g_free (joined);
+	}
+
+	if (!g_hash_table_contains (group->values, key)) {
+		gchar *key_copy = g_strdup (key);
+
+		g_ptr_array_add (group->keys, key_copy);
+		g_hash_table_insert (group->values, key_copy, g_strdup (value));
+		batch->size++;
+	} else {
+		/* Keeps the existing key, which is referenced by group->keys */
+		g_hash_table_insert (group->values, g_strdup (key), g_strdup (value));
+	}
+}
+
+/* Sets the resource @uid to @data, or marks it as removed when @data is NULL */
+void
+decsync_batch_set_resource (DecsyncBatch *batch,
+                            const gchar *uid,
+                            const gchar *data)
+{
+	const gchar *path[2];
+
+	g_return_if_fail (uid != NULL);
+
+	path[0] = "resources";
+	path[1] = uid;
+
+	decsync_batch_set_entry (batch, path, 2, "null",
+		decsync_json_encode_string (decsync_json_buffer (DECSYNC_JSON_BUFFER_VALUE), data));
+}
+
+guint
+decsync_batch_get_size (DecsyncBatch *batch)
+{
+	g_return_val_if_fail (batch != NULL, 0);
+
+	return batch->size;
+}
+
+/* Writes the collected entries, one decsync_set_entry() call per entry,
+ * path by path, and empties @batch */
+void
+decsync_batch_flush (DecsyncBatch *batch,
+                     Decsync decsync)
+{
+	guint ii, jj;
+
+	g_return_if_fail (batch != NULL);
+
+	for (ii = 0; ii < batch->order->len; ii++) {
+		DecsyncBatchGroup *group = g_ptr_array_index (batch->order, ii);
+
+		for (jj = 0; jj < group->keys->len; jj++) {
+			const gchar *key = g_ptr_array_index (group->keys, jj);
+
+			decsync_set_entry (decsync, (const gchar **) group->path, group->len,
+				key, g_hash_table_lookup (group->values, key));
+		}
+	}
+
+	g_hash_table_remove_all (batch->groups);
+	g_ptr_array_set_size (batch->order, 0);
+	batch->size = 0;
+}
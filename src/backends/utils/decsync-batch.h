@@ -0,0 +1,45 @@
+/**
+ * Evolution-DecSync - decsync-batch.h
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECSYNC_BATCH_H
+#define DECSYNC_BATCH_H
+
+#include <glib.h>
+#include <libdecsync.h>
+
+G_BEGIN_DECLS
+
+typedef struct _DecsyncBatch DecsyncBatch;
+
+DecsyncBatch *	decsync_batch_new		(void);
+void		decsync_batch_free		(DecsyncBatch *batch);
+void		decsync_batch_set_entry		(DecsyncBatch *batch,
+						 const gchar **path,
+						 gint len,
+						 const gchar *key,
+						 const gchar *value);
+void		decsync_batch_set_resource	(DecsyncBatch *batch,
+						 const gchar *uid,
+						 const gchar *data);
+guint		decsync_batch_get_size		(DecsyncBatch *batch);
+void		decsync_batch_flush		(DecsyncBatch *batch,
+						 Decsync decsync);
+
+G_END_DECLS
+
+#endif /* DECSYNC_BATCH_H */
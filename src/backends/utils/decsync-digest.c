@@ -0,0 +1,296 @@
+/**
+ * Evolution-DecSync - decsync-digest.c
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "evolution-decsync-config.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "decsync-digest.h"
+
+/* The digest of a resource is the 64-bit FNV-1a hash of the raw value
+ * received from or written to DecSync. It is only used to recognize a
+ * value which was seen before, so it does not need to be cryptographic. */
+
+#define FNV_OFFSET_BASIS G_GUINT64_CONSTANT (0xcbf29ce484222325)
+#define FNV_PRIME        G_GUINT64_CONSTANT (0x100000001b3)
+
+struct _DecsyncDigests {
+	GHashTable *table; /* gchar *uid -> guint64 * */
+	gboolean dirty;
+};
+
+static guint64 *
+digest_dup (guint64 digest)
+{
+	guint64 *copy = g_new (guint64, 1);
+
+	*copy = digest;
+
+	return copy;
+}
+
+guint64
+decsync_digest_compute (const gchar *data)
+{
+	const guchar *ptr;
+	guint64 hash = FNV_OFFSET_BASIS;
+
+	g_return_val_if_fail (data != NULL, 0);
+
+	for (ptr = (const guchar *) data; *ptr; ptr++) {
+		hash ^= *ptr;
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+gchar *
+decsync_digest_to_string (guint64 digest)
+{
+	return g_strdup_printf ("%016" G_GINT64_MODIFIER "x", digest);
+}
+
+gboolean
+decsync_digest_from_string (const gchar *str,
+                            guint64 *out_digest)
+{
+	gchar *end = NULL;
+
+	g_return_val_if_fail (out_digest != NULL, FALSE);
+
+	if (!str || strlen (str) != 16)
+		return FALSE;
+
+	*out_digest = g_ascii_strtoull (str, &end, 16);
+
+	return end && *end == '\0';
+}
+
+DecsyncDigests *
+decsync_digests_new (void)
+{
+	DecsyncDigests *digests;
+
+	digests = g_new0 (DecsyncDigests, 1);
+	digests->table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	return digests;
+}
+
+void
+decsync_digests_free (DecsyncDigests *digests)
+{
+	if (!digests)
+		return;
+
+	g_hash_table_destroy (digests->table);
+	g_free (digests);
+}
+
+/* Returns whether @digest is the one stored for @uid */
+gboolean
+decsync_digests_matches (DecsyncDigests *digests,
+                         const gchar *uid,
+                         guint64 digest)
+{
+	const guint64 *stored;
+
+	g_return_val_if_fail (digests != NULL, FALSE);
+	g_return_val_if_fail (uid != NULL, FALSE);
+
+	stored = g_hash_table_lookup (digests->table, uid);
+
+	return stored && *stored == digest;
+}
+
+/* Sets the digest stored for @uid to @out_digest, if any */
+gboolean
+decsync_digests_lookup (DecsyncDigests *digests,
+                        const gchar *uid,
+                        guint64 *out_digest)
+{
+	const guint64 *stored;
+
+	g_return_val_if_fail (digests != NULL, FALSE);
+	g_return_val_if_fail (uid != NULL, FALSE);
+	g_return_val_if_fail (out_digest != NULL, FALSE);
+
+	stored = g_hash_table_lookup (digests->table, uid);
+	if (!stored)
+		return FALSE;
+
+	*out_digest = *stored;
+
+	return TRUE;
+}
+
+void
+decsync_digests_set (DecsyncDigests *digests,
+                     const gchar *uid,
+                     guint64 digest)
+{
+	g_return_if_fail (digests != NULL);
+	g_return_if_fail (uid != NULL);
+
+	if (decsync_digests_matches (digests, uid, digest))
+		return;
+
+	g_hash_table_insert (digests->table, g_strdup (uid), digest_dup (digest));
+	digests->dirty = TRUE;
+}
+
+void
+decsync_digests_remove (DecsyncDigests *digests,
+                        const gchar *uid)
+{
+	g_return_if_fail (digests != NULL);
+	g_return_if_fail (uid != NULL);
+
+	if (g_hash_table_remove (digests->table, uid))
+		digests->dirty = TRUE;
+}
+
+void
+decsync_digests_clear (DecsyncDigests *digests)
+{
+	g_return_if_fail (digests != NULL);
+
+	if (g_hash_table_size (digests->table) > 0)
+		digests->dirty = TRUE;
+	g_hash_table_remove_all (digests->table);
+}
+
+/* Reads the digests saved by decsync_digests_save(), replacing the
+ * current ones. A missing file, or one saved with another @tag than
+ * the given one, leaves no digests. */
+gboolean
+decsync_digests_load (DecsyncDigests *digests,
+                      const gchar *filename,
+                      const gchar *tag,
+                      GError **error)
+{
+	gchar *contents = NULL, *line, *next;
+	GError *local_error = NULL;
+
+	g_return_val_if_fail (digests != NULL, FALSE);
+	g_return_val_if_fail (filename != NULL, FALSE);
+
+	g_hash_table_remove_all (digests->table);
+	digests->dirty = FALSE;
+
+	if (!g_file_get_contents (filename, &contents, NULL, &local_error)) {
+		if (g_error_matches (local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+			g_clear_error (&local_error);
+			return TRUE;
+		}
+
+		g_propagate_error (error, local_error);
+		return FALSE;
+	}
+
+	line = contents;
+
+	/* Saved along with some other data, whose tag comes first */
+	if (tag) {
+		gchar *header;
+		gboolean matches;
+
+		header = g_strdup_printf ("tag %s\n", tag);
+		matches = g_str_has_prefix (contents, header);
+		line = contents + strlen (header);
+		g_free (header);
+
+		if (!matches) {
+			g_free (contents);
+			return TRUE;
+		}
+	}
+
+	/* One "<digest> <uid>" per line */
+	for (; line && *line; line = next) {
+		guint64 digest;
+
+		next = strchr (line, '\n');
+		if (next)
+			*next++ = '\0';
+
+		if (strlen (line) < 18 || line[16] != ' ')
+			continue;
+
+		line[16] = '\0';
+		if (decsync_digest_from_string (line, &digest))
+			g_hash_table_insert (digests->table, g_strdup (line + 17), digest_dup (digest));
+	}
+
+	g_free (contents);
+
+	return TRUE;
+}
+
+/* Writes the digests to @filename, when they changed since the last
+ * load or save or when a @tag is given. The @tag identifies the data
+ * the digests belong to, see decsync_digests_load(). */
+gboolean
+decsync_digests_save (DecsyncDigests *digests,
+                      const gchar *filename,
+                      const gchar *tag,
+                      GError **error)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	GString *contents;
+	gboolean success;
+
+	g_return_val_if_fail (digests != NULL, FALSE);
+	g_return_val_if_fail (filename != NULL, FALSE);
+
+	if (!digests->dirty && !tag)
+		return TRUE;
+
+	if (g_hash_table_size (digests->table) == 0) {
+		g_unlink (filename);
+		digests->dirty = FALSE;
+		return TRUE;
+	}
+
+	contents = g_string_sized_new (g_hash_table_size (digests->table) * 64);
+
+	if (tag)
+		g_string_append_printf (contents, "tag %s\n", tag);
+
+	g_hash_table_iter_init (&iter, digests->table);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		const gchar *uid = key;
+
+		/* Cannot be stored in the line based file, thus never skipped */
+		if (strchr (uid, '\n'))
+			continue;
+
+		g_string_append_printf (contents, "%016" G_GINT64_MODIFIER "x %s\n", *((guint64 *) value), uid);
+	}
+
+	success = g_file_set_contents (filename, contents->str, contents->len, error);
+	if (success)
+		digests->dirty = FALSE;
+
+	g_string_free (contents, TRUE);
+
+	return success;
+}
@@ -0,0 +1,63 @@
+/**
+ * Evolution-DecSync - decsync-digest.h
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECSYNC_DIGEST_H
+#define DECSYNC_DIGEST_H
+
+#include <glib.h>
+
+/* Backend property with the number of incoming DecSync entries which
+ * were skipped because they did not change the resource */
+#define DECSYNC_BACKEND_PROPERTY_SKIPPED_ENTRIES "decsync-skipped-entries"
+
+G_BEGIN_DECLS
+
+typedef struct _DecsyncDigests DecsyncDigests;
+
+guint64		decsync_digest_compute		(const gchar *data);
+gchar *		decsync_digest_to_string	(guint64 digest);
+gboolean	decsync_digest_from_string	(const gchar *str,
+						 guint64 *out_digest);
+
+DecsyncDigests *
+		decsync_digests_new		(void);
+void		decsync_digests_free		(DecsyncDigests *digests);
+gboolean	decsync_digests_matches		(DecsyncDigests *digests,
+						 const gchar *uid,
+						 guint64 digest);
+gboolean	decsync_digests_lookup		(DecsyncDigests *digests,
+						 const gchar *uid,
+						 guint64 *out_digest);
+void		decsync_digests_set		(DecsyncDigests *digests,
+						 const gchar *uid,
+						 guint64 digest);
+void		decsync_digests_remove		(DecsyncDigests *digests,
+						 const gchar *uid);
+void		decsync_digests_clear		(DecsyncDigests *digests);
+gboolean	decsync_digests_load		(DecsyncDigests *digests,
+						 const gchar *filename,
+						 const gchar *tag,
+						 GError **error);
+gboolean	decsync_digests_save		(DecsyncDigests *digests,
+						 const gchar *filename,
+						 const gchar *tag,
+						 GError **error);
+
+G_END_DECLS
+
+#endif /* DECSYNC_DIGEST_H */
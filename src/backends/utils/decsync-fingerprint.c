@@ -0,0 +1,158 @@
+/**
+ * Evolution-DecSync - decsync-fingerprint.c
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "evolution-decsync-config.h"
+
+#include <gio/gio.h>
+
+#include "decsync-digest.h"
+#include "decsync-fingerprint.h"
+
+/* The fingerprint of a collection sums up the name, size and modification
+ * time of every file written by the other apps. Entries are only ever
+ * added by writing files, so as long as the fingerprint stays the same
+ * there is nothing new to read, and the directory does not have to be
+ * scanned by libdecsync. Only the metadata is read, never the contents. */
+
+/* Deeper than any of the new-entries/<app-id>/<path> and
+ * v2/<app-id>/<hash> layouts */
+#define MAX_DEPTH 8
+
+typedef struct {
+	const gchar *own_app_id;
+	guint64 sum;
+	guint n_files;
+} FingerprintData;
+
+static gboolean
+fingerprint_add_directory (FingerprintData *data,
+                           GFile *dir,
+                           const gchar *relative_path,
+                           gint depth)
+{
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GError *local_error = NULL;
+
+	if (depth > MAX_DEPTH)
+		return TRUE;
+
+	enumerator = g_file_enumerate_children (
+		dir,
+		G_FILE_ATTRIBUTE_STANDARD_NAME ","
+		G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+		G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+		G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+		G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+		G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+		NULL, &local_error);
+	if (!enumerator) {
+		/* A collection nobody wrote to yet */
+		if (depth == 0 && g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+			g_clear_error (&local_error);
+			return TRUE;
+		}
+
+		g_clear_error (&local_error);
+		return FALSE;
+	}
+
+	while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL) {
+		const gchar *name = g_file_info_get_name (info);
+		gchar *child_path;
+
+		/* Our own entries are not read back */
+		if (g_strcmp0 (name, data->own_app_id) == 0) {
+			g_object_unref (info);
+			continue;
+		}
+
+		child_path = relative_path ? g_build_filename (relative_path, name, NULL) : g_strdup (name);
+
+		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+			GFile *child;
+			gboolean success;
+
+			child = g_file_get_child (dir, name);
+			success = fingerprint_add_directory (data, child, child_path, depth + 1);
+			g_object_unref (child);
+
+			if (!success) {
+				g_free (child_path);
+				g_object_unref (info);
+				g_object_unref (enumerator);
+				return FALSE;
+			}
+		} else {
+			gchar *line;
+
+			/* Summed, so the order of the enumeration does not matter */
+			line = g_strdup_printf ("%s\n%" G_GUINT64_FORMAT "\n%" G_GUINT64_FORMAT "\n%u",
+				child_path,
+				(guint64) g_file_info_get_size (info),
+				g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+				g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC));
+			data->sum += decsync_digest_compute (line);
+			data->n_files++;
+			g_free (line);
+		}
+
+		g_free (child_path);
+		g_object_unref (info);
+	}
+
+	g_object_unref (enumerator);
+
+	return TRUE;
+}
+
+/* Returns the fingerprint of the entries of the other apps in the
+ * collection, or NULL when it cannot be determined */
+gchar *
+decsync_fingerprint_compute (const gchar *decsync_dir,
+                             const gchar *sync_type,
+                             const gchar *collection,
+                             const gchar *own_app_id)
+{
+	FingerprintData data;
+	GFile *root;
+	gchar *root_path;
+	gboolean success;
+
+	g_return_val_if_fail (decsync_dir != NULL, NULL);
+	g_return_val_if_fail (sync_type != NULL, NULL);
+
+	if (collection && *collection)
+		root_path = g_build_filename (decsync_dir, sync_type, collection, NULL);
+	else
+		root_path = g_build_filename (decsync_dir, sync_type, NULL);
+
+	data.own_app_id = own_app_id;
+	data.sum = 0;
+	data.n_files = 0;
+
+	root = g_file_new_for_path (root_path);
+	success = fingerprint_add_directory (&data, root, NULL, 0);
+	g_object_unref (root);
+	g_free (root_path);
+
+	if (!success)
+		return NULL;
+
+	return g_strdup_printf ("%u-%016" G_GINT64_MODIFIER "x", data.n_files, data.sum);
+}
@@ -0,0 +1,33 @@
+/**
+ * Evolution-DecSync - decsync-fingerprint.h
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECSYNC_FINGERPRINT_H
+#define DECSYNC_FINGERPRINT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gchar *		decsync_fingerprint_compute	(const gchar *decsync_dir,
+						 const gchar *sync_type,
+						 const gchar *collection,
+						 const gchar *own_app_id);
+
+G_END_DECLS
+
+#endif /* DECSYNC_FINGERPRINT_H */
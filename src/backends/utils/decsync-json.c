@@ -0,0 +1,309 @@
+/**
+ * Evolution-DecSync - decsync-json.c
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "evolution-decsync-config.h"
+
+#include <string.h>
+#include <json-glib/json-glib.h>
+
+#include "decsync-json.h"
+
+/* DecSync keys and values are JSON scalars: the key is null or a short
+ * string, the value is null, a boolean or a (possibly large) string.
+ * Those are handled here directly, without building a JsonNode and a
+ * generator or parser for each of them. Anything else is left to
+ * json-glib. */
+
+static void
+json_buffers_free (gpointer data)
+{
+	GString **buffers = data;
+	guint ii;
+
+	for (ii = 0; ii < DECSYNC_JSON_N_BUFFERS; ii++)
+		g_string_free (buffers[ii], TRUE);
+	g_free (buffers);
+}
+
+static GPrivate json_buffers = G_PRIVATE_INIT (json_buffers_free);
+
+/* Returns a buffer owned by the calling thread, to be reused between
+ * calls instead of allocating a new string for every entry */
+GString *
+decsync_json_buffer (guint index)
+{
+	GString **buffers;
+
+	g_return_val_if_fail (index < DECSYNC_JSON_N_BUFFERS, NULL);
+
+	buffers = g_private_get (&json_buffers);
+	if (!buffers) {
+		guint ii;
+
+		buffers = g_new (GString *, DECSYNC_JSON_N_BUFFERS);
+		for (ii = 0; ii < DECSYNC_JSON_N_BUFFERS; ii++)
+			buffers[ii] = g_string_sized_new (256);
+		g_private_set (&json_buffers, buffers);
+	}
+
+	return buffers[index];
+}
+
+/* Appends @str as a JSON string, or null when @str is NULL */
+void
+decsync_json_append_string (GString *out,
+                            const gchar *str)
+{
+	const gchar *ptr, *run;
+
+	if (!str) {
+		g_string_append (out, "null");
+		return;
+	}
+
+	g_string_append_c (out, '"');
+
+	for (ptr = run = str; *ptr; ptr++) {
+		guchar chr = *ptr;
+		const gchar *escaped;
+
+		switch (chr) {
+		case '"':
+			escaped = "\\\"";
+			break;
+		case '\\':
+			escaped = "\\\\";
+			break;
+		case '\b':
+			escaped = "\\b";
+			break;
+		case '\f':
+			escaped = "\\f";
+			break;
+		case '\n':
+			escaped = "\\n";
+			break;
+		case '\r':
+			escaped = "\\r";
+			break;
+		case '\t':
+			escaped = "\\t";
+			break;
+		default:
+			if (chr >= 0x20)
+				continue;
+			escaped = NULL;
+			break;
+		}
+
+		g_string_append_len (out, run, ptr - run);
+		if (escaped)
+			g_string_append (out, escaped);
+		else
+			g_string_append_printf (out, "\\u%04x", chr);
+		run = ptr + 1;
+	}
+
+	g_string_append_len (out, run, ptr - run);
+	g_string_append_c (out, '"');
+}
+
+/* Encodes @str into @buffer, replacing its contents, and returns the
+ * buffer's data */
+const gchar *
+decsync_json_encode_string (GString *buffer,
+                            const gchar *str)
+{
+	g_return_val_if_fail (buffer != NULL, NULL);
+
+	g_string_truncate (buffer, 0);
+	decsync_json_append_string (buffer, str);
+
+	return buffer->str;
+}
+
+static gint
+json_hex_value (const gchar *ptr)
+{
+	gint ii, value = 0;
+
+	for (ii = 0; ii < 4; ii++) {
+		gint digit = g_ascii_xdigit_value (ptr[ii]);
+
+		if (digit < 0)
+			return -1;
+		value = (value << 4) | digit;
+	}
+
+	return value;
+}
+
+/* Decodes the JSON string starting at the opening quote @ptr into @out.
+ * Returns the position after the closing quote, or NULL when the string
+ * is malformed. */
+static const gchar *
+json_decode_string (const gchar *ptr,
+                    GString *out)
+{
+	const gchar *run;
+
+	ptr++;
+	for (run = ptr; *ptr != '"'; ptr++) {
+		gunichar unichar;
+		gint value;
+
+		if (*ptr == '\0' || (guchar) *ptr < 0x20)
+			return NULL;
+		if (*ptr != '\\')
+			continue;
+
+		g_string_append_len (out, run, ptr - run);
+		ptr++;
+
+		switch (*ptr) {
+		case '"':
+		case '\\':
+		case '/':
+			g_string_append_c (out, *ptr);
+			break;
+		case 'b':
+			g_string_append_c (out, '\b');
+			break;
+		case 'f':
+			g_string_append_c (out, '\f');
+			break;
+		case 'n':
+			g_string_append_c (out, '\n');
+			break;
+		case 'r':
+			g_string_append_c (out, '\r');
+			break;
+		case 't':
+			g_string_append_c (out, '\t');
+			break;
+		case 'u':
+			value = json_hex_value (ptr + 1);
+			if (value < 0)
+				return NULL;
+			ptr += 4;
+			unichar = value;
+
+			/* Characters outside the BMP are escaped as a surrogate pair */
+			if (value >= 0xd800 && value < 0xdc00) {
+				gint low;
+
+				if (ptr[1] != '\\' || ptr[2] != 'u')
+					return NULL;
+				low = json_hex_value (ptr + 3);
+				if (low < 0xdc00 || low >= 0xe000)
+					return NULL;
+				ptr += 6;
+				unichar = 0x10000 + ((value - 0xd800) << 10) + (low - 0xdc00);
+			} else if (value >= 0xdc00 && value < 0xe000) {
+				return NULL;
+			}
+
+			g_string_append_unichar (out, unichar);
+			break;
+		default:
+			return NULL;
+		}
+
+		run = ptr + 1;
+	}
+
+	g_string_append_len (out, run, ptr - run);
+
+	return ptr + 1;
+}
+
+static DecsyncJsonType
+json_decode_fallback (const gchar *json,
+                      GString *out)
+{
+	JsonNode *node;
+	DecsyncJsonType type;
+
+	node = json_from_string (json, NULL);
+	if (!node)
+		return DECSYNC_JSON_INVALID;
+
+	if (JSON_NODE_HOLDS_NULL (node)) {
+		type = DECSYNC_JSON_NULL;
+	} else if (JSON_NODE_HOLDS_VALUE (node) && json_node_get_value_type (node) == G_TYPE_STRING) {
+		g_string_append (out, json_node_get_string (node));
+		type = DECSYNC_JSON_STRING;
+	} else if (JSON_NODE_HOLDS_VALUE (node) && json_node_get_value_type (node) == G_TYPE_BOOLEAN) {
+		type = json_node_get_boolean (node) ? DECSYNC_JSON_TRUE : DECSYNC_JSON_FALSE;
+	} else {
+		type = DECSYNC_JSON_OTHER;
+	}
+
+	json_node_free (node);
+
+	return type;
+}
+
+/* Decodes the JSON scalar @json. When it is a string, its contents
+ * replace those of @out. */
+DecsyncJsonType
+decsync_json_decode (const gchar *json,
+                     GString *out)
+{
+	const gchar *ptr;
+	DecsyncJsonType type;
+
+	g_return_val_if_fail (out != NULL, DECSYNC_JSON_INVALID);
+
+	g_string_truncate (out, 0);
+
+	if (!json)
+		return DECSYNC_JSON_INVALID;
+
+	ptr = json;
+	while (g_ascii_isspace (*ptr))
+		ptr++;
+
+	if (*ptr == '"') {
+		ptr = json_decode_string (ptr, out);
+		type = DECSYNC_JSON_STRING;
+	} else if (strncmp (ptr, "null", 4) == 0) {
+		ptr += 4;
+		type = DECSYNC_JSON_NULL;
+	} else if (strncmp (ptr, "true", 4) == 0) {
+		ptr += 4;
+		type = DECSYNC_JSON_TRUE;
+	} else if (strncmp (ptr, "false", 5) == 0) {
+		ptr += 5;
+		type = DECSYNC_JSON_FALSE;
+	} else {
+		ptr = NULL;
+		type = DECSYNC_JSON_INVALID;
+	}
+
+	if (ptr) {
+		while (g_ascii_isspace (*ptr))
+			ptr++;
+		if (*ptr == '\0')
+			return type;
+	}
+
+	g_string_truncate (out, 0);
+
+	return json_decode_fallback (json, out);
+}
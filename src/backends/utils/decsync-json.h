@@ -0,0 +1,52 @@
+/**
+ * Evolution-DecSync - decsync-json.h
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECSYNC_JSON_H
+#define DECSYNC_JSON_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	DECSYNC_JSON_INVALID,
+	DECSYNC_JSON_NULL,
+	DECSYNC_JSON_TRUE,
+	DECSYNC_JSON_FALSE,
+	DECSYNC_JSON_STRING,
+	DECSYNC_JSON_OTHER
+} DecsyncJsonType;
+
+/* Indices of the per-thread buffers returned by decsync_json_buffer() */
+enum {
+	DECSYNC_JSON_BUFFER_KEY,
+	DECSYNC_JSON_BUFFER_VALUE,
+	DECSYNC_JSON_N_BUFFERS
+};
+
+GString *	decsync_json_buffer		(guint index);
+void		decsync_json_append_string	(GString *out,
+						 const gchar *str);
+const gchar *	decsync_json_encode_string	(GString *buffer,
+						 const gchar *str);
+DecsyncJsonType	decsync_json_decode		(const gchar *json,
+						 GString *out);
+
+G_END_DECLS
+
+#endif /* DECSYNC_JSON_H */
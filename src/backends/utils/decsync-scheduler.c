@@ -0,0 +1,429 @@
+/**
+ * Evolution-DecSync - decsync-scheduler.c
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "evolution-decsync-config.h"
+
+#include <libedataserver/libedataserver.h>
+
+#include "decsync-fingerprint.h"
+#include "decsync-scheduler.h"
+
+/* Shares the periodic refresh of the collections of one DecSync directory
+ * between all backends of the factory process. There is a single timer
+ * per directory; on each tick the collections which are due are
+ * fingerprinted once, in parallel, and only the backends of the
+ * collections which changed are called. All of it runs in bounded pools
+ * of worker threads, so collections are read in parallel without a
+ * thread per backend. */
+
+#define TICK_SECONDS 60
+#define MAX_WORKERS 8
+
+typedef struct _SchedulerDir SchedulerDir;
+
+typedef struct {
+	guint id;
+	SchedulerDir *dir;
+	gchar *key; /* collections with the same key share a fingerprint */
+	gchar *sync_type;
+	gchar *collection;
+	gchar *own_app_id;
+	gint64 interval;
+	gint64 next_due;
+	gchar *sync_state; /* the fingerprint it was last called with */
+	gboolean queued;
+	gboolean running;
+	gboolean removed;
+	gint ref_count;
+
+	DecsyncSchedulerFunc func;
+	gpointer user_data;
+} SchedulerEntry;
+
+struct _SchedulerDir {
+	gchar *decsync_dir;
+	GPtrArray *entries; /* SchedulerEntry * */
+	guint tick_id;
+	gboolean scanning;
+};
+
+/* Either a scan of @dir or a call of @entry */
+typedef struct {
+	SchedulerDir *dir;
+	SchedulerEntry *entry;
+	gchar *sync_state;
+} SchedulerTask;
+
+/* Waited for by a scan until all of its walks are done */
+typedef struct {
+	GMutex lock;
+	GCond cond;
+	guint pending;
+} SchedulerWalkBatch;
+
+/* Takes the fingerprint of the collection of @entry */
+typedef struct {
+	SchedulerDir *dir;
+	SchedulerEntry *entry;
+	gchar *sync_state;
+	SchedulerWalkBatch *batch;
+} SchedulerWalk;
+
+/* Everything below is protected by scheduler_lock. There are only a few
+ * DecSync directories, so a SchedulerDir is kept once created. */
+static GMutex scheduler_lock;
+static GCond scheduler_cond;
+static GHashTable *scheduler_dirs; /* gchar *decsync_dir -> SchedulerDir * */
+static GHashTable *scheduler_entries; /* guint id -> SchedulerEntry * */
+static GThreadPool *scheduler_pool;
+static GThreadPool *scheduler_walk_pool; /* SchedulerWalk *, apart from the
+					  * scans which wait for them */
+static guint scheduler_last_id;
+
+/* Called with scheduler_lock held */
+static void
+scheduler_entry_unref (SchedulerEntry *entry)
+{
+	if (--entry->ref_count > 0)
+		return;
+
+	g_free (entry->key);
+	g_free (entry->sync_type);
+	g_free (entry->collection);
+	g_free (entry->own_app_id);
+	g_free (entry->sync_state);
+	g_free (entry);
+}
+
+/* The names are never changed, so they can be read unlocked */
+static void
+scheduler_walk (SchedulerWalk *walk)
+{
+	SchedulerEntry *entry = walk->entry;
+
+	walk->sync_state = decsync_fingerprint_compute (walk->dir->decsync_dir,
+		entry->sync_type, entry->collection, entry->own_app_id);
+}
+
+static void
+scheduler_run_walk (gpointer data,
+                    gpointer user_data)
+{
+	SchedulerWalk *walk = data;
+	SchedulerWalkBatch *batch = walk->batch;
+
+	scheduler_walk (walk);
+
+	g_mutex_lock (&batch->lock);
+	if (--batch->pending == 0)
+		g_cond_signal (&batch->cond);
+	g_mutex_unlock (&batch->lock);
+}
+
+/* Fingerprints the collections of @walks, in parallel when there are
+ * several of them */
+static void
+scheduler_walk_all (GPtrArray *walks)
+{
+	SchedulerWalkBatch batch;
+	guint ii;
+
+	if (walks->len < 2) {
+		for (ii = 0; ii < walks->len; ii++)
+			scheduler_walk (g_ptr_array_index (walks, ii));
+
+		return;
+	}
+
+	g_mutex_init (&batch.lock);
+	g_cond_init (&batch.cond);
+	batch.pending = walks->len;
+
+	for (ii = 0; ii < walks->len; ii++) {
+		SchedulerWalk *walk = g_ptr_array_index (walks, ii);
+
+		walk->batch = &batch;
+		g_thread_pool_push (scheduler_walk_pool, walk, NULL);
+	}
+
+	g_mutex_lock (&batch.lock);
+	while (batch.pending > 0)
+		g_cond_wait (&batch.cond, &batch.lock);
+	g_mutex_unlock (&batch.lock);
+
+	g_mutex_clear (&batch.lock);
+	g_cond_clear (&batch.cond);
+}
+
+static void
+scheduler_walk_free (gpointer data)
+{
+	SchedulerWalk *walk = data;
+
+	g_free (walk->sync_state);
+	g_free (walk);
+}
+
+static void
+scheduler_scan (SchedulerDir *dir)
+{
+	GPtrArray *due, *walks;
+	GHashTable *sync_states; /* const gchar *key -> const gchar *sync_state */
+	gint64 now;
+	guint ii;
+
+	due = g_ptr_array_new ();
+
+	g_mutex_lock (&scheduler_lock);
+
+	now = g_get_monotonic_time ();
+	for (ii = 0; ii < dir->entries->len; ii++) {
+		SchedulerEntry *entry = g_ptr_array_index (dir->entries, ii);
+
+		if (!entry->queued && !entry->running && entry->next_due <= now) {
+			entry->ref_count++;
+			g_ptr_array_add (due, entry);
+		}
+	}
+
+	g_mutex_unlock (&scheduler_lock);
+
+	/* Entries with the same key share a walk */
+	sync_states = g_hash_table_new (g_str_hash, g_str_equal);
+	walks = g_ptr_array_new_with_free_func (scheduler_walk_free);
+	for (ii = 0; ii < due->len; ii++) {
+		SchedulerEntry *entry = g_ptr_array_index (due, ii);
+
+		if (!g_hash_table_contains (sync_states, entry->key)) {
+			SchedulerWalk *walk;
+
+			walk = g_new0 (SchedulerWalk, 1);
+			walk->dir = dir;
+			walk->entry = entry;
+			g_ptr_array_add (walks, walk);
+
+			g_hash_table_insert (sync_states, entry->key, NULL);
+		}
+	}
+
+	scheduler_walk_all (walks);
+
+	for (ii = 0; ii < walks->len; ii++) {
+		SchedulerWalk *walk = g_ptr_array_index (walks, ii);
+
+		g_hash_table_insert (sync_states, walk->entry->key, walk->sync_state);
+	}
+
+	g_mutex_lock (&scheduler_lock);
+
+	now = g_get_monotonic_time ();
+	for (ii = 0; ii < due->len; ii++) {
+		SchedulerEntry *entry = g_ptr_array_index (due, ii);
+		const gchar *sync_state = g_hash_table_lookup (sync_states, entry->key);
+
+		entry->next_due = now + entry->interval;
+
+		/* Without a fingerprint the backend reads the collection anyway */
+		if (!entry->removed && (!sync_state || g_strcmp0 (sync_state, entry->sync_state) != 0)) {
+			SchedulerTask *task;
+
+			/* Hands over the reference */
+			task = g_new0 (SchedulerTask, 1);
+			task->entry = entry;
+			task->sync_state = g_strdup (sync_state);
+
+			entry->queued = TRUE;
+			g_thread_pool_push (scheduler_pool, task, NULL);
+		} else {
+			scheduler_entry_unref (entry);
+		}
+	}
+
+	dir->scanning = FALSE;
+
+	g_mutex_unlock (&scheduler_lock);
+
+	g_hash_table_destroy (sync_states);
+	g_ptr_array_free (walks, TRUE);
+	g_ptr_array_free (due, TRUE);
+}
+
+static void
+scheduler_dispatch (SchedulerEntry *entry,
+                    const gchar *sync_state)
+{
+	g_mutex_lock (&scheduler_lock);
+
+	entry->queued = FALSE;
+	if (entry->removed) {
+		scheduler_entry_unref (entry);
+		g_mutex_unlock (&scheduler_lock);
+		return;
+	}
+	entry->running = TRUE;
+
+	g_mutex_unlock (&scheduler_lock);
+
+	entry->func (sync_state, entry->user_data);
+
+	g_mutex_lock (&scheduler_lock);
+
+	g_free (entry->sync_state);
+	entry->sync_state = g_strdup (sync_state);
+	entry->running = FALSE;
+	g_cond_broadcast (&scheduler_cond);
+	scheduler_entry_unref (entry);
+
+	g_mutex_unlock (&scheduler_lock);
+}
+
+static void
+scheduler_run_task (gpointer data,
+                    gpointer user_data)
+{
+	SchedulerTask *task = data;
+
+	if (task->dir)
+		scheduler_scan (task->dir);
+	else
+		scheduler_dispatch (task->entry, task->sync_state);
+
+	g_free (task->sync_state);
+	g_free (task);
+}
+
+static gboolean
+scheduler_tick_cb (gpointer user_data)
+{
+	SchedulerDir *dir = user_data;
+
+	g_mutex_lock (&scheduler_lock);
+
+	/* A slow scan is not queued twice */
+	if (!dir->scanning && dir->entries->len > 0) {
+		SchedulerTask *task;
+
+		task = g_new0 (SchedulerTask, 1);
+		task->dir = dir;
+
+		dir->scanning = TRUE;
+		g_thread_pool_push (scheduler_pool, task, NULL);
+	}
+
+	g_mutex_unlock (&scheduler_lock);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* Calls @func whenever another app wrote to the collection, checking at
+ * most every @interval_seconds. Returns an id for decsync_scheduler_remove(). */
+guint
+decsync_scheduler_add (const gchar *decsync_dir,
+                       const gchar *sync_type,
+                       const gchar *collection,
+                       const gchar *own_app_id,
+                       guint interval_seconds,
+                       DecsyncSchedulerFunc func,
+                       gpointer user_data)
+{
+	SchedulerDir *dir;
+	SchedulerEntry *entry;
+	guint id;
+
+	g_return_val_if_fail (decsync_dir != NULL, 0);
+	g_return_val_if_fail (sync_type != NULL, 0);
+	g_return_val_if_fail (interval_seconds > 0, 0);
+	g_return_val_if_fail (func != NULL, 0);
+
+	g_mutex_lock (&scheduler_lock);
+
+	if (!scheduler_dirs) {
+		scheduler_dirs = g_hash_table_new (g_str_hash, g_str_equal);
+		scheduler_entries = g_hash_table_new (g_direct_hash, g_direct_equal);
+		scheduler_pool = g_thread_pool_new (scheduler_run_task, NULL,
+			CLAMP (g_get_num_processors (), 1, MAX_WORKERS), FALSE, NULL);
+		scheduler_walk_pool = g_thread_pool_new (scheduler_run_walk, NULL,
+			CLAMP (g_get_num_processors (), 1, MAX_WORKERS), FALSE, NULL);
+	}
+
+	dir = g_hash_table_lookup (scheduler_dirs, decsync_dir);
+	if (!dir) {
+		dir = g_new0 (SchedulerDir, 1);
+		dir->decsync_dir = g_strdup (decsync_dir);
+		dir->entries = g_ptr_array_new ();
+		g_hash_table_insert (scheduler_dirs, dir->decsync_dir, dir);
+	}
+
+	entry = g_new0 (SchedulerEntry, 1);
+	entry->id = id = ++scheduler_last_id;
+	entry->dir = dir;
+	entry->key = g_strjoin ("/", sync_type, collection ? collection : "", own_app_id ? own_app_id : "", NULL);
+	entry->sync_type = g_strdup (sync_type);
+	entry->collection = g_strdup (collection);
+	entry->own_app_id = g_strdup (own_app_id);
+	entry->interval = (gint64) interval_seconds * G_USEC_PER_SEC;
+	entry->next_due = g_get_monotonic_time () + entry->interval;
+	entry->ref_count = 1;
+	entry->func = func;
+	entry->user_data = user_data;
+
+	g_ptr_array_add (dir->entries, entry);
+	g_hash_table_insert (scheduler_entries, GUINT_TO_POINTER (id), entry);
+
+	if (!dir->tick_id)
+		dir->tick_id = e_named_timeout_add_seconds (TICK_SECONDS, scheduler_tick_cb, dir);
+
+	g_mutex_unlock (&scheduler_lock);
+
+	return id;
+}
+
+/* Stops calling the function added with decsync_scheduler_add(), waiting
+ * for a running call to finish, so its user data can be freed right after.
+ * Cannot be called from the function itself. */
+void
+decsync_scheduler_remove (guint id)
+{
+	SchedulerEntry *entry;
+	SchedulerDir *dir;
+
+	g_mutex_lock (&scheduler_lock);
+
+	entry = scheduler_entries ? g_hash_table_lookup (scheduler_entries, GUINT_TO_POINTER (id)) : NULL;
+	if (!entry) {
+		g_mutex_unlock (&scheduler_lock);
+		return;
+	}
+
+	dir = entry->dir;
+	g_hash_table_remove (scheduler_entries, GUINT_TO_POINTER (id));
+	g_ptr_array_remove (dir->entries, entry);
+	entry->removed = TRUE;
+
+	if (dir->entries->len == 0 && dir->tick_id) {
+		g_source_remove (dir->tick_id);
+		dir->tick_id = 0;
+	}
+
+	while (entry->running)
+		g_cond_wait (&scheduler_cond, &scheduler_lock);
+
+	scheduler_entry_unref (entry);
+
+	g_mutex_unlock (&scheduler_lock);
+}
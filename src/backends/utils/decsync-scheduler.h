@@ -0,0 +1,42 @@
+/**
+ * Evolution-DecSync - decsync-scheduler.h
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECSYNC_SCHEDULER_H
+#define DECSYNC_SCHEDULER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Called in a worker thread with the fingerprint of the changed
+ * collection, see decsync_fingerprint_compute() */
+typedef void (*DecsyncSchedulerFunc) (const gchar *sync_state,
+				      gpointer user_data);
+
+guint		decsync_scheduler_add		(const gchar *decsync_dir,
+						 const gchar *sync_type,
+						 const gchar *collection,
+						 const gchar *own_app_id,
+						 guint interval_seconds,
+						 DecsyncSchedulerFunc func,
+						 gpointer user_data);
+void		decsync_scheduler_remove	(guint id);
+
+G_END_DECLS
+
+#endif /* DECSYNC_SCHEDULER_H */
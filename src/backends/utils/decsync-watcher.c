@@ -0,0 +1,283 @@
+/**
+ * Evolution-DecSync - decsync-watcher.c
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "evolution-decsync-config.h"
+
+#include <string.h>
+
+#include <libedataserver/libedataserver.h>
+
+#include "decsync-watcher.h"
+
+/* Watches the directory of a DecSync collection for entries written by
+ * other apps. Bursts of changes, like the ones caused by a file
+ * synchronizer, are collapsed into a single call of the callback. */
+
+#define DEBOUNCE_MSECS 2000
+#define MAX_DELAY_USECS (30 * G_USEC_PER_SEC)
+
+/* Deep enough for both the new-entries/<app-id>/<path> layout and
+ * the v2/<app-id>/<hash> layout */
+#define MAX_DEPTH 4
+
+struct _DecsyncWatcher {
+	GFile *root;
+	gchar *own_app_id;
+	GHashTable *monitors; /* gchar *path -> GFileMonitor * */
+
+	guint debounce_id;
+	gint64 first_change_time;
+
+	GSourceFunc func;
+	gpointer user_data;
+};
+
+static void	watcher_changed_cb	(GFileMonitor *monitor,
+					 GFile *file,
+					 GFile *other_file,
+					 GFileMonitorEvent event_type,
+					 gpointer user_data);
+
+static void
+watcher_monitor_free (gpointer data)
+{
+	GFileMonitor *monitor = data;
+
+	g_signal_handlers_disconnect_matched (
+		monitor, G_SIGNAL_MATCH_FUNC, 0, 0, NULL, watcher_changed_cb, NULL);
+	g_file_monitor_cancel (monitor);
+	g_object_unref (monitor);
+}
+
+/* Returns the depth of @file below the collection directory, or -1 when
+ * it should be ignored. Our own entries are written by ourselves, so
+ * there is no need to read them back. */
+static gint
+watcher_get_depth (DecsyncWatcher *watcher,
+                   GFile *file)
+{
+	gchar *relative_path, **segments;
+	gint depth, ii;
+
+	if (g_file_equal (watcher->root, file))
+		return 0;
+
+	relative_path = g_file_get_relative_path (watcher->root, file);
+	if (!relative_path)
+		return -1;
+
+	segments = g_strsplit (relative_path, G_DIR_SEPARATOR_S, -1);
+	depth = g_strv_length (segments);
+
+	for (ii = 0; segments[ii]; ii++) {
+		if (g_strcmp0 (segments[ii], watcher->own_app_id) == 0) {
+			depth = -1;
+			break;
+		}
+	}
+
+	g_strfreev (segments);
+	g_free (relative_path);
+
+	return depth;
+}
+
+static void
+watcher_add_directory (DecsyncWatcher *watcher,
+                       GFile *dir,
+                       gint depth)
+{
+	GFileMonitor *monitor;
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	gchar *path;
+
+	if (depth < 0 || depth > MAX_DEPTH)
+		return;
+
+	path = g_file_get_path (dir);
+	if (!path || g_hash_table_contains (watcher->monitors, path)) {
+		g_free (path);
+		return;
+	}
+
+	monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+	if (!monitor) {
+		g_free (path);
+		return;
+	}
+
+	g_signal_connect (monitor, "changed", G_CALLBACK (watcher_changed_cb), watcher);
+	g_hash_table_insert (watcher->monitors, path, monitor);
+
+	if (depth == MAX_DEPTH)
+		return;
+
+	enumerator = g_file_enumerate_children (
+		dir,
+		G_FILE_ATTRIBUTE_STANDARD_NAME ","
+		G_FILE_ATTRIBUTE_STANDARD_TYPE,
+		G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+		NULL, NULL);
+	if (!enumerator)
+		return;
+
+	while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL) {
+		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+			GFile *child;
+
+			child = g_file_get_child (dir, g_file_info_get_name (info));
+			if (watcher_get_depth (watcher, child) >= 0)
+				watcher_add_directory (watcher, child, depth + 1);
+			g_object_unref (child);
+		}
+
+		g_object_unref (info);
+	}
+
+	g_object_unref (enumerator);
+}
+
+static gboolean
+watcher_debounce_cb (gpointer user_data)
+{
+	DecsyncWatcher *watcher = user_data;
+
+	watcher->debounce_id = 0;
+	watcher->first_change_time = 0;
+
+	watcher->func (watcher->user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+watcher_schedule (DecsyncWatcher *watcher)
+{
+	gint64 now;
+
+	now = g_get_monotonic_time ();
+
+	if (watcher->debounce_id) {
+		/* Keep postponing during a burst, but not indefinitely */
+		if (now - watcher->first_change_time >= MAX_DELAY_USECS)
+			return;
+
+		g_source_remove (watcher->debounce_id);
+	} else {
+		watcher->first_change_time = now;
+	}
+
+	watcher->debounce_id = e_named_timeout_add (DEBOUNCE_MSECS, watcher_debounce_cb, watcher);
+}
+
+static void
+watcher_changed_cb (GFileMonitor *monitor,
+                    GFile *file,
+                    GFile *other_file,
+                    GFileMonitorEvent event_type,
+                    gpointer user_data)
+{
+	DecsyncWatcher *watcher = user_data;
+	GFile *changed_file = file;
+	gint depth;
+
+	switch (event_type) {
+		case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+		case G_FILE_MONITOR_EVENT_PRE_UNMOUNT:
+		case G_FILE_MONITOR_EVENT_UNMOUNTED:
+		case G_FILE_MONITOR_EVENT_MOVED_OUT:
+			return;
+		case G_FILE_MONITOR_EVENT_RENAMED:
+			if (other_file)
+				changed_file = other_file;
+			break;
+		default:
+			break;
+	}
+
+	depth = watcher_get_depth (watcher, changed_file);
+	if (depth < 0)
+		return;
+
+	if (event_type == G_FILE_MONITOR_EVENT_DELETED) {
+		gchar *path = g_file_get_path (changed_file);
+
+		if (path)
+			g_hash_table_remove (watcher->monitors, path);
+		g_free (path);
+	} else if (event_type == G_FILE_MONITOR_EVENT_CREATED ||
+		   event_type == G_FILE_MONITOR_EVENT_MOVED_IN ||
+		   event_type == G_FILE_MONITOR_EVENT_RENAMED) {
+		if (g_file_query_file_type (changed_file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL) == G_FILE_TYPE_DIRECTORY)
+			watcher_add_directory (watcher, changed_file, depth);
+	}
+
+	watcher_schedule (watcher);
+}
+
+DecsyncWatcher *
+decsync_watcher_new (const gchar *decsync_dir,
+                     const gchar *sync_type,
+                     const gchar *collection,
+                     const gchar *own_app_id,
+                     GSourceFunc func,
+                     gpointer user_data)
+{
+	DecsyncWatcher *watcher;
+	gchar *root_path;
+
+	g_return_val_if_fail (decsync_dir != NULL, NULL);
+	g_return_val_if_fail (sync_type != NULL, NULL);
+	g_return_val_if_fail (func != NULL, NULL);
+
+	watcher = g_new0 (DecsyncWatcher, 1);
+
+	if (collection && *collection)
+		root_path = g_build_filename (decsync_dir, sync_type, collection, NULL);
+	else
+		root_path = g_build_filename (decsync_dir, sync_type, NULL);
+
+	watcher->root = g_file_new_for_path (root_path);
+	watcher->own_app_id = g_strdup (own_app_id);
+	watcher->monitors = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, watcher_monitor_free);
+	watcher->func = func;
+	watcher->user_data = user_data;
+
+	watcher_add_directory (watcher, watcher->root, 0);
+
+	g_free (root_path);
+
+	return watcher;
+}
+
+void
+decsync_watcher_free (DecsyncWatcher *watcher)
+{
+	if (!watcher)
+		return;
+
+	if (watcher->debounce_id)
+		g_source_remove (watcher->debounce_id);
+
+	g_hash_table_destroy (watcher->monitors);
+	g_object_unref (watcher->root);
+	g_free (watcher->own_app_id);
+
+	g_free (watcher);
+}
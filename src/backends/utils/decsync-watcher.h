@@ -0,0 +1,38 @@
+/**
+ * Evolution-DecSync - decsync-watcher.h
+ *
+ * Copyright (C) 2018 Aldo Gunsing
+ *
+ * This library is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECSYNC_WATCHER_H
+#define DECSYNC_WATCHER_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _DecsyncWatcher DecsyncWatcher;
+
+DecsyncWatcher *	decsync_watcher_new	(const gchar *decsync_dir,
+						 const gchar *sync_type,
+						 const gchar *collection,
+						 const gchar *own_app_id,
+						 GSourceFunc func,
+						 gpointer user_data);
+void			decsync_watcher_free	(DecsyncWatcher *watcher);
+
+G_END_DECLS
+
+#endif /* DECSYNC_WATCHER_H */
@@ -24,13 +24,17 @@ struct _ESourceDecsyncPrivate {
 	gchar *decsync_dir;
 	gchar *collection;
 	gchar *appid;
+	gboolean watch_changes;
+	gboolean autocomplete_index;
 };
 
 enum {
 	PROP_0,
 	PROP_DECSYNC_DIR,
 	PROP_COLLECTION,
-	PROP_APPID
+	PROP_APPID,
+	PROP_WATCH_CHANGES,
+	PROP_AUTOCOMPLETE_INDEX
 };
 
 G_DEFINE_TYPE_WITH_CODE (
@@ -63,6 +67,18 @@ source_decsync_set_property (GObject *object,
 				E_SOURCE_DECSYNC (object),
 				g_value_get_string (value));
 			return;
+
+		case PROP_WATCH_CHANGES:
+			e_source_decsync_set_watch_changes (
+				E_SOURCE_DECSYNC (object),
+				g_value_get_boolean (value));
+			return;
+
+		case PROP_AUTOCOMPLETE_INDEX:
+			e_source_decsync_set_autocomplete_index (
+				E_SOURCE_DECSYNC (object),
+				g_value_get_boolean (value));
+			return;
 	}
 
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -95,6 +111,20 @@ source_decsync_get_property (GObject *object,
 				e_source_decsync_dup_appid (
 				E_SOURCE_DECSYNC (object)));
 			return;
+
+		case PROP_WATCH_CHANGES:
+			g_value_set_boolean (
+				value,
+				e_source_decsync_get_watch_changes (
+				E_SOURCE_DECSYNC (object)));
+			return;
+
+		case PROP_AUTOCOMPLETE_INDEX:
+			g_value_set_boolean (
+				value,
+				e_source_decsync_get_autocomplete_index (
+				E_SOURCE_DECSYNC (object)));
+			return;
 	}
 
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -164,6 +194,30 @@ e_source_decsync_class_init (ESourceDecsyncClass *class)
 			G_PARAM_READWRITE |
 			G_PARAM_CONSTRUCT |
 			E_SOURCE_PARAM_SETTING));
+
+	g_object_class_install_property (
+		object_class,
+		PROP_WATCH_CHANGES,
+		g_param_spec_boolean (
+			"watch-changes",
+			"Watch Changes",
+			"Watch the DecSync directory for changes",
+			FALSE,
+			G_PARAM_READWRITE |
+			G_PARAM_CONSTRUCT |
+			E_SOURCE_PARAM_SETTING));
+
+	g_object_class_install_property (
+		object_class,
+		PROP_AUTOCOMPLETE_INDEX,
+		g_param_spec_boolean (
+			"autocomplete-index",
+			"Autocomplete Index",
+			"Keep an index of the names and emails for autocompletion",
+			FALSE,
+			G_PARAM_READWRITE |
+			G_PARAM_CONSTRUCT |
+			E_SOURCE_PARAM_SETTING));
 }
 
 static void
@@ -309,3 +363,45 @@ e_source_decsync_set_appid (ESourceDecsync *extension, const gchar *appid)
 
 	g_object_notify (G_OBJECT (extension), "app-id");
 }
+
+gboolean
+e_source_decsync_get_watch_changes (ESourceDecsync *extension)
+{
+	g_return_val_if_fail (E_IS_SOURCE_DECSYNC (extension), FALSE);
+
+	return extension->priv->watch_changes;
+}
+
+void
+e_source_decsync_set_watch_changes (ESourceDecsync *extension, gboolean watch_changes)
+{
+	g_return_if_fail (E_IS_SOURCE_DECSYNC (extension));
+
+	if (extension->priv->watch_changes == watch_changes)
+		return;
+
+	extension->priv->watch_changes = watch_changes;
+
+	g_object_notify (G_OBJECT (extension), "watch-changes");
+}
+
+gboolean
+e_source_decsync_get_autocomplete_index (ESourceDecsync *extension)
+{
+	g_return_val_if_fail (E_IS_SOURCE_DECSYNC (extension), FALSE);
+
+	return extension->priv->autocomplete_index;
+}
+
+void
+e_source_decsync_set_autocomplete_index (ESourceDecsync *extension, gboolean autocomplete_index)
+{
+	g_return_if_fail (E_IS_SOURCE_DECSYNC (extension));
+
+	if (extension->priv->autocomplete_index == autocomplete_index)
+		return;
+
+	extension->priv->autocomplete_index = autocomplete_index;
+
+	g_object_notify (G_OBJECT (extension), "autocomplete-index");
+}
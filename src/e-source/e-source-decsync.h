@@ -76,6 +76,10 @@ void		e_source_decsync_set_collection	(ESourceDecsync *extension, const gchar *c
 const gchar *	e_source_decsync_get_appid	(ESourceDecsync *extension);
 gchar *		e_source_decsync_dup_appid	(ESourceDecsync *extension);
 void		e_source_decsync_set_appid	(ESourceDecsync *extension, const gchar *appid);
+gboolean	e_source_decsync_get_watch_changes	(ESourceDecsync *extension);
+void		e_source_decsync_set_watch_changes	(ESourceDecsync *extension, gboolean watch_changes);
+gboolean	e_source_decsync_get_autocomplete_index	(ESourceDecsync *extension);
+void		e_source_decsync_set_autocomplete_index	(ESourceDecsync *extension, gboolean autocomplete_index);
 
 G_END_DECLS
 
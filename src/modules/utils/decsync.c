@@ -17,7 +17,7 @@
  */
 
 #include "decsync.h"
-#include <json-glib/json-glib.h>
+#include <backends/utils/decsync-json.h>
 #include <libdecsync.h>
 
 typedef struct _Context Context;
@@ -49,79 +49,63 @@ config_decsync_context_free (Context *context)
 static gchar *
 getInfo (const gchar *decsyncDir, const gchar *syncType, const gchar *collection, const gchar *name, const gchar *fallback)
 {
-	bool deleted;
-	JsonNode *key_node, *value_node;
-	gchar *key_string, value_string[256], *result;
-	GError *error = NULL;
-
-	key_node = json_node_new (JSON_NODE_VALUE);
-	json_node_set_string (key_node, "deleted");
-	key_string = json_to_string (key_node, FALSE);
-	decsync_get_static_info (decsyncDir, syncType, collection, key_string, value_string, 256);
-	json_node_free (key_node);
-	g_free (key_string);
-	value_node = json_from_string (value_string, &error);
-	if (error != NULL) {
+	GString *key, *value;
+	DecsyncJsonType value_type;
+	gchar value_string[256];
+
+	key = decsync_json_buffer (DECSYNC_JSON_BUFFER_KEY);
+	value = decsync_json_buffer (DECSYNC_JSON_BUFFER_VALUE);
+
+	decsync_get_static_info (decsyncDir, syncType, collection,
+		decsync_json_encode_string (key, "deleted"), value_string, 256);
+	value_type = decsync_json_decode (value_string, value);
+	if (value_type == DECSYNC_JSON_INVALID) {
 		g_warning ("Invalid JSON for static info 'deleted': %s", value_string);
-		g_error_free (error);
 		return NULL;
 	}
-	deleted = !json_node_is_null (value_node) && json_node_get_boolean (value_node);
-	json_node_free (value_node);
-	if (deleted)
+	if (value_type == DECSYNC_JSON_TRUE)
 		return NULL;
 
-	key_node = json_node_new (JSON_NODE_VALUE);
-	json_node_set_string (key_node, name);
-	key_string = json_to_string (key_node, FALSE);
-	decsync_get_static_info (decsyncDir, syncType, collection, key_string, value_string, 256);
-	json_node_free (key_node);
-	g_free (key_string);
-	value_node = json_from_string (value_string, &error);
-	if (error != NULL) {
+	decsync_get_static_info (decsyncDir, syncType, collection,
+		decsync_json_encode_string (key, name), value_string, 256);
+	value_type = decsync_json_decode (value_string, value);
+	if (value_type == DECSYNC_JSON_INVALID) {
 		g_warning ("Invalid JSON for static info '%s': %s", name, value_string);
-		g_error_free (error);
 		return NULL;
 	}
-	result = g_strdup (json_node_is_null (value_node) ? fallback : json_node_get_string (value_node));
-	json_node_free (value_node);
-	return result;
+	return g_strdup (value_type == DECSYNC_JSON_NULL ? fallback : value_type == DECSYNC_JSON_STRING ? value->str : NULL);
 }
 
 static void
-setInfoEntry (const gchar *decsyncDir, const gchar *syncType, const gchar *collection, const gchar *name, JsonNode *value_node)
+setInfoEntry (const gchar *decsyncDir, const gchar *syncType, const gchar *collection, const gchar *name, const gchar *value_string)
 {
 	Decsync decsync;
 	const gchar *path[1];
 	gchar ownAppId[256];
-	JsonNode *key_node;
-	gchar *key_string, *value_string;
 
 	decsync_get_app_id ("Evolution", ownAppId, 256);
 	decsync_new (&decsync, decsyncDir, syncType, collection, ownAppId);
 	path[0] = "info";
-	key_node = json_node_new (JSON_NODE_VALUE);
-	json_node_set_string (key_node, name);
-	key_string = json_to_string (key_node, FALSE);
-	value_string = json_to_string (value_node, FALSE);
-	decsync_set_entry (decsync, path, 1, key_string, value_string);
-	json_node_free (key_node);
-	g_free (key_string);
-	g_free (value_string);
+	decsync_set_entry (decsync, path, 1,
+		decsync_json_encode_string (decsync_json_buffer (DECSYNC_JSON_BUFFER_KEY), name),
+		value_string);
 	decsync_free (decsync);
 }
 
+static void
+setInfoString (const gchar *decsyncDir, const gchar *syncType, const gchar *collection, const gchar *name, const gchar *value)
+{
+	setInfoEntry (decsyncDir, syncType, collection, name,
+		decsync_json_encode_string (decsync_json_buffer (DECSYNC_JSON_BUFFER_VALUE), value));
+}
+
 static gchar *
 createCollection (const gchar *decsyncDir, const gchar *syncType, const gchar *name)
 {
 	gchar *collection;
-	JsonNode *value_node;
 
 	collection = g_strdup_printf ("colID%05d", rand () % 100000);
-	value_node = json_node_new (JSON_NODE_VALUE);
-	json_node_set_string (value_node, name);
-	setInfoEntry(decsyncDir, syncType, collection, "name", value_node);
-	json_node_free (value_node);
+	setInfoString (decsyncDir, syncType, collection, "name", name);
 	return collection;
 }
 
@@ -329,7 +313,6 @@ config_decsync_collection_rename_cb (GtkButton *button, Context *context)
 	GtkWidget *dialog, *container, *widget;
 	gpointer parent;
 	gint position;
-	JsonNode *value_node;
 
 	config = e_source_config_backend_get_config (context->backend);
 	extension_name = E_SOURCE_EXTENSION_DECSYNC_BACKEND;
@@ -361,10 +344,7 @@ config_decsync_collection_rename_cb (GtkButton *button, Context *context)
 		name = gtk_entry_get_text (GTK_ENTRY (widget));
 		if (name != NULL && *name != '\0' && g_strcmp0 (name, name_old)) {
 			dir = e_source_decsync_get_decsync_dir (E_SOURCE_DECSYNC (extension));
-			value_node = json_node_new (JSON_NODE_VALUE);
-			json_node_set_string (value_node, name);
-			setInfoEntry (dir, context->sync_type, collection, "name", value_node);
-			json_node_free (value_node);
+			setInfoString (dir, context->sync_type, collection, "name", name);
 			gtk_combo_box_text_remove (context->collection_combo_box, position);
 			gtk_combo_box_text_insert (context->collection_combo_box, position, collection, name);
 			gtk_combo_box_set_active_id (GTK_COMBO_BOX (context->collection_combo_box), collection);
@@ -383,7 +363,6 @@ config_decsync_collection_delete_cb (GtkButton *button, Context *context)
 	GtkWidget *dialog;
 	gpointer parent;
 	gint position;
-	JsonNode *value_node;
 
 	config = e_source_config_backend_get_config (context->backend);
 	extension_name = E_SOURCE_EXTENSION_DECSYNC_BACKEND;
@@ -408,10 +387,7 @@ config_decsync_collection_delete_cb (GtkButton *button, Context *context)
 	g_free (title);
 
 	if (gtk_dialog_run (GTK_DIALOG (dialog)) == GTK_RESPONSE_YES) {
-		value_node = json_node_new (JSON_NODE_VALUE);
-		json_node_set_boolean (value_node, TRUE);
-		setInfoEntry (dir, context->sync_type, collection, "deleted", value_node);
-		json_node_free (value_node);
+		setInfoEntry (dir, context->sync_type, collection, "deleted", "true");
 		position = gtk_combo_box_get_active (GTK_COMBO_BOX (context->collection_combo_box));
 		gtk_combo_box_text_remove (context->collection_combo_box, position);
 	}
@@ -525,6 +501,32 @@ config_decsync_insert_widgets (const gchar *sync_type, const gchar *sync_type_ti
 
 	config_decsync_update_combo_box (context);
 
+	widget = gtk_check_button_new_with_label (
+		_("Watch the directory for changes"));
+	e_source_config_insert_widget (
+		config, scratch_source, NULL, widget);
+	gtk_widget_show (widget);
+
+	e_binding_bind_property (
+		extension, "watch-changes",
+		widget, "active",
+		G_BINDING_BIDIRECTIONAL |
+		G_BINDING_SYNC_CREATE);
+
+	if (g_strcmp0 (sync_type, "contacts") == 0) {
+		widget = gtk_check_button_new_with_label (
+			_("Index names and emails for autocompletion"));
+		e_source_config_insert_widget (
+			config, scratch_source, NULL, widget);
+		gtk_widget_show (widget);
+
+		e_binding_bind_property (
+			extension, "autocomplete-index",
+			widget, "active",
+			G_BINDING_BIDIRECTIONAL |
+			G_BINDING_SYNC_CREATE);
+	}
+
 	e_source_config_add_refresh_interval (config, scratch_source);
 }
 
@@ -564,7 +566,6 @@ config_decsync_commit_changes (ESourceConfigBackend *backend, ESource *scratch_s
 	Context *context;
 	const gchar *uid, *extension_name, *decsync_dir, *collection, *old_appid, *new_color;
 	gchar new_appid[256], *old_color;
-	JsonNode *value_node;
 
 	uid = e_source_get_uid (scratch_source);
 	context = g_object_get_data (G_OBJECT (backend), uid);
@@ -594,10 +595,7 @@ config_decsync_commit_changes (ESourceConfigBackend *backend, ESource *scratch_s
 		old_color = getInfo (decsync_dir, context->sync_type, collection, "color", NULL);
 
 		if (g_strcmp0 (new_color, old_color)) {
-			value_node = json_node_new (JSON_NODE_VALUE);
-			json_node_set_string (value_node, new_color);
-			setInfoEntry (decsync_dir, context->sync_type, collection, "color", value_node);
-			json_node_free (value_node);
+			setInfoString (decsync_dir, context->sync_type, collection, "color", new_color);
 		}
 
 		g_free (old_color);